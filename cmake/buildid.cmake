@@ -0,0 +1,41 @@
+# This file is part of SynthXEX, one component of the
+# OpenXeChain development toolchain
+#
+# Copyright (c) 2025 Aiden Isik
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Affero General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Affero General Public License for more details.
+#
+# You should have received a copy of the GNU Affero General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+# Run at build time (cmake -P) with SOURCE_LIST, BUILD_TYPE and OUTPUT set. Writes a header defining
+# SYNTHXEX_BUILD_ID, the SHA1 of every source file along with the build type, so it changes whenever the
+# code that's built does, tagged release or not. The header's only rewritten when it changes, so an
+# unchanged tree doesn't rebuild anything.
+
+file(STRINGS ${SOURCE_LIST} sources)
+set(hashes "${BUILD_TYPE}")
+
+foreach(source ${sources})
+  file(SHA1 ${source} hash)
+  string(APPEND hashes " ${hash}")
+endforeach()
+
+string(SHA1 buildId "${hashes}")
+set(content "#define SYNTHXEX_BUILD_ID \"${buildId}-${BUILD_TYPE}\"\n")
+
+if(EXISTS ${OUTPUT})
+  file(READ ${OUTPUT} oldContent)
+endif()
+
+if(NOT "${content}" STREQUAL "${oldContent}")
+  file(WRITE ${OUTPUT} "${content}")
+endif()
@@ -0,0 +1,76 @@
+/* aes-encrypt-arm64.c
+
+   CBC mode encryption with AES-128, using the ARMv8 cryptography
+   extensions.
+
+   Copyright (C) 2025 Aiden Isik
+
+   This file is part of GNU Nettle.
+
+   GNU Nettle is free software: you can redistribute it and/or
+   modify it under the terms of either:
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at your
+       option) any later version.
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at your
+       option) any later version.
+
+   or both in parallel, as here.
+
+   GNU Nettle is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see http://www.gnu.org/licenses/.
+*/
+
+#if HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "aes.h"
+#include "fat-setup.h"
+
+#if HAVE_NATIVE_aes128_encrypt && defined(__aarch64__)
+
+#include <arm_neon.h>
+
+/* Built with -march=armv8-a+crypto (see CMakeLists.txt), only called
+   if the CPU reports support for it. AESE includes the AddRoundKey at
+   the start of each round, so the last key is added separately. */
+void
+_nettle_cbc_aes128_encrypt_arm64(const struct aes128_ctx *ctx, uint8_t *iv,
+				 size_t length, uint8_t *dst,
+				 const uint8_t *src)
+{
+  uint8x16_t K[_AES128_ROUNDS + 1];
+  uint8x16_t X = vld1q_u8(iv);
+  unsigned i;
+
+  for (i = 0; i <= _AES128_ROUNDS; i++)
+    K[i] = vld1q_u8(ctx->keys[i]);
+
+  for (; length >= AES_BLOCK_SIZE;
+       length -= AES_BLOCK_SIZE, src += AES_BLOCK_SIZE, dst += AES_BLOCK_SIZE)
+    {
+      X = veorq_u8(X, vld1q_u8(src));
+
+      for (i = 0; i < _AES128_ROUNDS - 1; i++)
+	X = vaesmcq_u8(vaeseq_u8(X, K[i]));
+
+      X = veorq_u8(vaeseq_u8(X, K[_AES128_ROUNDS - 1]), K[_AES128_ROUNDS]);
+      vst1q_u8(dst, X);
+    }
+
+  vst1q_u8(iv, X);
+}
+
+#endif /* HAVE_NATIVE_aes128_encrypt && __aarch64__ */
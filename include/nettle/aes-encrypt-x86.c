@@ -0,0 +1,88 @@
+/* aes-encrypt-x86.c
+
+   CBC mode encryption with AES-128, using the x86 AES instructions
+   (AES-NI).
+
+   Copyright (C) 2025 Aiden Isik
+
+   This file is part of GNU Nettle.
+
+   GNU Nettle is free software: you can redistribute it and/or
+   modify it under the terms of either:
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at your
+       option) any later version.
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at your
+       option) any later version.
+
+   or both in parallel, as here.
+
+   GNU Nettle is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see http://www.gnu.org/licenses/.
+*/
+
+#if HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "aes.h"
+#include "fat-setup.h"
+
+#if HAVE_NATIVE_aes128_encrypt && (defined(__x86_64__) || defined(__i386__))
+
+#include <immintrin.h>
+
+/* Built with -maes -msse2 (see CMakeLists.txt), only called if the CPU
+   reports support for them. CBC is serial, so this is latency bound;
+   the round keys stay in registers for the whole message. */
+void
+_nettle_cbc_aes128_encrypt_aesni(const struct aes128_ctx *ctx, uint8_t *iv,
+				 size_t length, uint8_t *dst,
+				 const uint8_t *src)
+{
+  __m128i K0 = _mm_loadu_si128((const __m128i *) ctx->keys[0]);
+  __m128i K1 = _mm_loadu_si128((const __m128i *) ctx->keys[1]);
+  __m128i K2 = _mm_loadu_si128((const __m128i *) ctx->keys[2]);
+  __m128i K3 = _mm_loadu_si128((const __m128i *) ctx->keys[3]);
+  __m128i K4 = _mm_loadu_si128((const __m128i *) ctx->keys[4]);
+  __m128i K5 = _mm_loadu_si128((const __m128i *) ctx->keys[5]);
+  __m128i K6 = _mm_loadu_si128((const __m128i *) ctx->keys[6]);
+  __m128i K7 = _mm_loadu_si128((const __m128i *) ctx->keys[7]);
+  __m128i K8 = _mm_loadu_si128((const __m128i *) ctx->keys[8]);
+  __m128i K9 = _mm_loadu_si128((const __m128i *) ctx->keys[9]);
+  __m128i K10 = _mm_loadu_si128((const __m128i *) ctx->keys[10]);
+  __m128i X = _mm_loadu_si128((const __m128i *) iv);
+
+  for (; length >= AES_BLOCK_SIZE;
+       length -= AES_BLOCK_SIZE, src += AES_BLOCK_SIZE, dst += AES_BLOCK_SIZE)
+    {
+      X = _mm_xor_si128(X, _mm_loadu_si128((const __m128i *) src));
+      X = _mm_xor_si128(X, K0);
+      X = _mm_aesenc_si128(X, K1);
+      X = _mm_aesenc_si128(X, K2);
+      X = _mm_aesenc_si128(X, K3);
+      X = _mm_aesenc_si128(X, K4);
+      X = _mm_aesenc_si128(X, K5);
+      X = _mm_aesenc_si128(X, K6);
+      X = _mm_aesenc_si128(X, K7);
+      X = _mm_aesenc_si128(X, K8);
+      X = _mm_aesenc_si128(X, K9);
+      X = _mm_aesenclast_si128(X, K10);
+      _mm_storeu_si128((__m128i *) dst, X);
+    }
+
+  _mm_storeu_si128((__m128i *) iv, X);
+}
+
+#endif /* HAVE_NATIVE_aes128_encrypt && x86 */
@@ -0,0 +1,47 @@
+/* aes-internal.h
+
+   The aes/rijndael block cipher, internal declarations.
+
+   Copyright (C) 2025 Aiden Isik
+
+   This file is part of GNU Nettle.
+
+   GNU Nettle is free software: you can redistribute it and/or
+   modify it under the terms of either:
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at your
+       option) any later version.
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at your
+       option) any later version.
+
+   or both in parallel, as here.
+
+   GNU Nettle is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef NETTLE_AES_INTERNAL_H_INCLUDED
+#define NETTLE_AES_INTERNAL_H_INCLUDED
+
+#include "aes.h"
+
+/* Multiplication by x in GF(2^8) */
+#define AES_XTIME(x) ((uint8_t) (((x) << 1) ^ (((x) & 0x80) ? 0x1b : 0)))
+
+extern const uint8_t _nettle_aes_sbox[0x100];
+
+void
+_nettle_aes128_encrypt_block(const struct aes128_ctx *ctx, uint8_t *block);
+
+#endif /* NETTLE_AES_INTERNAL_H_INCLUDED */
@@ -0,0 +1,74 @@
+/* aes-set-encrypt-key.c
+
+   Key setup for the aes/rijndael block cipher.
+
+   Copyright (C) 2000, 2001, 2002 Rafael R. Sevilla, Niels Möller
+   Copyright (C) 2025 Aiden Isik
+
+   This file is part of GNU Nettle.
+
+   GNU Nettle is free software: you can redistribute it and/or
+   modify it under the terms of either:
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at your
+       option) any later version.
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at your
+       option) any later version.
+
+   or both in parallel, as here.
+
+   GNU Nettle is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see http://www.gnu.org/licenses/.
+*/
+
+#if HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <string.h>
+
+#include "aes-internal.h"
+
+void
+aes128_set_encrypt_key(struct aes128_ctx *ctx, const uint8_t *key)
+{
+  uint8_t *w = ctx->keys[0];
+  uint8_t rcon = 1;
+  unsigned i;
+
+  memcpy(w, key, AES128_KEY_SIZE);
+
+  for (i = AES128_KEY_SIZE; i < sizeof(ctx->keys); i += 4)
+    {
+      uint8_t t[4];
+
+      memcpy(t, w + i - 4, 4);
+
+      if (i % AES128_KEY_SIZE == 0)
+	{
+	  /* RotWord, SubWord and the round constant */
+	  uint8_t first = t[0];
+	  t[0] = _nettle_aes_sbox[t[1]] ^ rcon;
+	  t[1] = _nettle_aes_sbox[t[2]];
+	  t[2] = _nettle_aes_sbox[t[3]];
+	  t[3] = _nettle_aes_sbox[first];
+	  rcon = AES_XTIME(rcon);
+	}
+
+      w[i] = w[i - AES128_KEY_SIZE] ^ t[0];
+      w[i + 1] = w[i + 1 - AES128_KEY_SIZE] ^ t[1];
+      w[i + 2] = w[i + 2 - AES128_KEY_SIZE] ^ t[2];
+      w[i + 3] = w[i + 3 - AES128_KEY_SIZE] ^ t[3];
+    }
+}
@@ -0,0 +1,81 @@
+/* aes.h
+
+   The aes/rijndael block cipher (AES-128 encryption only).
+
+   Copyright (C) 2025 Aiden Isik
+
+   This file is part of GNU Nettle.
+
+   GNU Nettle is free software: you can redistribute it and/or
+   modify it under the terms of either:
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at your
+       option) any later version.
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at your
+       option) any later version.
+
+   or both in parallel, as here.
+
+   GNU Nettle is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef NETTLE_AES_H_INCLUDED
+#define NETTLE_AES_H_INCLUDED
+
+#include "nettle-types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Name mangling */
+#define aes128_set_encrypt_key nettle_aes128_set_encrypt_key
+#define aes128_encrypt nettle_aes128_encrypt
+#define cbc_aes128_encrypt nettle_cbc_aes128_encrypt
+
+#define AES_BLOCK_SIZE 16
+
+#define AES128_KEY_SIZE 16
+#define _AES128_ROUNDS 10
+
+/* Round keys are kept as bytes, in the order the hardware instructions
+   load them, so every implementation can share the key schedule. */
+struct aes128_ctx
+{
+  uint8_t keys[_AES128_ROUNDS + 1][AES_BLOCK_SIZE];
+};
+
+void
+aes128_set_encrypt_key(struct aes128_ctx *ctx, const uint8_t *key);
+
+/* Encrypts LENGTH bytes, a multiple of AES_BLOCK_SIZE, block by block (ECB). */
+void
+aes128_encrypt(const struct aes128_ctx *ctx,
+	       size_t length, uint8_t *dst,
+	       const uint8_t *src);
+
+/* CBC encryption of LENGTH bytes, a multiple of AES_BLOCK_SIZE. IV is
+   updated to the last ciphertext block, so a long message can be
+   encrypted in several calls. DST may be equal to SRC. */
+void
+cbc_aes128_encrypt(const struct aes128_ctx *ctx, uint8_t *iv,
+		   size_t length, uint8_t *dst,
+		   const uint8_t *src);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NETTLE_AES_H_INCLUDED */
@@ -0,0 +1,70 @@
+/* cbc-aes128-encrypt.c
+
+   CBC mode encryption with AES-128, portable C.
+
+   Copyright (C) 2001, 2011 Niels Möller
+   Copyright (C) 2025 Aiden Isik
+
+   This file is part of GNU Nettle.
+
+   GNU Nettle is free software: you can redistribute it and/or
+   modify it under the terms of either:
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at your
+       option) any later version.
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at your
+       option) any later version.
+
+   or both in parallel, as here.
+
+   GNU Nettle is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see http://www.gnu.org/licenses/.
+*/
+
+#if HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <assert.h>
+#include <string.h>
+
+#include "aes-internal.h"
+#include "fat-setup.h"
+#include "macros.h"
+
+/* For fat builds */
+#if HAVE_NATIVE_aes128_encrypt
+void
+_nettle_cbc_aes128_encrypt_c(const struct aes128_ctx *ctx, uint8_t *iv,
+			     size_t length, uint8_t *dst,
+			     const uint8_t *src);
+#define nettle_cbc_aes128_encrypt _nettle_cbc_aes128_encrypt_c
+#endif
+
+void
+nettle_cbc_aes128_encrypt(const struct aes128_ctx *ctx, uint8_t *iv,
+			  size_t length, uint8_t *dst,
+			  const uint8_t *src)
+{
+  FOR_BLOCKS(length, dst, src, AES_BLOCK_SIZE)
+    {
+      unsigned i;
+
+      for (i = 0; i < AES_BLOCK_SIZE; i++)
+	iv[i] ^= src[i];
+
+      _nettle_aes128_encrypt_block(ctx, iv);
+      memcpy(dst, iv, AES_BLOCK_SIZE);
+    }
+}
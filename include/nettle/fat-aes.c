@@ -0,0 +1,114 @@
+/* fat-aes.c
+
+   Runtime selection of the AES-128 CBC encryption function.
+
+   Copyright (C) 2025 Aiden Isik
+
+   This file is part of GNU Nettle.
+
+   GNU Nettle is free software: you can redistribute it and/or
+   modify it under the terms of either:
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at your
+       option) any later version.
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at your
+       option) any later version.
+
+   or both in parallel, as here.
+
+   GNU Nettle is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see http://www.gnu.org/licenses/.
+*/
+
+#if HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "aes.h"
+#include "fat-setup.h"
+
+#if HAVE_NATIVE_aes128_encrypt
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <cpuid.h>
+# define AES_FEATURE_NAME "aes_ni"
+#elif defined(__aarch64__)
+# if defined(__linux__)
+#  include <sys/auxv.h>
+#  ifndef HWCAP_AES
+#   define HWCAP_AES (1 << 3)
+#  endif
+# endif
+# define AES_FEATURE_NAME "aes"
+#else
+# error "HAVE_NATIVE_aes128_encrypt set for an unsupported architecture"
+#endif
+
+static cbc_aes128_encrypt_func *cbc_aes128_encrypt_vec = _nettle_cbc_aes128_encrypt_c;
+
+static int
+have_aes(void)
+{
+  const char *s = getenv(ENV_OVERRIDE);
+
+  if (s)
+    return _nettle_fat_feature_listed(s, AES_FEATURE_NAME);
+
+#if defined(__x86_64__) || defined(__i386__)
+  {
+    unsigned eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+      return 0;
+
+    return (ecx & bit_AES) && (edx & bit_SSE2);
+  }
+#elif defined(__linux__)
+  return (getauxval(AT_HWCAP) & HWCAP_AES) != 0;
+#elif defined(__APPLE__)
+  /* Every Apple ARM64 CPU has the cryptography extensions */
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+static void __attribute__((constructor))
+fat_aes_init(void)
+{
+  int aes = have_aes();
+
+#if defined(__x86_64__) || defined(__i386__)
+  cbc_aes128_encrypt_vec = aes ? _nettle_cbc_aes128_encrypt_aesni : _nettle_cbc_aes128_encrypt_c;
+#else
+  cbc_aes128_encrypt_vec = aes ? _nettle_cbc_aes128_encrypt_arm64 : _nettle_cbc_aes128_encrypt_c;
+#endif
+
+  if (getenv(ENV_VERBOSE) != NULL)
+    fprintf(stderr, "libnettle: using %s cbc_aes128_encrypt.\n",
+	    aes ? AES_FEATURE_NAME : "portable");
+}
+
+void
+nettle_cbc_aes128_encrypt(const struct aes128_ctx *ctx, uint8_t *iv,
+			  size_t length, uint8_t *dst,
+			  const uint8_t *src)
+{
+  cbc_aes128_encrypt_vec(ctx, iv, length, dst, src);
+}
+
+#endif /* HAVE_NATIVE_aes128_encrypt */
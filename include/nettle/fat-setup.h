@@ -0,0 +1,73 @@
+/* fat-setup.h
+
+   Declarations for runtime selection of accelerated functions.
+
+   Copyright (C) 2025 Aiden Isik
+
+   This file is part of GNU Nettle.
+
+   GNU Nettle is free software: you can redistribute it and/or
+   modify it under the terms of either:
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at your
+       option) any later version.
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at your
+       option) any later version.
+
+   or both in parallel, as here.
+
+   GNU Nettle is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef NETTLE_FAT_SETUP_H_INCLUDED
+#define NETTLE_FAT_SETUP_H_INCLUDED
+
+#include "nettle-types.h"
+
+/* Same environment variables as upstream fat builds. The override is a
+   comma separated list of CPU features to use instead of the detected
+   ones, so e.g. NETTLE_FAT_OVERRIDE=none forces the portable C code. */
+#define ENV_OVERRIDE "NETTLE_FAT_OVERRIDE"
+#define ENV_VERBOSE "NETTLE_FAT_VERBOSE"
+
+typedef void sha1_compress_func(uint32_t *state, const uint8_t *input);
+
+sha1_compress_func _nettle_sha1_compress_c;
+sha1_compress_func _nettle_sha1_compress_sha_ni;
+sha1_compress_func _nettle_sha1_compress_arm64;
+
+/* Multi-buffer compression, see sha1-multi-kernel.h for the layout */
+typedef void sha1_compress_multi_func(uint32_t *state, const uint8_t *const *data, size_t blocks);
+
+sha1_compress_multi_func _nettle_sha1_compress_x8_avx2;
+sha1_compress_multi_func _nettle_sha1_compress_x4_sse2;
+sha1_compress_multi_func _nettle_sha1_compress_x4_neon;
+
+extern sha1_compress_multi_func *_nettle_sha1_compress_multi_vec;
+extern unsigned _nettle_sha1_multi_lanes;
+
+/* Whether FEATURE is in the comma separated LIST (as in ENV_OVERRIDE) */
+int _nettle_fat_feature_listed(const char *list, const char *feature);
+
+struct aes128_ctx;
+
+typedef void cbc_aes128_encrypt_func(const struct aes128_ctx *ctx, uint8_t *iv,
+				     size_t length, uint8_t *dst, const uint8_t *src);
+
+cbc_aes128_encrypt_func _nettle_cbc_aes128_encrypt_c;
+cbc_aes128_encrypt_func _nettle_cbc_aes128_encrypt_aesni;
+cbc_aes128_encrypt_func _nettle_cbc_aes128_encrypt_arm64;
+
+#endif /* NETTLE_FAT_SETUP_H_INCLUDED */
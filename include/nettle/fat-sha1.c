@@ -0,0 +1,209 @@
+/* fat-sha1.c
+
+   Runtime selection of the sha1 compression function.
+
+   Copyright (C) 2025 Aiden Isik
+
+   This file is part of GNU Nettle.
+
+   GNU Nettle is free software: you can redistribute it and/or
+   modify it under the terms of either:
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at your
+       option) any later version.
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at your
+       option) any later version.
+
+   or both in parallel, as here.
+
+   GNU Nettle is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see http://www.gnu.org/licenses/.
+*/
+
+#if HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "sha1.h"
+#include "fat-setup.h"
+
+#if HAVE_NATIVE_sha1_compress
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <cpuid.h>
+#elif defined(__aarch64__)
+# if defined(__linux__)
+#  include <sys/auxv.h>
+#  ifndef HWCAP_SHA1
+#   define HWCAP_SHA1 (1 << 5)
+#  endif
+# endif
+#else
+# error "HAVE_NATIVE_sha1_compress set for an unsupported architecture"
+#endif
+
+/* CPU features we care about, named as in upstream fat builds */
+#define FEATURE_SHA 1 /* sha_ni on x86, sha1 on arm64 */
+#define FEATURE_SIMD_WIDE 2 /* avx2 on x86 */
+#define FEATURE_SIMD 4 /* sse2 on x86, neon on arm64 */
+
+#if defined(__x86_64__) || defined(__i386__)
+static const char *const feature_names[] = { "sha_ni", "avx2", "sse2" };
+#else
+static const char *const feature_names[] = { "sha1", "", "neon" };
+#endif
+
+static sha1_compress_func *sha1_compress_vec = _nettle_sha1_compress_c;
+
+/* Checks for FEATURE in a comma separated list, shared with fat-aes.c */
+int
+_nettle_fat_feature_listed(const char *list, const char *feature)
+{
+  size_t length = strlen(feature);
+
+  if (length == 0)
+    return 0;
+
+  while (*list)
+    {
+      const char *end = strchr(list, ',');
+      size_t item = end ? (size_t) (end - list) : strlen(list);
+
+      if (item == length && memcmp(list, feature, length) == 0)
+	return 1;
+
+      list += item;
+      if (*list == ',')
+	list++;
+    }
+
+  return 0;
+}
+
+static unsigned
+get_features(void)
+{
+  const char *s = getenv(ENV_OVERRIDE);
+  unsigned features = 0;
+  unsigned i;
+
+  if (s)
+    {
+      for (i = 0; i < sizeof(feature_names) / sizeof(feature_names[0]); i++)
+	if (_nettle_fat_feature_listed(s, feature_names[i]))
+	  features |= 1 << i;
+
+      return features;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+  {
+    unsigned eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+      return 0;
+
+    if (edx & bit_SSE2)
+      features |= FEATURE_SIMD;
+
+    /* SSSE3 and SSE4.1 are needed for the SHA-NI byte shuffles and lane extract,
+       and AVX2 needs the OS to save the YMM registers */
+    int have_sse41 = (ecx & bit_SSSE3) && (ecx & bit_SSE4_1);
+    int have_ymm = 0;
+
+    if (ecx & bit_OSXSAVE)
+      {
+	unsigned xcr0, xcr0_high;
+	__asm__ ("xgetbv" : "=a" (xcr0), "=d" (xcr0_high) : "c" (0));
+	have_ymm = (xcr0 & 6) == 6;
+      }
+
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+      {
+	if (have_sse41 && (ebx & bit_SHA))
+	  features |= FEATURE_SHA;
+	if (have_ymm && (ebx & bit_AVX2))
+	  features |= FEATURE_SIMD_WIDE;
+      }
+  }
+#elif defined(__aarch64__)
+  features |= FEATURE_SIMD;
+# if defined(__linux__)
+  if (getauxval(AT_HWCAP) & HWCAP_SHA1)
+    features |= FEATURE_SHA;
+# elif defined(__APPLE__)
+  /* Every Apple ARM64 CPU has the cryptography extensions */
+  features |= FEATURE_SHA;
+# endif
+#endif
+
+  return features;
+}
+
+static void __attribute__((constructor))
+fat_init(void)
+{
+  int verbose = getenv(ENV_VERBOSE) != NULL;
+  unsigned features = get_features();
+
+  sha1_compress_vec = _nettle_sha1_compress_c;
+  _nettle_sha1_compress_multi_vec = NULL;
+  _nettle_sha1_multi_lanes = 1;
+
+  /* The sha1 instructions beat hashing several messages at once with
+     general purpose SIMD, so multi-buffer is only used without them */
+  if (features & FEATURE_SHA)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+      sha1_compress_vec = _nettle_sha1_compress_sha_ni;
+#else
+      sha1_compress_vec = _nettle_sha1_compress_arm64;
+#endif
+    }
+#if defined(__x86_64__) || defined(__i386__)
+  else if (features & FEATURE_SIMD_WIDE)
+    {
+      _nettle_sha1_compress_multi_vec = _nettle_sha1_compress_x8_avx2;
+      _nettle_sha1_multi_lanes = 8;
+    }
+  else if (features & FEATURE_SIMD)
+    {
+      _nettle_sha1_compress_multi_vec = _nettle_sha1_compress_x4_sse2;
+      _nettle_sha1_multi_lanes = 4;
+    }
+#else
+  else if (features & FEATURE_SIMD)
+    {
+      _nettle_sha1_compress_multi_vec = _nettle_sha1_compress_x4_neon;
+      _nettle_sha1_multi_lanes = 4;
+    }
+#endif
+
+  if (verbose)
+    fprintf(stderr, "libnettle: using %s sha1_compress, %u-way sha1_update_multi.\n",
+	    (features & FEATURE_SHA) ? feature_names[0] : "portable",
+	    _nettle_sha1_multi_lanes);
+}
+
+void
+nettle_sha1_compress(uint32_t *state, const uint8_t *input)
+{
+  sha1_compress_vec(state, input);
+}
+
+#endif /* HAVE_NATIVE_sha1_compress */
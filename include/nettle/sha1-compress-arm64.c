@@ -0,0 +1,209 @@
+/* sha1-compress-arm64.c
+
+   The compression function of the sha1 hash function, using the
+   ARMv8 cryptography extensions.
+
+   Copyright (C) 2025 Aiden Isik
+
+   This file is part of GNU Nettle.
+
+   GNU Nettle is free software: you can redistribute it and/or
+   modify it under the terms of either:
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at your
+       option) any later version.
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at your
+       option) any later version.
+
+   or both in parallel, as here.
+
+   GNU Nettle is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see http://www.gnu.org/licenses/.
+*/
+
+#if HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "sha1.h"
+#include "fat-setup.h"
+
+#if HAVE_NATIVE_sha1_compress && defined(__aarch64__)
+
+#include <arm_neon.h>
+
+/* Built with -march=armv8-a+crypto (see CMakeLists.txt), only called
+   if the CPU reports support for it. */
+void
+_nettle_sha1_compress_arm64(uint32_t *state, const uint8_t *input)
+{
+  uint32x4_t ABCD, ABCD_SAVE;
+  uint32x4_t TMP0, TMP1;
+  uint32x4_t MSG0, MSG1, MSG2, MSG3;
+  uint32_t E0, E0_SAVE, E1;
+
+  ABCD = vld1q_u32(state);
+  E0 = state[4];
+
+  ABCD_SAVE = ABCD;
+  E0_SAVE = E0;
+
+  /* The input words are big endian */
+  MSG0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(input)));
+  MSG1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(input + 16)));
+  MSG2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(input + 32)));
+  MSG3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(input + 48)));
+
+  TMP0 = vaddq_u32(MSG0, vdupq_n_u32(0x5A827999));
+  TMP1 = vaddq_u32(MSG1, vdupq_n_u32(0x5A827999));
+
+  /* Rounds 0-3 */
+  E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+  ABCD = vsha1cq_u32(ABCD, E0, TMP0);
+  TMP0 = vaddq_u32(MSG2, vdupq_n_u32(0x5A827999));
+  MSG0 = vsha1su0q_u32(MSG0, MSG1, MSG2);
+
+  /* Rounds 4-7 */
+  E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+  ABCD = vsha1cq_u32(ABCD, E1, TMP1);
+  TMP1 = vaddq_u32(MSG3, vdupq_n_u32(0x5A827999));
+  MSG0 = vsha1su1q_u32(MSG0, MSG3);
+  MSG1 = vsha1su0q_u32(MSG1, MSG2, MSG3);
+
+  /* Rounds 8-11 */
+  E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+  ABCD = vsha1cq_u32(ABCD, E0, TMP0);
+  TMP0 = vaddq_u32(MSG0, vdupq_n_u32(0x5A827999));
+  MSG1 = vsha1su1q_u32(MSG1, MSG0);
+  MSG2 = vsha1su0q_u32(MSG2, MSG3, MSG0);
+
+  /* Rounds 12-15 */
+  E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+  ABCD = vsha1cq_u32(ABCD, E1, TMP1);
+  TMP1 = vaddq_u32(MSG1, vdupq_n_u32(0x6ED9EBA1));
+  MSG2 = vsha1su1q_u32(MSG2, MSG1);
+  MSG3 = vsha1su0q_u32(MSG3, MSG0, MSG1);
+
+  /* Rounds 16-19 */
+  E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+  ABCD = vsha1cq_u32(ABCD, E0, TMP0);
+  TMP0 = vaddq_u32(MSG2, vdupq_n_u32(0x6ED9EBA1));
+  MSG3 = vsha1su1q_u32(MSG3, MSG2);
+  MSG0 = vsha1su0q_u32(MSG0, MSG1, MSG2);
+
+  /* Rounds 20-23 */
+  E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+  ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+  TMP1 = vaddq_u32(MSG3, vdupq_n_u32(0x6ED9EBA1));
+  MSG0 = vsha1su1q_u32(MSG0, MSG3);
+  MSG1 = vsha1su0q_u32(MSG1, MSG2, MSG3);
+
+  /* Rounds 24-27 */
+  E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+  ABCD = vsha1pq_u32(ABCD, E0, TMP0);
+  TMP0 = vaddq_u32(MSG0, vdupq_n_u32(0x6ED9EBA1));
+  MSG1 = vsha1su1q_u32(MSG1, MSG0);
+  MSG2 = vsha1su0q_u32(MSG2, MSG3, MSG0);
+
+  /* Rounds 28-31 */
+  E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+  ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+  TMP1 = vaddq_u32(MSG1, vdupq_n_u32(0x6ED9EBA1));
+  MSG2 = vsha1su1q_u32(MSG2, MSG1);
+  MSG3 = vsha1su0q_u32(MSG3, MSG0, MSG1);
+
+  /* Rounds 32-35 */
+  E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+  ABCD = vsha1pq_u32(ABCD, E0, TMP0);
+  TMP0 = vaddq_u32(MSG2, vdupq_n_u32(0x8F1BBCDC));
+  MSG3 = vsha1su1q_u32(MSG3, MSG2);
+  MSG0 = vsha1su0q_u32(MSG0, MSG1, MSG2);
+
+  /* Rounds 36-39 */
+  E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+  ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+  TMP1 = vaddq_u32(MSG3, vdupq_n_u32(0x8F1BBCDC));
+  MSG0 = vsha1su1q_u32(MSG0, MSG3);
+  MSG1 = vsha1su0q_u32(MSG1, MSG2, MSG3);
+
+  /* Rounds 40-43 */
+  E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+  ABCD = vsha1mq_u32(ABCD, E0, TMP0);
+  TMP0 = vaddq_u32(MSG0, vdupq_n_u32(0x8F1BBCDC));
+  MSG1 = vsha1su1q_u32(MSG1, MSG0);
+  MSG2 = vsha1su0q_u32(MSG2, MSG3, MSG0);
+
+  /* Rounds 44-47 */
+  E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+  ABCD = vsha1mq_u32(ABCD, E1, TMP1);
+  TMP1 = vaddq_u32(MSG1, vdupq_n_u32(0x8F1BBCDC));
+  MSG2 = vsha1su1q_u32(MSG2, MSG1);
+  MSG3 = vsha1su0q_u32(MSG3, MSG0, MSG1);
+
+  /* Rounds 48-51 */
+  E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+  ABCD = vsha1mq_u32(ABCD, E0, TMP0);
+  TMP0 = vaddq_u32(MSG2, vdupq_n_u32(0x8F1BBCDC));
+  MSG3 = vsha1su1q_u32(MSG3, MSG2);
+  MSG0 = vsha1su0q_u32(MSG0, MSG1, MSG2);
+
+  /* Rounds 52-55 */
+  E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+  ABCD = vsha1mq_u32(ABCD, E1, TMP1);
+  TMP1 = vaddq_u32(MSG3, vdupq_n_u32(0xCA62C1D6));
+  MSG0 = vsha1su1q_u32(MSG0, MSG3);
+  MSG1 = vsha1su0q_u32(MSG1, MSG2, MSG3);
+
+  /* Rounds 56-59 */
+  E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+  ABCD = vsha1mq_u32(ABCD, E0, TMP0);
+  TMP0 = vaddq_u32(MSG0, vdupq_n_u32(0xCA62C1D6));
+  MSG1 = vsha1su1q_u32(MSG1, MSG0);
+  MSG2 = vsha1su0q_u32(MSG2, MSG3, MSG0);
+
+  /* Rounds 60-63 */
+  E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+  ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+  TMP1 = vaddq_u32(MSG1, vdupq_n_u32(0xCA62C1D6));
+  MSG2 = vsha1su1q_u32(MSG2, MSG1);
+  MSG3 = vsha1su0q_u32(MSG3, MSG0, MSG1);
+
+  /* Rounds 64-67 */
+  E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+  ABCD = vsha1pq_u32(ABCD, E0, TMP0);
+  TMP0 = vaddq_u32(MSG2, vdupq_n_u32(0xCA62C1D6));
+  MSG3 = vsha1su1q_u32(MSG3, MSG2);
+
+  /* Rounds 68-71 */
+  E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+  ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+  TMP1 = vaddq_u32(MSG3, vdupq_n_u32(0xCA62C1D6));
+
+  /* Rounds 72-75 */
+  E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+  ABCD = vsha1pq_u32(ABCD, E0, TMP0);
+
+  /* Rounds 76-79 */
+  E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+  ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+
+  /* Add this block's result to the state */
+  E0 += E0_SAVE;
+  ABCD = vaddq_u32(ABCD, ABCD_SAVE);
+
+  vst1q_u32(state, ABCD);
+  state[4] = E0;
+}
+
+#endif
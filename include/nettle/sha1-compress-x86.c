@@ -0,0 +1,224 @@
+/* sha1-compress-x86.c
+
+   The compression function of the sha1 hash function, using the
+   x86 SHA extensions (SHA-NI).
+
+   Copyright (C) 2025 Aiden Isik
+
+   This file is part of GNU Nettle.
+
+   GNU Nettle is free software: you can redistribute it and/or
+   modify it under the terms of either:
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at your
+       option) any later version.
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at your
+       option) any later version.
+
+   or both in parallel, as here.
+
+   GNU Nettle is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see http://www.gnu.org/licenses/.
+*/
+
+#if HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "sha1.h"
+#include "fat-setup.h"
+
+#if HAVE_NATIVE_sha1_compress && (defined(__x86_64__) || defined(__i386__))
+
+#include <immintrin.h>
+
+/* Built with -msha -msse4.1 (see CMakeLists.txt), only called if
+   the CPU reports support for them. */
+void
+_nettle_sha1_compress_sha_ni(uint32_t *state, const uint8_t *input)
+{
+  __m128i ABCD, ABCD_SAVE, E0, E0_SAVE, E1;
+  __m128i MSG0, MSG1, MSG2, MSG3;
+
+  /* Byte order reversal, the input words are big endian */
+  const __m128i MASK = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+  /* The instructions keep A in the most significant word */
+  ABCD = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) state), 0x1B);
+  E0 = _mm_set_epi32(state[4], 0, 0, 0);
+
+  ABCD_SAVE = ABCD;
+  E0_SAVE = E0;
+
+  /* Rounds 0-3 */
+  MSG0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(input + 0)), MASK);
+  E0 = _mm_add_epi32(E0, MSG0);
+  E1 = ABCD;
+  ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
+
+  /* Rounds 4-7 */
+  MSG1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(input + 16)), MASK);
+  E1 = _mm_sha1nexte_epu32(E1, MSG1);
+  E0 = ABCD;
+  ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 0);
+  MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+
+  /* Rounds 8-11 */
+  MSG2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(input + 32)), MASK);
+  E0 = _mm_sha1nexte_epu32(E0, MSG2);
+  E1 = ABCD;
+  ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
+  MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+  MSG0 = _mm_xor_si128(MSG0, MSG2);
+
+  /* Rounds 12-15 */
+  MSG3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(input + 48)), MASK);
+  E1 = _mm_sha1nexte_epu32(E1, MSG3);
+  E0 = ABCD;
+  MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+  ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 0);
+  MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+  MSG1 = _mm_xor_si128(MSG1, MSG3);
+
+  /* Rounds 16-19 */
+  E0 = _mm_sha1nexte_epu32(E0, MSG0);
+  E1 = ABCD;
+  MSG1 = _mm_sha1msg2_epu32(MSG1, MSG0);
+  ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
+  MSG3 = _mm_sha1msg1_epu32(MSG3, MSG0);
+  MSG2 = _mm_xor_si128(MSG2, MSG0);
+
+  /* Rounds 20-23 */
+  E1 = _mm_sha1nexte_epu32(E1, MSG1);
+  E0 = ABCD;
+  MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+  ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 1);
+  MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+  MSG3 = _mm_xor_si128(MSG3, MSG1);
+
+  /* Rounds 24-27 */
+  E0 = _mm_sha1nexte_epu32(E0, MSG2);
+  E1 = ABCD;
+  MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+  ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 1);
+  MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+  MSG0 = _mm_xor_si128(MSG0, MSG2);
+
+  /* Rounds 28-31 */
+  E1 = _mm_sha1nexte_epu32(E1, MSG3);
+  E0 = ABCD;
+  MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+  ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 1);
+  MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+  MSG1 = _mm_xor_si128(MSG1, MSG3);
+
+  /* Rounds 32-35 */
+  E0 = _mm_sha1nexte_epu32(E0, MSG0);
+  E1 = ABCD;
+  MSG1 = _mm_sha1msg2_epu32(MSG1, MSG0);
+  ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 1);
+  MSG3 = _mm_sha1msg1_epu32(MSG3, MSG0);
+  MSG2 = _mm_xor_si128(MSG2, MSG0);
+
+  /* Rounds 36-39 */
+  E1 = _mm_sha1nexte_epu32(E1, MSG1);
+  E0 = ABCD;
+  MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+  ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 1);
+  MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+  MSG3 = _mm_xor_si128(MSG3, MSG1);
+
+  /* Rounds 40-43 */
+  E0 = _mm_sha1nexte_epu32(E0, MSG2);
+  E1 = ABCD;
+  MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+  ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 2);
+  MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+  MSG0 = _mm_xor_si128(MSG0, MSG2);
+
+  /* Rounds 44-47 */
+  E1 = _mm_sha1nexte_epu32(E1, MSG3);
+  E0 = ABCD;
+  MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+  ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 2);
+  MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+  MSG1 = _mm_xor_si128(MSG1, MSG3);
+
+  /* Rounds 48-51 */
+  E0 = _mm_sha1nexte_epu32(E0, MSG0);
+  E1 = ABCD;
+  MSG1 = _mm_sha1msg2_epu32(MSG1, MSG0);
+  ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 2);
+  MSG3 = _mm_sha1msg1_epu32(MSG3, MSG0);
+  MSG2 = _mm_xor_si128(MSG2, MSG0);
+
+  /* Rounds 52-55 */
+  E1 = _mm_sha1nexte_epu32(E1, MSG1);
+  E0 = ABCD;
+  MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+  ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 2);
+  MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+  MSG3 = _mm_xor_si128(MSG3, MSG1);
+
+  /* Rounds 56-59 */
+  E0 = _mm_sha1nexte_epu32(E0, MSG2);
+  E1 = ABCD;
+  MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+  ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 2);
+  MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+  MSG0 = _mm_xor_si128(MSG0, MSG2);
+
+  /* Rounds 60-63 */
+  E1 = _mm_sha1nexte_epu32(E1, MSG3);
+  E0 = ABCD;
+  MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+  ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 3);
+  MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+  MSG1 = _mm_xor_si128(MSG1, MSG3);
+
+  /* Rounds 64-67 */
+  E0 = _mm_sha1nexte_epu32(E0, MSG0);
+  E1 = ABCD;
+  MSG1 = _mm_sha1msg2_epu32(MSG1, MSG0);
+  ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 3);
+  MSG3 = _mm_sha1msg1_epu32(MSG3, MSG0);
+  MSG2 = _mm_xor_si128(MSG2, MSG0);
+
+  /* Rounds 68-71 */
+  E1 = _mm_sha1nexte_epu32(E1, MSG1);
+  E0 = ABCD;
+  MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+  ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 3);
+  MSG3 = _mm_xor_si128(MSG3, MSG1);
+
+  /* Rounds 72-75 */
+  E0 = _mm_sha1nexte_epu32(E0, MSG2);
+  E1 = ABCD;
+  MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+  ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 3);
+
+  /* Rounds 76-79 */
+  E1 = _mm_sha1nexte_epu32(E1, MSG3);
+  E0 = ABCD;
+  ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 3);
+
+  /* Add this block's result to the state */
+  E0 = _mm_sha1nexte_epu32(E0, E0_SAVE);
+  ABCD = _mm_add_epi32(ABCD, ABCD_SAVE);
+
+  _mm_storeu_si128((__m128i *) state, _mm_shuffle_epi32(ABCD, 0x1B));
+  state[4] = _mm_extract_epi32(E0, 3);
+}
+
+#endif
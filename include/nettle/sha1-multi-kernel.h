@@ -0,0 +1,101 @@
+/* sha1-multi-kernel.h
+
+   Multi-buffer sha1 compression, hashing one independent message per
+   SIMD lane. Included by the sha1-multi-*.c files, which define
+   SHA1_MULTI_LANES and SHA1_MULTI_FUNC and are built with the
+   matching instruction set enabled.
+
+   Copyright (C) 2025 Aiden Isik
+
+   This file is part of GNU Nettle.
+
+   GNU Nettle is free software: you can redistribute it and/or
+   modify it under the terms of either:
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at your
+       option) any later version.
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at your
+       option) any later version.
+
+   or both in parallel, as here.
+
+   GNU Nettle is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see http://www.gnu.org/licenses/.
+*/
+
+#include <string.h>
+
+#include "macros.h"
+
+typedef uint32_t sha1_vec __attribute__((vector_size(SHA1_MULTI_LANES * 4)));
+
+#define VROTL(n, x) (((x) << (n)) | ((x) >> (32 - (n))))
+
+#define VF1(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define VF2(x, y, z) ((x) ^ (y) ^ (z))
+#define VF3(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+
+#define VEXPAND(W, i) (W[(i) & 15] = \
+  VROTL(1, W[(i) & 15] ^ W[((i) - 14) & 15] ^ W[((i) - 8) & 15] ^ W[((i) - 3) & 15]))
+
+#define VROUND(f, k, data) do {					\
+    sha1_vec T = VROTL(5, A) + f(B, C, D) + E + (k) + (data);	\
+    E = D; D = C; C = VROTL(30, B); B = A; A = T;		\
+  } while (0)
+
+/* STATE holds the five state words transposed, i.e. word i of lane j
+   is at STATE[i * SHA1_MULTI_LANES + j]. DATA[j] points to BLOCKS
+   consecutive 64-byte blocks for lane j. */
+void
+SHA1_MULTI_FUNC(uint32_t *state, const uint8_t *const *data, size_t blocks)
+{
+  sha1_vec A, B, C, D, E;
+  sha1_vec W[16];
+  size_t b;
+  unsigned i, j;
+
+  memcpy(&A, state + 0 * SHA1_MULTI_LANES, sizeof(A));
+  memcpy(&B, state + 1 * SHA1_MULTI_LANES, sizeof(B));
+  memcpy(&C, state + 2 * SHA1_MULTI_LANES, sizeof(C));
+  memcpy(&D, state + 3 * SHA1_MULTI_LANES, sizeof(D));
+  memcpy(&E, state + 4 * SHA1_MULTI_LANES, sizeof(E));
+
+  for (b = 0; b < blocks; b++)
+    {
+      sha1_vec A0 = A, B0 = B, C0 = C, D0 = D, E0 = E;
+
+      for (i = 0; i < 16; i++)
+	for (j = 0; j < SHA1_MULTI_LANES; j++)
+	  W[i][j] = READ_UINT32(data[j] + b * 64 + i * 4);
+
+      for (i = 0; i < 16; i++)
+	VROUND(VF1, 0x5A827999, W[i]);
+      for (; i < 20; i++)
+	VROUND(VF1, 0x5A827999, VEXPAND(W, i));
+      for (; i < 40; i++)
+	VROUND(VF2, 0x6ED9EBA1, VEXPAND(W, i));
+      for (; i < 60; i++)
+	VROUND(VF3, 0x8F1BBCDC, VEXPAND(W, i));
+      for (; i < 80; i++)
+	VROUND(VF2, 0xCA62C1D6, VEXPAND(W, i));
+
+      A += A0; B += B0; C += C0; D += D0; E += E0;
+    }
+
+  memcpy(state + 0 * SHA1_MULTI_LANES, &A, sizeof(A));
+  memcpy(state + 1 * SHA1_MULTI_LANES, &B, sizeof(B));
+  memcpy(state + 2 * SHA1_MULTI_LANES, &C, sizeof(C));
+  memcpy(state + 3 * SHA1_MULTI_LANES, &D, sizeof(D));
+  memcpy(state + 4 * SHA1_MULTI_LANES, &E, sizeof(E));
+}
@@ -0,0 +1,50 @@
+/* sha1-multi-neon.c
+
+   Four-way multi-buffer sha1 compression using NEON.
+
+   Copyright (C) 2025 Aiden Isik
+
+   This file is part of GNU Nettle.
+
+   GNU Nettle is free software: you can redistribute it and/or
+   modify it under the terms of either:
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at your
+       option) any later version.
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at your
+       option) any later version.
+
+   or both in parallel, as here.
+
+   GNU Nettle is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see http://www.gnu.org/licenses/.
+*/
+
+#if HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "sha1.h"
+#include "fat-setup.h"
+
+#if HAVE_NATIVE_sha1_compress && defined(__aarch64__)
+
+/* NEON is part of the base ARM64 instruction set, so this needs no
+   extra flags. It is only used if the sha1 instructions are missing. */
+#define SHA1_MULTI_LANES 4
+#define SHA1_MULTI_FUNC _nettle_sha1_compress_x4_neon
+
+#include "sha1-multi-kernel.h"
+
+#endif
@@ -0,0 +1,93 @@
+/* sha1-multi.c
+
+   Hashing of many independent messages at once, using multi-buffer
+   SIMD compression functions where that is the fastest option.
+
+   Copyright (C) 2025 Aiden Isik
+
+   This file is part of GNU Nettle.
+
+   GNU Nettle is free software: you can redistribute it and/or
+   modify it under the terms of either:
+
+     * the GNU Lesser General Public License as published by the Free
+       Software Foundation; either version 3 of the License, or (at your
+       option) any later version.
+
+   or
+
+     * the GNU General Public License as published by the Free
+       Software Foundation; either version 2 of the License, or (at your
+       option) any later version.
+
+   or both in parallel, as here.
+
+   GNU Nettle is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received copies of the GNU General Public License and
+   the GNU Lesser General Public License along with this program.  If
+   not, see http://www.gnu.org/licenses/.
+*/
+
+#if HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <assert.h>
+
+#include "sha1.h"
+#include "fat-setup.h"
+
+/* Set by fat_init if a multi-buffer function should be used */
+sha1_compress_multi_func *_nettle_sha1_compress_multi_vec = NULL;
+unsigned _nettle_sha1_multi_lanes = 1;
+
+unsigned
+sha1_multi_lanes(void)
+{
+  return _nettle_sha1_multi_lanes;
+}
+
+void
+sha1_update_multi(struct sha1_ctx *ctx, size_t count,
+		  size_t length, const uint8_t *data, size_t stride)
+{
+  size_t i = 0;
+
+  assert(length % SHA1_BLOCK_SIZE == 0);
+
+  if (_nettle_sha1_compress_multi_vec)
+    {
+      unsigned lanes = _nettle_sha1_multi_lanes;
+      uint32_t state[_SHA1_DIGEST_LENGTH * SHA1_MULTI_MAX_LANES];
+      const uint8_t *lane[SHA1_MULTI_MAX_LANES];
+      unsigned j, k;
+
+      for (; i + lanes <= count; i += lanes)
+	{
+	  for (j = 0; j < lanes; j++)
+	    {
+	      assert(ctx[i + j].index == 0);
+	      for (k = 0; k < _SHA1_DIGEST_LENGTH; k++)
+		state[k * lanes + j] = ctx[i + j].state[k];
+	      lane[j] = data + (i + j) * stride;
+	    }
+
+	  _nettle_sha1_compress_multi_vec(state, lane, length / SHA1_BLOCK_SIZE);
+
+	  for (j = 0; j < lanes; j++)
+	    {
+	      for (k = 0; k < _SHA1_DIGEST_LENGTH; k++)
+		ctx[i + j].state[k] = state[k * lanes + j];
+	      ctx[i + j].count += length / SHA1_BLOCK_SIZE;
+	    }
+	}
+    }
+
+  /* Whatever doesn't fill all lanes goes through the normal path */
+  for (; i < count; i++)
+    sha1_update(&ctx[i], length, data + i * stride);
+}
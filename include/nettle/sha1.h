@@ -45,6 +45,8 @@ extern "C" {
 #define sha1_update nettle_sha1_update
 #define sha1_digest nettle_sha1_digest
 #define sha1_compress nettle_sha1_compress
+#define sha1_update_multi nettle_sha1_update_multi
+#define sha1_multi_lanes nettle_sha1_multi_lanes
 
 /* SHA1 */
 
@@ -53,6 +55,9 @@ extern "C" {
 /* For backwards compatibility */
 #define SHA1_DATA_SIZE SHA1_BLOCK_SIZE
 
+/* Most messages sha1_update_multi hashes at once. */
+#define SHA1_MULTI_MAX_LANES 8
+
 /* Digest is kept internally as 5 32-bit words. */
 #define _SHA1_DIGEST_LENGTH 5
 
@@ -77,6 +82,17 @@ sha1_digest(struct sha1_ctx *ctx,
 	    size_t length,
 	    uint8_t *digest);
 
+/* Absorbs LENGTH bytes, a multiple of SHA1_BLOCK_SIZE, into each of
+   COUNT contexts, with the message for CTX[i] at DATA + i * STRIDE.
+   The contexts must not have a partial block buffered. */
+void
+sha1_update_multi(struct sha1_ctx *ctx, size_t count,
+		  size_t length, const uint8_t *data, size_t stride);
+
+/* How many messages sha1_update_multi hashes at once, for batching. */
+unsigned
+sha1_multi_lanes(void);
+
 /* SHA1 compression function. STATE points to 5 uint32_t words,
    and DATA points to 64 bytes of input data, possibly unaligned. */
 void
@@ -0,0 +1,233 @@
+// This file is part of SynthXEX, one component of the
+// OpenXeChain development toolchain
+//
+// Copyright (c) 2025 Aiden Isik
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "hashcache.h"
+
+// Sidecar file header, followed by count entries
+struct pageHashCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pageSize;
+    uint32_t count;
+};
+
+#define FINGERPRINT_PRIME_1 0x9E3779B185EBCA87ULL
+#define FINGERPRINT_PRIME_2 0xC2B2AE3D27D4EB4FULL
+#define FINGERPRINT_PRIME_3 0x165667B19E3779F9ULL
+#define FINGERPRINT_PRIME_4 0x85EBCA77C2B2AE63ULL
+#define FINGERPRINT_PRIME_5 0x27D4EB2F165667C5ULL
+
+uint64_t rotateLeft64(uint64_t value, uint32_t bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+uint64_t fingerprintRound(uint64_t accumulator, uint64_t input)
+{
+    accumulator += input * FINGERPRINT_PRIME_2;
+    accumulator = rotateLeft64(accumulator, 31);
+    return accumulator * FINGERPRINT_PRIME_1;
+}
+
+uint64_t fingerprintMerge(uint64_t accumulator, uint64_t value)
+{
+    accumulator ^= fingerprintRound(0, value);
+    return accumulator * FINGERPRINT_PRIME_1 + FINGERPRINT_PRIME_4;
+}
+
+// A fast non-cryptographic hash (the same construction as xxHash's XXH64), many times quicker than SHA1.
+// It only has to tell a page that changed from one that didn't, nobody's trying to fool it.
+// Words are read in the host's byte order.
+uint64_t fingerprintData(const uint8_t *data, size_t length)
+{
+    const uint8_t *end = data + length;
+    uint64_t hash;
+
+    if(length >= 32)
+    {
+        uint64_t lanes[4] =
+        {
+            FINGERPRINT_PRIME_1 + FINGERPRINT_PRIME_2,
+            FINGERPRINT_PRIME_2,
+            0,
+            -FINGERPRINT_PRIME_1
+        };
+
+        // Four independent lanes, so the multiplies overlap
+        for(; end - data >= 32; data += 32)
+        {
+            uint64_t words[4];
+            memcpy(words, data, sizeof(words));
+
+            for(uint32_t i = 0; i < 4; i++)
+            { lanes[i] = fingerprintRound(lanes[i], words[i]); }
+        }
+
+        hash = rotateLeft64(lanes[0], 1) + rotateLeft64(lanes[1], 7) + rotateLeft64(lanes[2], 12) + rotateLeft64(lanes[3], 18);
+
+        for(uint32_t i = 0; i < 4; i++)
+        { hash = fingerprintMerge(hash, lanes[i]); }
+    }
+    else
+    { hash = FINGERPRINT_PRIME_5; }
+
+    hash += length;
+
+    for(; end - data >= 8; data += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        hash ^= fingerprintRound(0, word);
+        hash = rotateLeft64(hash, 27) * FINGERPRINT_PRIME_1 + FINGERPRINT_PRIME_4;
+    }
+
+    for(; data < end; data++)
+    {
+        hash ^= *data * FINGERPRINT_PRIME_5;
+        hash = rotateLeft64(hash, 11) * FINGERPRINT_PRIME_1;
+    }
+
+    // Final mix, so every input bit reaches every output bit
+    hash ^= hash >> 33;
+    hash *= FINGERPRINT_PRIME_2;
+    hash ^= hash >> 29;
+    hash *= FINGERPRINT_PRIME_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+int comparePageHashEntries(const void *a, const void *b)
+{
+    const struct pageHashEntry *entryA = a;
+    const struct pageHashEntry *entryB = b;
+
+    if(entryA->fingerprint != entryB->fingerprint)
+    { return (entryA->fingerprint < entryB->fingerprint) ? -1 : 1; }
+
+    if(entryA->pageCount != entryB->pageCount)
+    { return (entryA->pageCount < entryB->pageCount) ? -1 : 1; }
+
+    return 0;
+}
+
+// A missing, unreadable or mismatched sidecar just means an empty cache, and everything being hashed again
+int loadPageHashCache(const char *path, struct pageHashCache *cache)
+{
+    memset(cache, 0, sizeof(struct pageHashCache));
+
+    FILE *file = fopen(path, "rb");
+
+    if(file == NULL)
+    { return SUCCESS; }
+
+    struct pageHashCacheHeader header;
+
+    if(fread(&header, sizeof(header), 1, file) != 1 || header.magic != HASH_CACHE_MAGIC
+            || header.version != HASH_CACHE_VERSION || header.count == 0)
+    {
+        fclose(file);
+        return SUCCESS;
+    }
+
+    cache->entries = malloc((size_t)header.count * sizeof(struct pageHashEntry));
+
+    if(cache->entries == NULL)
+    {
+        fclose(file);
+        return ERR_OUT_OF_MEM;
+    }
+
+    if(fread(cache->entries, sizeof(struct pageHashEntry), header.count, file) != header.count)
+    {
+        nullAndFree((void **) & (cache->entries));
+        fclose(file);
+        return SUCCESS;
+    }
+
+    fclose(file);
+    cache->pageSize = header.pageSize;
+    cache->count = header.count;
+    qsort(cache->entries, cache->count, sizeof(struct pageHashEntry), comparePageHashEntries);
+    return SUCCESS;
+}
+
+// Sets midstate up as if it had just absorbed the pages with this fingerprint, if they're in the cache
+bool findPageHash(const struct pageHashCache *cache, uint64_t fingerprint, uint32_t pageCount, struct sha1_ctx *midstate)
+{
+    struct pageHashEntry key;
+    key.fingerprint = fingerprint;
+    key.pageCount = pageCount;
+
+    if(cache->count == 0)
+    { return false; }
+
+    struct pageHashEntry *found = bsearch(&key, cache->entries, cache->count, sizeof(struct pageHashEntry), comparePageHashEntries);
+
+    if(found == NULL)
+    { return false; }
+
+    sha1_init(midstate);
+    memcpy(midstate->state, found->state, sizeof(found->state));
+    midstate->count = ((uint64_t)pageCount * cache->pageSize) / SHA1_BLOCK_SIZE;
+    return true;
+}
+
+// Writes this build's entries out. They go to a temporary file first and replace the old sidecar in one go,
+// so a build that's interrupted part way leaves the old one intact.
+int savePageHashCache(const char *path, const struct pageHashCache *cache)
+{
+    char *tempPath = NULL;
+    int ret = getTempPath(path, &tempPath);
+
+    if(ret != SUCCESS)
+    { return ret; }
+
+    FILE *file = fopen(tempPath, "wb");
+
+    if(file == NULL)
+    {
+        nullAndFree((void **)&tempPath);
+        return ERR_FILE_OPEN;
+    }
+
+    struct pageHashCacheHeader header = { HASH_CACHE_MAGIC, HASH_CACHE_VERSION, cache->pageSize, cache->newCount };
+
+    if(fwrite(&header, sizeof(header), 1, file) != 1 || (cache->newCount > 0
+            && fwrite(cache->newEntries, sizeof(struct pageHashEntry), cache->newCount, file) != cache->newCount))
+    { ret = ERR_FILE_WRITE; }
+
+    if(fclose(file) != 0)
+    { ret = ERR_FILE_WRITE; }
+
+    if(ret == SUCCESS)
+    { ret = replaceFile(tempPath, path); }
+    else
+    { remove(tempPath); }
+
+    nullAndFree((void **)&tempPath);
+    return ret;
+}
+
+void freePageHashCache(struct pageHashCache *cache)
+{
+    nullAndFree((void **) & (cache->entries));
+    nullAndFree((void **) & (cache->newEntries));
+    cache->count = 0;
+    cache->newCount = 0;
+}
@@ -0,0 +1,55 @@
+// This file is part of SynthXEX, one component of the
+// OpenXeChain development toolchain
+//
+// Copyright (c) 2025 Aiden Isik
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "../common/common.h"
+#include "../common/crypto.h"
+#include "../common/datastorage.h"
+#include "outputcache.h"
+
+// Written in the host's byte order, so a sidecar from a host of the other order reads back as invalid and is ignored
+#define HASH_CACHE_MAGIC 0x43584558
+#define HASH_CACHE_VERSION 1
+#define HASH_CACHE_SUFFIX ".xexcache"
+
+// The SHA1 state after absorbing the pages one page descriptor covers. Only the state is kept,
+// the rest of the context follows from the page count (pages are whole SHA1 blocks).
+struct pageHashEntry
+{
+    uint64_t fingerprint; // Of the pages' contents, see fingerprintData
+    uint32_t pageCount;
+    uint32_t state[5];
+};
+
+// Hashes from the last build of a XEX, looked up by content rather than position, so pages that moved
+// (from code being inserted before them, say) are still found. What this build hashed goes in newEntries.
+struct pageHashCache
+{
+    uint32_t pageSize;
+    uint32_t count;
+    struct pageHashEntry *entries; // Sorted by fingerprint, then page count
+    uint32_t newCount;
+    struct pageHashEntry *newEntries;
+};
+
+uint64_t fingerprintData(const uint8_t *data, size_t length);
+int loadPageHashCache(const char *path, struct pageHashCache *cache);
+bool findPageHash(const struct pageHashCache *cache, uint64_t fingerprint, uint32_t pageCount, struct sha1_ctx *midstate);
+int savePageHashCache(const char *path, const struct pageHashCache *cache);
+void freePageHashCache(struct pageHashCache *cache);
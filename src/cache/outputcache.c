@@ -0,0 +1,273 @@
+// This file is part of SynthXEX, one component of the
+// OpenXeChain development toolchain
+//
+// Copyright (c) 2025 Aiden Isik
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "outputcache.h"
+
+// The key is the SHA1 of settings (everything but the input that decides the output, including the version
+// which built it), then the whole input PE. SHA1 is what we have hardware support for already, and
+// unlike a checksum it's safe to share one directory between any number of builds.
+int getCachedOutputPath(const char *cacheDir, const uint8_t *pe, uint64_t peSize, const char *settings, char **entryPath)
+{
+    uint8_t key[OUTPUT_CACHE_KEY_SIZE];
+    struct sha1_ctx sha1;
+    sha1_init(&sha1);
+    sha1_update(&sha1, strlen(settings) + 1, (const uint8_t *)settings);
+    sha1_update(&sha1, peSize, pe);
+    sha1_digest(&sha1, sizeof(key), key);
+
+    // <dir>/xx/<38 more hex digits>.xex
+    *entryPath = malloc(strlen(cacheDir) + 1 + 2 + 1 + (OUTPUT_CACHE_KEY_SIZE * 2 - 2) + strlen(OUTPUT_CACHE_SUFFIX) + 1);
+
+    if(*entryPath == NULL)
+    { return ERR_OUT_OF_MEM; }
+
+    char *position = *entryPath + sprintf(*entryPath, "%s/%02x/", cacheDir, key[0]);
+
+    for(uint32_t i = 1; i < OUTPUT_CACHE_KEY_SIZE; i++)
+    { position += sprintf(position, "%02x", key[i]); }
+
+    strcpy(position, OUTPUT_CACHE_SUFFIX);
+    return SUCCESS;
+}
+
+// Copies all of in to out, which is empty. On Linux a reflink is tried first (instant, and sharing the
+// storage, on btrfs/XFS), then an in-kernel copy.
+int copyWholeFile(FILE *in, FILE *out)
+{
+#ifdef __linux__
+
+    if(ioctl(fileno(out), FICLONE, fileno(in)) == 0)
+    { return SUCCESS; }
+
+    while(true)
+    {
+        ssize_t copied = copy_file_range(fileno(in), NULL, fileno(out), NULL, 1024 * 1024 * 1024, 0);
+
+        if(copied < 0 && errno == EINTR)
+        { continue; }
+
+        if(copied < 0)
+        { break; }
+
+        if(copied == 0)
+        { return SUCCESS; }
+    }
+
+    // Whatever's been done already counts, carry on from where it left off
+    if(fseek(in, lseek(fileno(in), 0, SEEK_CUR), SEEK_SET) != 0 || fseek(out, lseek(fileno(out), 0, SEEK_CUR), SEEK_SET) != 0)
+    { return ERR_FILE_READ; }
+
+#endif
+
+    uint8_t *buffer = malloc(1024 * 1024);
+
+    if(buffer == NULL)
+    { return ERR_OUT_OF_MEM; }
+
+    int ret = SUCCESS;
+    size_t got;
+
+    while((got = fread(buffer, sizeof(uint8_t), 1024 * 1024, in)) > 0)
+        if(fwrite(buffer, sizeof(uint8_t), got, out) != got)
+        {
+            ret = ERR_FILE_WRITE;
+            break;
+        }
+
+    if(ret == SUCCESS && ferror(in))
+    { ret = ERR_FILE_READ; }
+
+    nullAndFree((void **)&buffer);
+    return ret;
+}
+
+// A name next to path nobody else will pick, for building a file before renaming it into place.
+// Random rather than from the process ID, so threads in one process don't collide either.
+int getTempPath(const char *path, char **tempPath)
+{
+    uint8_t random[8];
+    int ret = getRandomBytes(random, sizeof(random));
+
+    if(ret != SUCCESS)
+    { return ret; }
+
+    *tempPath = malloc(strlen(path) + 5 + sizeof(random) * 2 + 1);
+
+    if(*tempPath == NULL)
+    { return ERR_OUT_OF_MEM; }
+
+    char *position = *tempPath + sprintf(*tempPath, "%s.tmp.", path);
+
+    for(uint32_t i = 0; i < sizeof(random); i++)
+    { position += sprintf(position, "%02x", random[i]); }
+
+    return SUCCESS;
+}
+
+// Replaces path with tempPath in one go, so nobody ever sees half of it
+int replaceFile(const char *tempPath, const char *path)
+{
+#ifdef _WIN32
+    // rename won't replace an existing file here
+    remove(path);
+#endif
+
+    if(rename(tempPath, path) != 0)
+    {
+        remove(tempPath);
+        return ERR_FILE_WRITE;
+    }
+
+    return SUCCESS;
+}
+
+// Copies src to dst through a temporary file, so dst is either the old file or all of the new one
+int copyFileAtomically(const char *src, const char *dst)
+{
+    FILE *in = fopen(src, "rb");
+
+    if(in == NULL)
+    { return ERR_FILE_OPEN; }
+
+    char *tempPath = NULL;
+    int ret = getTempPath(dst, &tempPath);
+
+    if(ret != SUCCESS)
+    {
+        fclose(in);
+        return ret;
+    }
+
+    FILE *out = fopen(tempPath, "wb");
+
+    if(out == NULL)
+    {
+        fclose(in);
+        nullAndFree((void **)&tempPath);
+        return ERR_FILE_OPEN;
+    }
+
+    ret = copyWholeFile(in, out);
+    fclose(in);
+
+    if(fclose(out) != 0 && ret == SUCCESS)
+    { ret = ERR_FILE_WRITE; }
+
+    if(ret == SUCCESS)
+    { ret = replaceFile(tempPath, dst); }
+    else
+    { remove(tempPath); }
+
+    nullAndFree((void **)&tempPath);
+    return ret;
+}
+
+// Puts the cached XEX at xexfilePath. Returns ERR_FILE_OPEN if there's no such entry.
+// A hard link is the cheapest of all, but then the output and the cache entry are the same file,
+// and anything editing the output in place edits the cache too. So it's only done when asked for.
+int fetchCachedOutput(const char *entryPath, const char *xexfilePath, bool hardLink)
+{
+#ifndef _WIN32
+
+    if(hardLink)
+    {
+        char *tempPath = NULL;
+        int ret = getTempPath(xexfilePath, &tempPath);
+
+        if(ret != SUCCESS)
+        { return ret; }
+
+        if(link(entryPath, tempPath) == 0)
+        {
+            ret = replaceFile(tempPath, xexfilePath);
+            nullAndFree((void **)&tempPath);
+            return ret;
+        }
+
+        nullAndFree((void **)&tempPath);
+
+        // Different filesystems, most likely. Copy instead, unless there's nothing to copy.
+        if(errno == ENOENT)
+        { return ERR_FILE_OPEN; }
+    }
+
+#endif
+
+    return copyFileAtomically(entryPath, xexfilePath);
+}
+
+// Removes the file at path if it has other hard links, so writing a new one there can't change them.
+// Anything truncating and rewriting an existing output calls this first, in case it came out of the cache.
+void unshareOutput(const char *path)
+{
+    struct stat fileStat;
+
+    if(stat(path, &fileStat) == 0 && fileStat.st_nlink > 1)
+    { remove(path); }
+}
+
+// Makes dir if it's not already there
+int makeDirectory(const char *dir)
+{
+#ifdef _WIN32
+    int made = mkdir(dir);
+#else
+    int made = mkdir(dir, 0777);
+#endif
+
+    return (made == 0 || errno == EEXIST) ? SUCCESS : ERR_FILE_WRITE;
+}
+
+// Adds the XEX at xexfilePath to the cache. Builds running at the same time may store the same entry,
+// each does it through a file of it's own and the last rename wins, with identical contents anyway.
+int storeCachedOutput(const char *entryPath, const char *xexfilePath)
+{
+    // The cache directory itself, then the subdirectory for this entry
+    char *dir = malloc(strlen(entryPath) + 1);
+
+    if(dir == NULL)
+    { return ERR_OUT_OF_MEM; }
+
+    strcpy(dir, entryPath);
+    *strrchr(dir, '/') = '\0';
+    char *subdir = strrchr(dir, '/');
+
+    *subdir = '\0';
+    int ret = makeDirectory(dir);
+    *subdir = '/';
+
+    if(ret == SUCCESS)
+    { ret = makeDirectory(dir); }
+
+    nullAndFree((void **)&dir);
+
+    if(ret != SUCCESS)
+    { return ret; }
+
+    ret = copyFileAtomically(xexfilePath, entryPath);
+
+#ifndef _WIN32
+
+    // Read only, so anything else opening a linked out copy for writing is refused rather than changing it
+    if(ret == SUCCESS)
+    { chmod(entryPath, 0444); }
+
+#endif
+
+    return ret;
+}
@@ -0,0 +1,41 @@
+// This file is part of SynthXEX, one component of the
+// OpenXeChain development toolchain
+//
+// Copyright (c) 2025 Aiden Isik
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "../common/common.h"
+#include "../common/crypto.h"
+#include "../common/datastorage.h"
+
+#include <sys/stat.h>
+
+#ifdef _WIN32
+    #include <io.h>
+#endif
+
+// Entries are named for the SHA1 of what went into them, in subdirectories by the first byte (as ccache does)
+#define OUTPUT_CACHE_KEY_SIZE 20
+#define OUTPUT_CACHE_SUFFIX ".xex"
+
+int getTempPath(const char *path, char **tempPath);
+int replaceFile(const char *tempPath, const char *path);
+int copyFileAtomically(const char *src, const char *dst);
+void unshareOutput(const char *path);
+int getCachedOutputPath(const char *cacheDir, const uint8_t *pe, uint64_t peSize, const char *settings, char **entryPath);
+int fetchCachedOutput(const char *entryPath, const char *xexfilePath, bool hardLink);
+int storeCachedOutput(const char *entryPath, const char *xexfilePath);
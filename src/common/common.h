@@ -22,6 +22,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <string.h>
 #include <stdbool.h>
 
@@ -55,3 +56,14 @@
 #define ERR_INVALID_RVA_OR_OFFSET -8
 #define ERR_INVALID_IMPORT_NAME -9
 #define ERR_DATA_OVERFLOW -10
+#define ERR_INVALID_PE -11
+#define ERR_PE_OPEN -12
+#define ERR_XEX_CREATE -13
+#define ERR_INVALID_MANIFEST -14
+#define ERR_INVALID_OPTION -15
+#define ERR_SOCKET -16
+#define ERR_PROTOCOL -17
+#define ERR_INVALID_XEX -18
+#define ERR_INVALID_PATCH -19
+#define ERR_PATCH_MISMATCH -20
+#define ERR_PATCH_UNDIFFABLE -21
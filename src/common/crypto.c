@@ -0,0 +1,62 @@
+// This file is part of SynthXEX, one component of the
+// OpenXeChain development toolchain
+//
+// Copyright (c) 2025 Aiden Isik
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Has to come before anything includes stdlib.h for rand_s to be declared
+#ifdef _WIN32
+    #define _CRT_RAND_S
+#endif
+
+#include "crypto.h"
+
+// Fills buffer from the system's secure random number generator
+int getRandomBytes(uint8_t *buffer, size_t length)
+{
+#ifdef _WIN32
+
+    for(size_t i = 0; i < length; i++)
+    {
+        unsigned int value;
+
+        if(rand_s(&value) != 0)
+        { return ERR_FILE_READ; }
+
+        buffer[i] = value & 0xFF;
+    }
+
+    return SUCCESS;
+#else
+    FILE *random = fopen("/dev/urandom", "rb");
+
+    if(random == NULL)
+    { return ERR_FILE_OPEN; }
+
+    size_t got = fread(buffer, 1, length, random);
+    fclose(random);
+    return (got == length) ? SUCCESS : ERR_FILE_READ;
+#endif
+}
+
+// The loader decrypts the security info's AES key with the retail key to get the key the basefile is encrypted with
+void wrapImageKey(const uint8_t *imageKey, uint8_t *aesKey)
+{
+    const uint8_t retailKey[AES128_KEY_SIZE] = XEX_RETAIL_KEY;
+    struct aes128_ctx aes;
+
+    aes128_set_encrypt_key(&aes, retailKey);
+    aes128_encrypt(&aes, AES128_KEY_SIZE, aesKey, imageKey);
+}
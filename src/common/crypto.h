@@ -18,4 +18,13 @@
 
 #pragma once
 
+#include "common.h"
+
 #include <nettle/sha1.h>
+#include <nettle/aes.h>
+
+// Retail key used by the loader to unwrap the image key in the security info
+#define XEX_RETAIL_KEY { 0x20, 0xB1, 0x85, 0xA5, 0x9D, 0x28, 0xFD, 0xC3, 0x40, 0x58, 0x3F, 0xBB, 0x08, 0x96, 0xBF, 0x91 }
+
+int getRandomBytes(uint8_t *buffer, size_t length);
+void wrapImageKey(const uint8_t *imageKey, uint8_t *aesKey);
@@ -145,10 +145,60 @@ void freeOptHeadersStruct(struct optHeaders **optHeaders)
     if(*optHeaders != NULL)
     {
         freeImportLibrariesStruct(&((*optHeaders)->importLibraries));
+
+        struct basicCompBlock *blocks = (*optHeaders)->basefileFormat.blocks; // Avoid dereferencing unaligned pointer
+        nullAndFree((void **)&blocks);
+
+        uint8_t *normalCompData = (*optHeaders)->basefileFormat.normalCompData; // Avoid dereferencing unaligned pointer
+        nullAndFree((void **)&normalCompData);
+
         nullAndFree((void **)optHeaders);
     }
 }
 
+void freeBasefileStruct(struct basefile *basefile)
+{
+#ifndef _WIN32
+
+    if(basefile->mapped)
+    {
+        if(basefile->data != NULL)
+        { munmap(basefile->data, basefile->size); }
+
+        close(basefile->fd);
+        basefile->data = NULL;
+        basefile->mapped = false;
+        return;
+    }
+
+#endif
+
+    nullAndFree((void **) & (basefile->data));
+}
+
+void freeMappedFileStruct(struct mappedFile *file)
+{
+    uint8_t *data = file->borrowed ? NULL : (uint8_t *)file->data;
+
+#ifndef _WIN32
+
+    if(file->mapped)
+    {
+        if(data != NULL)
+        { munmap(data, file->size); }
+
+        data = NULL;
+    }
+
+#endif
+
+    nullAndFree((void **)&data);
+    file->data = NULL;
+    file->size = 0;
+    file->mapped = false;
+    file->borrowed = false;
+}
+
 void freeAllMainStructs(struct offsets **offsets, struct xexHeader **xexHeader, struct secInfoHeader **secInfoHeader,
                         struct peData **peData, struct optHeaderEntries **optHeaderEntries, struct optHeaders **optHeaders)
 {
@@ -160,6 +210,73 @@ void freeAllMainStructs(struct offsets **offsets, struct xexHeader **xexHeader,
     freeOptHeadersStruct(optHeaders);
 }
 
+// Creates a blank basefile. It's kept in memory if it's no larger than memLimit, otherwise
+// it's backed by an unlinked temporary file so very large images can be paged out to disk.
+int createBasefile(struct basefile *basefile, uint32_t size, uint64_t memLimit)
+{
+    basefile->size = size;
+    basefile->mapped = false;
+
+#ifndef _WIN32
+
+    if(size > memLimit)
+    {
+        const char *tmpDir = getenv("TMPDIR");
+
+        if(tmpDir == NULL || tmpDir[0] == '\0')
+        { tmpDir = "/tmp"; }
+
+        char *tmpPath = malloc(strlen(tmpDir) + strlen("/synthxex-XXXXXX") + 1);
+
+        if(tmpPath == NULL)
+        { return ERR_OUT_OF_MEM; }
+
+        strcpy(tmpPath, tmpDir);
+        strcat(tmpPath, "/synthxex-XXXXXX");
+
+        int fd = mkstemp(tmpPath);
+
+        if(fd == -1)
+        {
+            nullAndFree((void **)&tmpPath);
+            return ERR_FILE_OPEN;
+        }
+
+        // Nothing else needs to see it, and this way it's cleaned up however we exit
+        unlink(tmpPath);
+        nullAndFree((void **)&tmpPath);
+
+        if(ftruncate(fd, size) != 0)
+        {
+            close(fd);
+            return ERR_FILE_WRITE;
+        }
+
+        void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+        if(data == MAP_FAILED)
+        {
+            close(fd);
+            return ERR_OUT_OF_MEM;
+        }
+
+        // The file is kept open so the basefile can be copied into the XEX in-kernel later
+        basefile->data = data;
+        basefile->fd = fd;
+        basefile->mapped = true;
+        return SUCCESS;
+    }
+
+#endif
+
+    basefile->data = calloc(size, sizeof(uint8_t));
+
+    if(basefile->data == NULL)
+    { return ERR_OUT_OF_MEM; }
+
+    return SUCCESS;
+}
+
 uint32_t getNextAligned(uint32_t offset, uint32_t alignment)
 {
     if(offset % alignment) // If offset not aligned
@@ -203,75 +320,365 @@ uint32_t offsetToRVA(uint32_t offset, struct sections *sections)
     return 0; // Not found
 }
 
-uint32_t get32BitFromPE(FILE *pe)
+// Opens a whole file for reading, so parsing is just pointer arithmetic from here on
+int mapInputFile(const char *path, struct mappedFile *file)
 {
-    uint32_t result;
-    errno = SUCCESS;
+    memset(file, 0, sizeof(struct mappedFile));
+
+    FILE *fp = fopen(path, "rb");
+
+    if(fp == NULL)
+    { return ERR_FILE_OPEN; }
+
+    return mapInputStream(fp, file);
+}
+
+#ifndef _WIN32
+// As mapInputFile, for a file someone else opened (e.g. a memfd, or a file received over a socket).
+// fd is left open.
+int mapInputFd(int fd, struct mappedFile *file)
+{
+    memset(file, 0, sizeof(struct mappedFile));
 
-    if(fread(&result, sizeof(uint32_t), 1, pe) != 1)
+    int ownFd = dup(fd);
+
+    if(ownFd < 0)
+    { return ERR_FILE_OPEN; }
+
+    FILE *fp = fdopen(ownFd, "rb");
+
+    if(fp == NULL)
     {
-        errno = ERR_FILE_READ;
-        return 0;
+        close(ownFd);
+        return ERR_FILE_OPEN;
     }
 
-    // If system is big endian, swap endianness (PE is LE)
-#ifdef BIG_ENDIAN_SYSTEM
-    return __builtin_bswap32(result);
-#else
-    return result;
+    return mapInputStream(fp, file);
+}
 #endif
+
+// Maps (or failing that, reads in) the whole of fp, then closes it
+int mapInputStream(FILE *fp, struct mappedFile *file)
+{
+    if(fseek(fp, 0, SEEK_END) != 0)
+    {
+        fclose(fp);
+        return ERR_FILE_READ;
+    }
+
+    long size = ftell(fp);
+
+    if(size < 0)
+    {
+        fclose(fp);
+        return ERR_FILE_READ;
+    }
+
+    file->size = size;
+
+    // Nothing to map. The parsers will reject it as it's too small.
+    if(file->size == 0)
+    {
+        fclose(fp);
+        return SUCCESS;
+    }
+
+#ifndef _WIN32
+    void *mapping = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+
+    if(mapping != MAP_FAILED)
+    {
+        // Headers are small, and sections are copied out front to back, so read ahead as much as possible.
+        // These are just hints, so don't worry if they fail.
+        madvise(mapping, file->size, MADV_SEQUENTIAL);
+        madvise(mapping, file->size, MADV_WILLNEED);
+
+        fclose(fp); // The mapping holds it's own reference
+        file->data = mapping;
+        file->mapped = true;
+        return SUCCESS;
+    }
+
+#endif
+
+    // Can't be mapped (e.g. it's a pipe, or we're on Windows), read it all in instead
+    uint8_t *data = malloc(file->size);
+
+    if(data == NULL)
+    {
+        fclose(fp);
+        return ERR_OUT_OF_MEM;
+    }
+
+    if(fseek(fp, 0, SEEK_SET) != 0 || fread(data, 1, file->size, fp) != file->size)
+    {
+        nullAndFree((void **)&data);
+        fclose(fp);
+        return ERR_FILE_READ;
+    }
+
+    fclose(fp);
+    file->data = data;
+    return SUCCESS;
 }
 
-uint16_t get16BitFromPE(FILE *pe)
+// Reads from a buffer the caller already has in memory rather than a file. The buffer must outlive the mappedFile.
+void useBufferAsInput(const uint8_t *data, uint64_t size, struct mappedFile *file)
 {
-    uint16_t result;
-    errno = SUCCESS;
+    file->data = data;
+    file->size = size;
+    file->mapped = false;
+    file->borrowed = true;
+}
+
+// Writes size bytes at offset without relying on the stream position.
+// On POSIX systems this is a positional write, so it may be called from several threads at once
+// (any data buffered in the stream must be flushed beforehand). Elsewhere, callers must serialise it.
+int writeAtOffset(FILE *file, const void *data, size_t size, uint64_t offset)
+{
+#ifndef _WIN32
+    int fd = fileno(file);
 
-    if(fread(&result, sizeof(uint16_t), 1, pe) != 1)
+    while(size > 0)
     {
-        errno = ERR_FILE_READ;
-        return 0;
+        ssize_t written = pwrite(fd, data, size, offset);
+
+        if(written < 0 && errno == EINTR)
+        { continue; }
+
+        if(written <= 0)
+        { return ERR_FILE_WRITE; }
+
+        data = (const uint8_t *)data + written;
+        size -= written;
+        offset += written;
     }
 
-#ifdef BIG_ENDIAN_SYSTEM
-    return __builtin_bswap16(result);
 #else
-    return result;
+
+    if(fseek(file, offset, SEEK_SET) != 0 || fwrite(data, sizeof(uint8_t), size, file) != size)
+    { return ERR_FILE_WRITE; }
+
 #endif
+
+    return SUCCESS;
 }
 
-uint32_t get32BitFromXEX(FILE *xex)
+// Like writeAtOffset, but only writes the pages which differ from what existing (a view of the same file from
+// before it's updated) already holds there. Unchanged data isn't written back over itself, so updating a big file
+// in place only costs as much I/O as the change. Ranges written this way must not overlap.
+int writeChangedAtOffset(FILE *file, const struct mappedFile *existing, const void *data, size_t size, uint64_t offset)
 {
-    uint32_t result;
-    errno = SUCCESS;
+    const uint8_t *bytes = data;
+    size_t runStart = 0;
+    bool inRun = false; // Of changed pages, written together once it ends
 
-    if(fread(&result, sizeof(uint32_t), 1, xex) != 1)
+    for(size_t done = 0; done < size;)
     {
-        errno = ERR_FILE_READ;
-        return 0;
+        size_t chunk = (size - done < WRITE_COMPARE_SIZE) ? size - done : WRITE_COMPARE_SIZE;
+        const uint8_t *old = getSpan(existing, offset + done, chunk);
+        bool changed = (old == NULL || memcmp(old, bytes + done, chunk) != 0);
+
+        if(changed && !inRun)
+        {
+            runStart = done;
+            inRun = true;
+        }
+        else if(!changed && inRun)
+        {
+            int ret = writeAtOffset(file, bytes + runStart, done - runStart, offset + runStart);
+
+            if(ret != SUCCESS)
+            { return ret; }
+
+            inRun = false;
+        }
+
+        done += chunk;
     }
 
-#ifdef LITTLE_ENDIAN_SYSTEM
-    return __builtin_bswap32(result);
+    return inRun ? writeAtOffset(file, bytes + runStart, size - runStart, offset + runStart) : SUCCESS;
+}
+
+// Cuts a file updated in place down to size, in case it's shrunk. Any buffered data must be flushed beforehand.
+int setFileSize(FILE *file, uint64_t size)
+{
+#ifdef _WIN32
+
+    if(_chsize_s(_fileno(file), size) != 0)
+    { return ERR_FILE_WRITE; }
+
 #else
-    return result;
+
+    if(ftruncate(fileno(file), size) != 0)
+    { return ERR_FILE_WRITE; }
+
 #endif
+
+    return SUCCESS;
 }
 
-uint16_t get16BitFromXEX(FILE *xex)
+// Copies length bytes of the basefile from start into file at offset. If the basefile is backed by a file,
+// the copy is done by the kernel: a reflink where the filesystem supports it (a metadata-only operation on
+// btrfs/XFS, given block aligned ranges), then copy_file_range, then sendfile. Anything those don't manage
+// is written from memory as usual. Must not run alongside anything else writing to file.
+int copyBasefileRange(struct basefile *basefile, uint32_t start, uint32_t length, FILE *file, uint64_t offset)
 {
-    uint16_t result;
-    errno = SUCCESS;
+    uint64_t done = 0;
 
-    if(fread(&result, sizeof(uint16_t), 1, xex) != 1)
+#ifdef __linux__
+
+    if(basefile->mapped)
     {
-        errno = ERR_FILE_READ;
-        return 0;
+        int outFd = fileno(file);
+
+        // Reflink. Only works on the same filesystem with block aligned ranges, so just try it.
+        struct file_clone_range cloneRange;
+        cloneRange.src_fd = basefile->fd;
+        cloneRange.src_offset = start;
+        cloneRange.src_length = length;
+        cloneRange.dest_offset = offset;
+
+        if(ioctl(outFd, FICLONERANGE, &cloneRange) == 0)
+        { return SUCCESS; }
+
+        // In-kernel copy, which may still share extents (or offload) where the filesystem can
+        while(done < length)
+        {
+            loff_t inOffset = start + done;
+            loff_t outOffset = offset + done;
+            ssize_t copied = copy_file_range(basefile->fd, &inOffset, outFd, &outOffset, length - done, 0);
+
+            if(copied < 0 && errno == EINTR)
+            { continue; }
+
+            if(copied <= 0)
+            { break; }
+
+            done += copied;
+        }
+
+        // sendfile writes at the output's file position, which nothing else depends on here
+        if(done < length && lseek(outFd, offset + done, SEEK_SET) != -1)
+        {
+            while(done < length)
+            {
+                off_t inOffset = start + done;
+                ssize_t copied = sendfile(outFd, basefile->fd, &inOffset, length - done);
+
+                if(copied < 0 && errno == EINTR)
+                { continue; }
+
+                if(copied <= 0)
+                { break; }
+
+                done += copied;
+            }
+        }
     }
 
-#ifdef LITTLE_ENDIAN_SYSTEM
-    return __builtin_bswap16(result);
-#else
+#endif
+
+    // Last resort, plain write from memory
+    return writeAtOffset(file, basefile->data + start + done, length - done, offset + done);
+}
+
+// Returns a pointer to length bytes at offset, or NULL if any of them are outwith the file
+const uint8_t *getSpan(const struct mappedFile *file, uint64_t offset, uint64_t length)
+{
+    if(offset > file->size || length > file->size - offset)
+    { return NULL; }
+
+    return file->data + offset;
+}
+
+// Decode little endian (PE byte order) values from memory, regardless of host endianness
+uint32_t get32BitLE(const uint8_t *data)
+{
+    uint32_t result;
+    memcpy(&result, data, sizeof(uint32_t));
+
+    // If system is big endian, swap endianness (PE is LE)
+#ifdef BIG_ENDIAN_SYSTEM
+    result = __builtin_bswap32(result);
+#endif
+
     return result;
+}
+
+uint16_t get16BitLE(const uint8_t *data)
+{
+    uint16_t result;
+    memcpy(&result, data, sizeof(uint16_t));
+
+#ifdef BIG_ENDIAN_SYSTEM
+    result = __builtin_bswap16(result);
 #endif
+
+    return result;
+}
+
+// Decode and encode big endian (XEX byte order) values, regardless of host endianness
+uint32_t get32BitBE(const uint8_t *data)
+{
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+void put32BitBE(uint8_t *data, uint32_t value)
+{
+    data[0] = (uint8_t)(value >> 24);
+    data[1] = (uint8_t)(value >> 16);
+    data[2] = (uint8_t)(value >> 8);
+    data[3] = (uint8_t)value;
+}
+
+void put16BitBE(uint8_t *data, uint16_t value)
+{
+    data[0] = (uint8_t)(value >> 8);
+    data[1] = (uint8_t)value;
+}
+
+// Writes an import table as it appears in the XEX (big endian, addresses following it) and returns it's size
+uint32_t serialiseImportTable(const struct importTable *table, uint8_t *data)
+{
+    const uint32_t *addresses = table->addresses; // Avoid dereferencing unaligned pointer
+    uint16_t addressCount = table->addressCount;
+
+    put32BitBE(data, table->size);
+    memcpy(data + 0x4, table->sha1, 0x14);
+    put32BitBE(data + 0x18, table->unknown);
+    put32BitBE(data + 0x1C, table->targetVer);
+    put32BitBE(data + 0x20, table->minimumVer);
+    data[0x24] = table->padding;
+    data[0x25] = table->tableIndex;
+    put16BitBE(data + 0x26, addressCount);
+
+    uint8_t *currentPos = data + sizeof(struct importTable) - sizeof(void *);
+
+    for(uint16_t i = 0; i < addressCount; i++)
+    { put32BitBE(currentPos + (i * sizeof(uint32_t)), addresses[i]); }
+
+    return sizeof(struct importTable) - sizeof(void *) + (addressCount * sizeof(uint32_t));
+}
+
+int get32BitFromPE(struct mappedFile *pe, uint64_t offset, uint32_t *result)
+{
+    const uint8_t *data = getSpan(pe, offset, sizeof(uint32_t));
+
+    if(data == NULL)
+    { return ERR_FILE_READ; }
+
+    *result = get32BitLE(data);
+    return SUCCESS;
+}
+
+int get16BitFromPE(struct mappedFile *pe, uint64_t offset, uint16_t *result)
+{
+    const uint8_t *data = getSpan(pe, offset, sizeof(uint16_t));
+
+    if(data == NULL)
+    { return ERR_FILE_READ; }
+
+    *result = get16BitLE(data);
+    return SUCCESS;
 }
@@ -20,6 +20,19 @@
 
 #include "common.h"
 
+#ifdef _WIN32
+    #include <io.h>
+#else
+    #include <unistd.h>
+    #include <sys/mman.h>
+#endif
+
+#ifdef __linux__
+    #include <sys/ioctl.h>
+    #include <sys/sendfile.h>
+    #include <linux/fs.h>
+#endif
+
 // Endian test
 #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
     #define LITTLE_ENDIAN_SYSTEM
@@ -75,6 +88,27 @@
 #define XEX_SECTION_RWDATA 0x2
 #define XEX_SECTION_RODATA 0x3
 
+// Basefile encryption types
+#define XEX_ENC_NONE   0x0
+#define XEX_ENC_NORMAL 0x1 // AES-128-CBC with a zero IV, through everything stored after the headers
+
+// Basefile compression types
+#define XEX_COMP_BASIC  0x1 // Only runs of zeroes are removed (with a single block, nothing is)
+#define XEX_COMP_NORMAL 0x2 // LZX
+
+// Basefile compression modes, as requested on the command line
+#define COMP_MODE_NONE  0 // Basic compression with a single block
+#define COMP_MODE_BASIC 1
+#define COMP_MODE_FAST    2 // Normal compression, in increasing order of effort
+#define COMP_MODE_DEFAULT 3
+#define COMP_MODE_MAX     4
+
+// Granularity at which a file updated in place is compared with what it held before
+#define WRITE_COMPARE_SIZE 0x1000
+
+// Largest number of pages one page descriptor can cover (upper 28 bits of sizeAndInfo)
+#define XEX_PAGE_DESC_MAX_RUN 0x0FFFFFFF
+
 // Page RWX flags
 struct sections
 {
@@ -89,6 +123,7 @@ struct section
     uint32_t rva;
     uint32_t rawSize;
     uint32_t offset;
+    uint32_t characteristics;
 };
 
 struct peImport
@@ -120,6 +155,7 @@ struct peExportInfo
 // Data structs
 struct peData
 {
+    uint64_t fileSize;
     uint32_t size;
     uint32_t baseAddr;
     uint32_t entryPoint;
@@ -130,12 +166,32 @@ struct peData
     uint32_t sectionTableSize;
     uint32_t headerSize;
     uint32_t pageSize;
+    uint16_t machine;
+    uint16_t subsystem;
     uint16_t characteristics;
     struct sections sections;
     struct peImportInfo peImportInfo;
     struct peExportInfo peExportInfo;
 };
 
+// A read-only view of a whole input file, memory-mapped where possible
+struct mappedFile
+{
+    const uint8_t *data;
+    uint64_t size;
+    bool mapped; // If false, data is a heap copy of the file
+    bool borrowed; // If true, data belongs to someone else (see useBufferAsInput) and is never freed
+};
+
+// The PE mapped into memory (RVAs become offsets)
+struct basefile
+{
+    uint8_t *data;
+    uint32_t size;
+    bool mapped; // If true, data is a mapping of an unlinked temporary file rather than heap memory
+    int fd; // The temporary file, only valid if mapped
+};
+
 // Most of these are 8-byte aligned. Basefile is 4KiB aligned.
 // In order of appearance
 struct offsets
@@ -186,13 +242,32 @@ struct __attribute__((packed)) secInfoHeader
     struct pageDescriptor *descriptors;
 };
 
+// With basic compression, the basefile is stored as a series of these: dataSize bytes
+// are present in the XEX, then zeroSize zeroes which are left out
+struct __attribute__((packed)) basicCompBlock
+{
+    uint32_t dataSize;
+    uint32_t zeroSize;
+};
+
+// With normal compression, each compressed block starts with the size and hash of the next one
+struct __attribute__((packed)) normalCompBlockInfo
+{
+    uint32_t size;
+    uint8_t sha1[0x14];
+};
+
 struct __attribute__((packed)) basefileFormat
 {
     uint32_t size;
     uint16_t encType;
     uint16_t compType;
-    uint32_t dataSize;
-    uint32_t zeroSize;
+    struct basicCompBlock *blocks; // Basic compression only, (size - 8) / 8 of them
+    uint32_t windowSize; // Normal compression only, followed by the first compressed block's info
+    struct normalCompBlockInfo firstBlock;
+    uint8_t *normalCompData; // Normal compression only, the compressed blocks as they're stored in the XEX
+    uint32_t normalCompDataSize;
+    uint8_t imageKey[0x10]; // Encryption only, what the basefile is encrypted with (the security info holds it wrapped)
 };
 
 struct __attribute__((packed)) importTable
@@ -263,17 +338,37 @@ void freePeImportInfoStruct(struct peImportInfo *peImportInfo);
 void freePeDataStruct(struct peData **peData);
 void freeOptHeaderEntriesStruct(struct optHeaderEntries **optHeaderEntries);
 void freeOptHeadersStruct(struct optHeaders **optHeaders);
+void freeBasefileStruct(struct basefile *basefile);
+void freeMappedFileStruct(struct mappedFile *file);
 void freeAllMainStructs(struct offsets **offsets, struct xexHeader **xexHeader, struct secInfoHeader **secInfoHeader,
                         struct peData **peData, struct optHeaderEntries **optHeaderEntries, struct optHeaders **optHeaders);
 
 // Functions used for file data manipulation
 
+int createBasefile(struct basefile *basefile, uint32_t size, uint64_t memLimit);
+
 uint32_t getNextAligned(uint32_t offset, uint32_t alignment);
 
 uint32_t rvaToOffset(uint32_t rva, struct sections *sections);
 uint32_t offsetToRVA(uint32_t offset, struct sections *sections);
 
-uint32_t get32BitFromPE(FILE *pe);
-uint16_t get16BitFromPE(FILE *pe);
-uint32_t get32BitFromXEX(FILE *xex);
-uint16_t get16BitFromXEX(FILE *xex);
+int mapInputFile(const char *path, struct mappedFile *file);
+int mapInputStream(FILE *fp, struct mappedFile *file);
+#ifndef _WIN32
+    int mapInputFd(int fd, struct mappedFile *file);
+#endif
+void useBufferAsInput(const uint8_t *data, uint64_t size, struct mappedFile *file);
+const uint8_t *getSpan(const struct mappedFile *file, uint64_t offset, uint64_t length);
+int writeAtOffset(FILE *file, const void *data, size_t size, uint64_t offset);
+int writeChangedAtOffset(FILE *file, const struct mappedFile *existing, const void *data, size_t size, uint64_t offset);
+int setFileSize(FILE *file, uint64_t size);
+int copyBasefileRange(struct basefile *basefile, uint32_t start, uint32_t length, FILE *file, uint64_t offset);
+
+uint32_t get32BitLE(const uint8_t *data);
+uint16_t get16BitLE(const uint8_t *data);
+uint32_t get32BitBE(const uint8_t *data);
+void put32BitBE(uint8_t *data, uint32_t value);
+void put16BitBE(uint8_t *data, uint16_t value);
+uint32_t serialiseImportTable(const struct importTable *table, uint8_t *data);
+int get32BitFromPE(struct mappedFile *pe, uint64_t offset, uint32_t *result);
+int get16BitFromPE(struct mappedFile *pe, uint64_t offset, uint16_t *result);
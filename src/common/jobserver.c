@@ -0,0 +1,196 @@
+// This file is part of SynthXEX, one component of the
+// OpenXeChain development toolchain
+//
+// Copyright (c) 2025 Aiden Isik
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "jobserver.h"
+
+#ifndef _WIN32
+
+// Finds the last --jobserver-auth (or --jobserver-fds, as make before 4.2 called it) in MAKEFLAGS.
+// The last is the one that counts, a sub-make appends it's own.
+const char *findJobServerAuth(const char *makeflags)
+{
+    const char *names[] = { "--jobserver-auth=", "--jobserver-fds=" };
+    const char *auth = NULL;
+
+    for(uint32_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        size_t nameLen = strlen(names[i]);
+
+        for(const char *found = strstr(makeflags, names[i]); found != NULL; found = strstr(found + nameLen, names[i]))
+            if(auth == NULL || found > auth)
+            { auth = found + nameLen; }
+    }
+
+    return auth;
+}
+
+// Make only passes the pipe on to recipes it knows run make (or are marked with +),
+// so the descriptors named in MAKEFLAGS may be closed, or something else entirely
+bool isInheritedPipe(int fd)
+{
+    struct stat fdStat;
+    return fd >= 0 && fcntl(fd, F_GETFD) != -1 && fstat(fd, &fdStat) == 0 && S_ISFIFO(fdStat.st_mode);
+}
+
+bool connectJobServer(struct jobServer *jobServer)
+{
+    jobServer->readFd = -1;
+    jobServer->writeFd = -1;
+    jobServer->ownsReadFd = false;
+
+    const char *makeflags = getenv("MAKEFLAGS");
+
+    if(makeflags == NULL)
+    { return false; }
+
+    const char *auth = findJobServerAuth(makeflags);
+
+    if(auth == NULL)
+    { return false; }
+
+    // Make 4.4 onwards: a named pipe, which gets it's own non-blocking open
+    if(strncmp(auth, "fifo:", 5) == 0)
+    {
+        size_t pathLen = strcspn(auth + 5, " ");
+        char *path = malloc(pathLen + 1);
+
+        if(path == NULL)
+        { return false; }
+
+        memcpy(path, auth + 5, pathLen);
+        path[pathLen] = '\0';
+
+        jobServer->readFd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        nullAndFree((void **)&path);
+
+        if(!isInheritedPipe(jobServer->readFd))
+        {
+            if(jobServer->readFd >= 0)
+            { close(jobServer->readFd); }
+
+            jobServer->readFd = -1;
+            return false;
+        }
+
+        jobServer->writeFd = jobServer->readFd;
+        jobServer->ownsReadFd = true;
+        return true;
+    }
+
+    // Older makes: an anonymous pipe, as "<read fd>,<write fd>"
+    char *end;
+    long readFd = strtol(auth, &end, 10);
+
+    if(end == auth || *end != ',')
+    { return false; }
+
+    const char *writeStart = end + 1;
+    long writeFd = strtol(writeStart, &end, 10);
+
+    if(end == writeStart || (*end != '\0' && *end != ' ') || readFd > INT32_MAX || writeFd > INT32_MAX
+            || !isInheritedPipe(readFd) || !isInheritedPipe(writeFd))
+    { return false; }
+
+    jobServer->readFd = readFd;
+    jobServer->writeFd = writeFd;
+
+#ifdef __linux__
+    // The pipe's shared with make and everything else it runs, so it can't be made non-blocking.
+    // Opening it again through /proc gives a descriptor of our own which can be.
+    char procPath[32];
+    snprintf(procPath, sizeof(procPath), "/proc/self/fd/%d", jobServer->readFd);
+    int ownFd = open(procPath, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+
+    if(ownFd >= 0)
+    {
+        jobServer->readFd = ownFd;
+        jobServer->ownsReadFd = true;
+    }
+
+#endif
+
+    return true;
+}
+
+void disconnectJobServer(struct jobServer *jobServer)
+{
+    if(jobServer->ownsReadFd && jobServer->readFd >= 0)
+    { close(jobServer->readFd); }
+
+    jobServer->readFd = -1;
+    jobServer->writeFd = -1;
+    jobServer->ownsReadFd = false;
+}
+
+// Waits up to timeout milliseconds for a token. Without a non-blocking descriptor, another process
+// can take the token between the poll and the read, in which case this waits for the next one.
+bool acquireJobToken(struct jobServer *jobServer, char *token, int timeout)
+{
+    struct pollfd pollFd = { jobServer->readFd, POLLIN, 0 };
+
+    if(poll(&pollFd, 1, timeout) <= 0 || !(pollFd.revents & POLLIN))
+    { return false; }
+
+    return read(jobServer->readFd, token, 1) == 1;
+}
+
+// Tokens go back as they came, make may care what's in them
+void releaseJobToken(struct jobServer *jobServer, char token)
+{
+    while(write(jobServer->writeFd, &token, 1) != 1)
+        if(errno != EINTR)
+        { break; }
+}
+
+uint32_t getProcessorCount()
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (uint32_t)count : 1;
+}
+
+#else
+
+// Make on Windows hands out tokens with a named semaphore, which isn't supported (yet)
+
+bool connectJobServer(struct jobServer *jobServer)
+{
+    jobServer->readFd = -1;
+    jobServer->writeFd = -1;
+    jobServer->ownsReadFd = false;
+    return false;
+}
+
+void disconnectJobServer(struct jobServer *jobServer)
+{
+}
+
+bool acquireJobToken(struct jobServer *jobServer, char *token, int timeout)
+{
+    return false;
+}
+
+void releaseJobToken(struct jobServer *jobServer, char token)
+{
+}
+
+uint32_t getProcessorCount()
+{
+    return 1;
+}
+
+#endif
@@ -0,0 +1,47 @@
+// This file is part of SynthXEX, one component of the
+// OpenXeChain development toolchain
+//
+// Copyright (c) 2025 Aiden Isik
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "common.h"
+#include "datastorage.h"
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <unistd.h>
+    #include <sys/stat.h>
+#endif
+
+// How long a worker waits for a token before checking whether there's still work for it
+#define JOB_TOKEN_POLL_MS 20
+
+// GNU make's jobserver, if we were run from a parallel build. Every token taken from it is one
+// more thread we may run, on top of the one make already counted us as.
+struct jobServer
+{
+    int readFd;
+    int writeFd;
+    bool ownsReadFd; // Opened by us (the fifo, or a non-blocking reopen of make's pipe)
+};
+
+bool connectJobServer(struct jobServer *jobServer);
+void disconnectJobServer(struct jobServer *jobServer);
+bool acquireJobToken(struct jobServer *jobServer, char *token, int timeout);
+void releaseJobToken(struct jobServer *jobServer, char token);
+uint32_t getProcessorCount();
@@ -0,0 +1,405 @@
+// This file is part of SynthXEX, one component of the
+// OpenXeChain development toolchain
+//
+// Copyright (c) 2025 Aiden Isik
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "taskpool.h"
+
+// Which pool (if any) the current thread works for, and it's deque
+_Thread_local struct taskPool *currentPool = NULL;
+_Thread_local uint32_t currentWorker = 0;
+
+struct taskWorkerInfo
+{
+    struct taskPool *pool;
+    uint32_t index;
+};
+
+int pushTask(struct taskDeque *deque, struct task *task)
+{
+    pthread_mutex_lock(&(deque->mutex));
+
+    if(deque->count == deque->capacity)
+    {
+        uint32_t newCapacity = (deque->capacity == 0) ? 16 : deque->capacity * 2;
+        struct task *newTasks = malloc(newCapacity * sizeof(struct task));
+
+        if(newTasks == NULL)
+        {
+            pthread_mutex_unlock(&(deque->mutex));
+            return ERR_OUT_OF_MEM;
+        }
+
+        // Unwrap the ring while we're at it
+        for(uint32_t i = 0; i < deque->count; i++)
+        { newTasks[i] = deque->tasks[(deque->head + i) % deque->capacity]; }
+
+        nullAndFree((void **) & (deque->tasks));
+        deque->tasks = newTasks;
+        deque->capacity = newCapacity;
+        deque->head = 0;
+    }
+
+    deque->tasks[(deque->head + deque->count) % deque->capacity] = *task;
+    deque->count++;
+
+    pthread_mutex_unlock(&(deque->mutex));
+    return SUCCESS;
+}
+
+// Newest task, for the deque's owner
+bool popTask(struct taskDeque *deque, struct task *task)
+{
+    bool got = false;
+    pthread_mutex_lock(&(deque->mutex));
+
+    if(deque->count > 0)
+    {
+        deque->count--;
+        *task = deque->tasks[(deque->head + deque->count) % deque->capacity];
+        got = true;
+    }
+
+    pthread_mutex_unlock(&(deque->mutex));
+    return got;
+}
+
+// Oldest task, for everyone else
+bool stealTask(struct taskDeque *deque, struct task *task)
+{
+    bool got = false;
+    pthread_mutex_lock(&(deque->mutex));
+
+    if(deque->count > 0)
+    {
+        *task = deque->tasks[deque->head];
+        deque->head = (deque->head + 1) % deque->capacity;
+        deque->count--;
+        got = true;
+    }
+
+    pthread_mutex_unlock(&(deque->mutex));
+    return got;
+}
+
+// Tries our own deque first, then steals from the others in turn
+bool takeTask(struct taskPool *pool, uint32_t self, struct task *task)
+{
+    uint32_t dequeCount = pool->workerCount + 1;
+    bool got = popTask(&(pool->deques[self]), task);
+
+    for(uint32_t i = 1; !got && i < dequeCount; i++)
+    { got = stealTask(&(pool->deques[(self + i) % dequeCount]), task); }
+
+    if(got)
+    {
+        pthread_mutex_lock(&(pool->sleepMutex));
+        pool->pending--;
+        pthread_mutex_unlock(&(pool->sleepMutex));
+    }
+
+    return got;
+}
+
+void runTask(struct task *task)
+{
+    task->function(task->arg);
+
+    pthread_mutex_lock(&(task->group->mutex));
+    task->group->outstanding--;
+
+    if(task->group->outstanding == 0)
+    { pthread_cond_broadcast(&(task->group->done)); }
+
+    pthread_mutex_unlock(&(task->group->mutex));
+}
+
+// Waits for a jobserver token for as long as there's work waiting on one.
+// Gives up if the work's taken by someone else (the thread the jobserver already counts, most likely).
+bool waitForJobToken(struct taskPool *pool, char *token)
+{
+    while(true)
+    {
+        if(acquireJobToken(pool->jobServer, token, JOB_TOKEN_POLL_MS))
+        { return true; }
+
+        pthread_mutex_lock(&(pool->sleepMutex));
+        bool wanted = (pool->pending > 0);
+        pthread_mutex_unlock(&(pool->sleepMutex));
+
+        if(!wanted)
+        { return false; }
+    }
+}
+
+// Under a jobserver, a worker holds a token while it has tasks to run and gives it back as soon as
+// it runs out, so the pool grows when the rest of the build is idle and shrinks when it's busy
+void *taskWorker(void *arg)
+{
+    struct taskWorkerInfo *info = arg;
+    struct taskPool *pool = info->pool;
+    currentPool = pool;
+    currentWorker = info->index;
+
+    bool haveToken = (pool->jobServer == NULL);
+    char token = 0;
+
+    while(true)
+    {
+        struct task task;
+
+        if(haveToken && takeTask(pool, currentWorker, &task))
+        {
+            runTask(&task);
+            continue;
+        }
+
+        if(pool->jobServer != NULL && haveToken)
+        {
+            releaseJobToken(pool->jobServer, token);
+            haveToken = false;
+        }
+
+        pthread_mutex_lock(&(pool->sleepMutex));
+
+        while(pool->pending == 0 && !pool->stopping)
+        { pthread_cond_wait(&(pool->wake), &(pool->sleepMutex)); }
+
+        bool stop = (pool->stopping && pool->pending == 0);
+        pthread_mutex_unlock(&(pool->sleepMutex));
+
+        if(stop)
+        { break; }
+
+        if(pool->jobServer != NULL)
+        { haveToken = waitForJobToken(pool, &token); }
+    }
+
+    nullAndFree((void **)&info);
+    return NULL;
+}
+
+// If we can't get as many threads as requested, carry on with the ones we have.
+// With none, whoever waits on a group runs it's tasks.
+int createTaskPool(struct taskPool *pool, uint32_t workerCount, struct jobServer *jobServer)
+{
+    memset(pool, 0, sizeof(struct taskPool));
+    pool->threads = calloc(workerCount + 1, sizeof(pthread_t));
+    pool->deques = calloc(workerCount + 1, sizeof(struct taskDeque));
+
+    if(pool->threads == NULL || pool->deques == NULL)
+    {
+        nullAndFree((void **) & (pool->threads));
+        nullAndFree((void **) & (pool->deques));
+        return ERR_OUT_OF_MEM;
+    }
+
+    pthread_mutex_init(&(pool->sleepMutex), NULL);
+    pthread_cond_init(&(pool->wake), NULL);
+    pool->jobServer = jobServer;
+
+    // All the deques exist before any worker starts, the workers steal from the shared one at the end by index
+    pool->workerCount = workerCount;
+
+    for(uint32_t i = 0; i <= workerCount; i++)
+    { pthread_mutex_init(&(pool->deques[i].mutex), NULL); }
+
+    uint32_t started = 0;
+
+    for(; started < workerCount; started++)
+    {
+        struct taskWorkerInfo *info = malloc(sizeof(struct taskWorkerInfo));
+
+        if(info == NULL)
+        { break; }
+
+        info->pool = pool;
+        info->index = started;
+
+        if(pthread_create(&(pool->threads[started]), NULL, taskWorker, info) != 0)
+        {
+            nullAndFree((void **)&info);
+            break;
+        }
+    }
+
+    // Deques past the last started worker are still stolen from, so nothing submitted there is lost
+    pool->threadCount = started;
+    return SUCCESS;
+}
+
+void destroyTaskPool(struct taskPool *pool)
+{
+    pthread_mutex_lock(&(pool->sleepMutex));
+    pool->stopping = true;
+    pthread_cond_broadcast(&(pool->wake));
+    pthread_mutex_unlock(&(pool->sleepMutex));
+
+    for(uint32_t i = 0; i < pool->threadCount; i++)
+    { pthread_join(pool->threads[i], NULL); }
+
+    for(uint32_t i = 0; i <= pool->workerCount; i++)
+    {
+        pthread_mutex_destroy(&(pool->deques[i].mutex));
+        nullAndFree((void **) & (pool->deques[i].tasks));
+    }
+
+    pthread_cond_destroy(&(pool->wake));
+    pthread_mutex_destroy(&(pool->sleepMutex));
+    nullAndFree((void **) & (pool->threads));
+    nullAndFree((void **) & (pool->deques));
+}
+
+int initTaskGroup(struct taskGroup *group)
+{
+    group->outstanding = 0;
+
+    if(pthread_mutex_init(&(group->mutex), NULL) != 0)
+    { return ERR_OUT_OF_MEM; }
+
+    if(pthread_cond_init(&(group->done), NULL) != 0)
+    {
+        pthread_mutex_destroy(&(group->mutex));
+        return ERR_OUT_OF_MEM;
+    }
+
+    return SUCCESS;
+}
+
+void destroyTaskGroup(struct taskGroup *group)
+{
+    pthread_cond_destroy(&(group->done));
+    pthread_mutex_destroy(&(group->mutex));
+}
+
+int submitTask(struct taskPool *pool, struct taskGroup *group, void *(*function)(void *), void *arg)
+{
+    struct task task = { function, arg, group };
+    uint32_t deque = (currentPool == pool) ? currentWorker : pool->workerCount;
+
+    pthread_mutex_lock(&(group->mutex));
+    group->outstanding++;
+    pthread_mutex_unlock(&(group->mutex));
+
+    // Counted before it's pushed, so a worker taking it straight away can't bring pending below zero
+    pthread_mutex_lock(&(pool->sleepMutex));
+    pool->pending++;
+    pthread_mutex_unlock(&(pool->sleepMutex));
+
+    int ret = pushTask(&(pool->deques[deque]), &task);
+
+    pthread_mutex_lock(&(pool->sleepMutex));
+
+    if(ret != SUCCESS)
+    { pool->pending--; }
+    else
+    { pthread_cond_signal(&(pool->wake)); }
+
+    pthread_mutex_unlock(&(pool->sleepMutex));
+
+    if(ret != SUCCESS)
+    {
+        pthread_mutex_lock(&(group->mutex));
+        group->outstanding--;
+        pthread_mutex_unlock(&(group->mutex));
+        return ret;
+    }
+
+    return SUCCESS;
+}
+
+// Runs whatever tasks can be found while waiting, so a task can wait on tasks it submitted itself
+// without tying up a worker. Only sleeps once there's nothing left to take, at which point
+// everything in the group is already running somewhere.
+void waitTaskGroup(struct taskPool *pool, struct taskGroup *group)
+{
+    uint32_t self = (currentPool == pool) ? currentWorker : pool->workerCount;
+
+    while(true)
+    {
+        pthread_mutex_lock(&(group->mutex));
+        bool done = (group->outstanding == 0);
+        pthread_mutex_unlock(&(group->mutex));
+
+        if(done)
+        { break; }
+
+        struct task task;
+
+        if(takeTask(pool, self, &task))
+        {
+            runTask(&task);
+            continue;
+        }
+
+        pthread_mutex_lock(&(group->mutex));
+
+        while(group->outstanding > 0)
+        { pthread_cond_wait(&(group->done), &(group->mutex)); }
+
+        pthread_mutex_unlock(&(group->mutex));
+        break;
+    }
+}
+
+// Runs count copies of worker on arg, one of them on the calling thread.
+// Without a pool, the others get threads of their own.
+int runParallel(struct taskPool *pool, void *(*worker)(void *), void *arg, uint32_t count)
+{
+    if(count == 0)
+    { count = 1; }
+
+    if(pool != NULL)
+    {
+        struct taskGroup group;
+
+        if(initTaskGroup(&group) != SUCCESS)
+        {
+            worker(arg);
+            return SUCCESS;
+        }
+
+        // If we can't submit as many as requested, carry on with the ones we have
+        for(uint32_t i = 0; i < count - 1; i++)
+            if(submitTask(pool, &group, worker, arg) != SUCCESS)
+            { break; }
+
+        worker(arg);
+        waitTaskGroup(pool, &group);
+        destroyTaskGroup(&group);
+        return SUCCESS;
+    }
+
+    pthread_t *threads = calloc(count, sizeof(pthread_t));
+
+    if(!threads)
+    { return ERR_OUT_OF_MEM; }
+
+    // If we can't get as many threads as requested, carry on with the ones we have
+    uint32_t started = 0;
+
+    for(; started < count - 1; started++)
+        if(pthread_create(&threads[started], NULL, worker, arg) != 0)
+        { break; }
+
+    worker(arg);
+
+    for(uint32_t i = 0; i < started; i++)
+    { pthread_join(threads[i], NULL); }
+
+    nullAndFree((void **)&threads);
+    return SUCCESS;
+}
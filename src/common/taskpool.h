@@ -0,0 +1,73 @@
+// This file is part of SynthXEX, one component of the
+// OpenXeChain development toolchain
+//
+// Copyright (c) 2025 Aiden Isik
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "common.h"
+#include "datastorage.h"
+#include "jobserver.h"
+
+#include <pthread.h>
+
+// A pool of threads with a deque of tasks each. Workers take the newest task from their own deque
+// and steal the oldest from the others when it's empty, so related work stays on one thread until
+// someone else is idle. Tasks submitted from outside the pool go on a shared deque everyone steals from.
+struct task
+{
+    void *(*function)(void *);
+    void *arg;
+    struct taskGroup *group;
+};
+
+struct taskDeque
+{
+    pthread_mutex_t mutex;
+    struct task *tasks; // Ring buffer
+    uint32_t capacity;
+    uint32_t head; // Oldest task, where thieves take from
+    uint32_t count;
+};
+
+struct taskPool
+{
+    uint32_t workerCount;
+    uint32_t threadCount; // How many workers actually started
+    pthread_t *threads;
+    struct taskDeque *deques; // One per worker, then the shared one
+    pthread_mutex_t sleepMutex; // Guards pending and stopping
+    pthread_cond_t wake;
+    uint32_t pending; // Tasks sitting in deques
+    bool stopping;
+    struct jobServer *jobServer; // If set, workers only run tasks while holding a token from it
+};
+
+// Tasks which someone is waiting on together
+struct taskGroup
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t done;
+    uint32_t outstanding;
+};
+
+int createTaskPool(struct taskPool *pool, uint32_t workerCount, struct jobServer *jobServer);
+void destroyTaskPool(struct taskPool *pool);
+int initTaskGroup(struct taskGroup *group);
+void destroyTaskGroup(struct taskGroup *group);
+int submitTask(struct taskPool *pool, struct taskGroup *group, void *(*function)(void *), void *arg);
+void waitTaskGroup(struct taskPool *pool, struct taskGroup *group);
+int runParallel(struct taskPool *pool, void *(*worker)(void *), void *arg, uint32_t count);
@@ -0,0 +1,238 @@
+// This file is part of SynthXEX, one component of the
+// OpenXeChain development toolchain
+//
+// Copyright (c) 2025 Aiden Isik
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "basiccomp.h"
+
+// 16 bytes is a native vector on every SIMD ISA we care about (SSE2, NEON, AltiVec),
+// and GCC/Clang fall back to scalar code for it anywhere else
+typedef uint8_t zeroScanVec __attribute__((vector_size(16)));
+
+bool isZeroGranule(const uint8_t *data)
+{
+    zeroScanVec acc = { 0 };
+
+    for(uint32_t i = 0; i < BASIC_COMP_SCAN_GRANULE; i += sizeof(zeroScanVec))
+    {
+        zeroScanVec current;
+        memcpy(&current, data + i, sizeof(zeroScanVec));
+        acc |= current;
+    }
+
+    uint64_t halves[2];
+    memcpy(halves, &acc, sizeof(halves));
+    return (halves[0] | halves[1]) == 0;
+}
+
+int addBasicCompBlock(struct basicCompBlock **blocks, uint32_t *blockCount, uint32_t dataSize, uint32_t zeroSize)
+{
+    // Grow in powers of two, there can be a lot of these
+    if((*blockCount & (*blockCount - 1)) == 0)
+    {
+        struct basicCompBlock *newBlocks = realloc(*blocks, (*blockCount == 0 ? 1 : *blockCount * 2) * sizeof(struct basicCompBlock));
+
+        if(newBlocks == NULL)
+        { return ERR_OUT_OF_MEM; }
+
+        *blocks = newBlocks;
+    }
+
+    (*blocks)[*blockCount].dataSize = dataSize;
+    (*blocks)[*blockCount].zeroSize = zeroSize;
+    (*blockCount)++;
+    return SUCCESS;
+}
+
+// Splits the basefile into data/zero block pairs. Without elideZeroes, the whole basefile is one data block.
+int getBasicCompBlocks(struct basefile *basefile, bool elideZeroes, struct basicCompBlock **blocks, uint32_t *blockCount)
+{
+    *blocks = NULL;
+    *blockCount = 0;
+
+    uint32_t dataStart = 0; // Start of the current block's data
+    uint32_t offset = 0;
+
+    // The basefile is a whole number of pages, so always a whole number of granules
+    while(elideZeroes && offset < basefile->size)
+    {
+        if(!isZeroGranule(basefile->data + offset))
+        {
+            offset += BASIC_COMP_SCAN_GRANULE;
+            continue;
+        }
+
+        uint32_t zeroStart = offset;
+
+        while(offset < basefile->size && isZeroGranule(basefile->data + offset))
+        { offset += BASIC_COMP_SCAN_GRANULE; }
+
+        if(offset - zeroStart < BASIC_COMP_MIN_ZERO_RUN && offset < basefile->size)
+        { continue; }
+
+        int ret = addBasicCompBlock(blocks, blockCount, zeroStart - dataStart, offset - zeroStart);
+
+        if(ret != SUCCESS)
+        {
+            nullAndFree((void **)blocks);
+            return ret;
+        }
+
+        dataStart = offset;
+    }
+
+    if(dataStart < basefile->size || *blockCount == 0)
+    {
+        int ret = addBasicCompBlock(blocks, blockCount, basefile->size - dataStart, 0);
+
+        if(ret != SUCCESS)
+        {
+            nullAndFree((void **)blocks);
+            return ret;
+        }
+    }
+
+    return SUCCESS;
+}
+
+int createBasicCompMap(struct basicCompMap *map, struct basefileFormat *basefileFormat)
+{
+    struct basicCompBlock *blocks = basefileFormat->blocks; // Avoid dereferencing unaligned pointer
+
+    map->blockCount = (basefileFormat->size - 8) / sizeof(struct basicCompBlock);
+    map->basefileStarts = malloc(map->blockCount * sizeof(uint32_t));
+    map->xexStarts = malloc(map->blockCount * sizeof(uint32_t));
+    map->dataSizes = malloc(map->blockCount * sizeof(uint32_t));
+
+    if(map->basefileStarts == NULL || map->xexStarts == NULL || map->dataSizes == NULL)
+    {
+        freeBasicCompMap(map);
+        return ERR_OUT_OF_MEM;
+    }
+
+    uint32_t basefileOffset = 0;
+    uint32_t xexOffset = 0;
+
+    for(uint32_t i = 0; i < map->blockCount; i++)
+    {
+        map->basefileStarts[i] = basefileOffset;
+        map->xexStarts[i] = xexOffset;
+        map->dataSizes[i] = blocks[i].dataSize;
+        basefileOffset += blocks[i].dataSize + blocks[i].zeroSize;
+        xexOffset += blocks[i].dataSize;
+    }
+
+    return SUCCESS;
+}
+
+void freeBasicCompMap(struct basicCompMap *map)
+{
+    nullAndFree((void **) & (map->basefileStarts));
+    nullAndFree((void **) & (map->xexStarts));
+    nullAndFree((void **) & (map->dataSizes));
+}
+
+// Finds the first block with data ending after start
+uint32_t findBasicCompBlock(struct basicCompMap *map, uint32_t start)
+{
+    uint32_t low = 0;
+    uint32_t high = map->blockCount;
+
+    while(low < high)
+    {
+        uint32_t mid = low + ((high - low) / 2);
+
+        if((uint64_t)map->basefileStarts[mid] + map->dataSizes[mid] <= start)
+        { low = mid + 1; }
+        else
+        { high = mid; }
+    }
+
+    return low;
+}
+
+// Writes whatever part of basefile[start, start + length) is kept as block data to where it belongs in the XEX.
+// If inKernel is set, the copy is left to the kernel where possible (see copyBasefileRange),
+// which isn't safe to do from several threads at once. With existing (see writeChangedAtOffset), only what changed is written.
+int writeBasicCompRange(struct basicCompMap *map, struct basefile *basefile, uint32_t start, uint32_t length,
+                        FILE *xex, uint32_t xexOffset, bool inKernel, const struct mappedFile *existing)
+{
+    uint64_t end = (uint64_t)start + length;
+
+    for(uint32_t i = findBasicCompBlock(map, start); i < map->blockCount && map->basefileStarts[i] < end; i++)
+    {
+        uint64_t from = (start > map->basefileStarts[i]) ? start : map->basefileStarts[i];
+        uint64_t to = (uint64_t)map->basefileStarts[i] + map->dataSizes[i];
+
+        if(to > end)
+        { to = end; }
+
+        if(from >= to)
+        { continue; }
+
+        uint64_t destination = (uint64_t)xexOffset + map->xexStarts[i] + (from - map->basefileStarts[i]);
+        int ret;
+
+        if(existing != NULL)
+        { ret = writeChangedAtOffset(xex, existing, basefile->data + from, to - from, destination); }
+        else if(inKernel)
+        { ret = copyBasefileRange(basefile, from, to - from, xex, destination); }
+        else
+        { ret = writeAtOffset(xex, basefile->data + from, to - from, destination); }
+
+        if(ret != SUCCESS)
+        { return ret; }
+    }
+
+    return SUCCESS;
+}
+
+// How much of the XEX the basefile takes up, after the headers
+uint64_t getStoredBasefileSize(struct basefileFormat *basefileFormat)
+{
+    if(basefileFormat->compType == XEX_COMP_NORMAL)
+    { return basefileFormat->normalCompDataSize; }
+
+    struct basicCompBlock *blocks = basefileFormat->blocks; // Avoid dereferencing unaligned pointer
+    uint32_t blockCount = (basefileFormat->size - 8) / sizeof(struct basicCompBlock);
+    uint64_t size = 0;
+
+    for(uint32_t i = 0; i < blockCount; i++)
+    { size += blocks[i].dataSize; }
+
+    return size;
+}
+
+// Encrypts whatever part of basefile[start, start + length) is kept as block data, in place.
+// Only the kept data is in the XEX, so that's all the CBC chain runs through.
+// iv carries the chain from one call to the next, so ranges must be passed in order.
+void encryptBasicCompRange(struct basicCompMap *map, struct basefile *basefile, uint32_t start, uint32_t length,
+                           struct aes128_ctx *aes, uint8_t *iv)
+{
+    uint64_t end = (uint64_t)start + length;
+
+    for(uint32_t i = findBasicCompBlock(map, start); i < map->blockCount && map->basefileStarts[i] < end; i++)
+    {
+        uint64_t from = (start > map->basefileStarts[i]) ? start : map->basefileStarts[i];
+        uint64_t to = (uint64_t)map->basefileStarts[i] + map->dataSizes[i];
+
+        if(to > end)
+        { to = end; }
+
+        if(from < to)
+        { cbc_aes128_encrypt(aes, iv, to - from, basefile->data + from, basefile->data + from); }
+    }
+}
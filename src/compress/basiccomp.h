@@ -0,0 +1,49 @@
+// This file is part of SynthXEX, one component of the
+// OpenXeChain development toolchain
+//
+// Copyright (c) 2025 Aiden Isik
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "../common/common.h"
+#include "../common/crypto.h"
+#include "../common/datastorage.h"
+
+// The basefile is checked for zeroes this many bytes at a time (a multiple of the scan vector size)
+#define BASIC_COMP_SCAN_GRANULE 0x40
+
+// Runs of zeroes shorter than this aren't worth another 8 byte block descriptor.
+// The final run is always removed, whatever it's length.
+#define BASIC_COMP_MIN_ZERO_RUN 0x100
+
+// Where the data of each block lives, in the basefile and in the XEX
+struct basicCompMap
+{
+    uint32_t blockCount;
+    uint32_t *basefileStarts;
+    uint32_t *xexStarts; // Relative to the start of the basefile in the XEX
+    uint32_t *dataSizes;
+};
+
+int getBasicCompBlocks(struct basefile *basefile, bool elideZeroes, struct basicCompBlock **blocks, uint32_t *blockCount);
+int createBasicCompMap(struct basicCompMap *map, struct basefileFormat *basefileFormat);
+void freeBasicCompMap(struct basicCompMap *map);
+uint32_t findBasicCompBlock(struct basicCompMap *map, uint32_t start);
+int writeBasicCompRange(struct basicCompMap *map, struct basefile *basefile, uint32_t start, uint32_t length,
+                        FILE *xex, uint32_t xexOffset, bool inKernel, const struct mappedFile *existing);
+uint64_t getStoredBasefileSize(struct basefileFormat *basefileFormat);
+void encryptBasicCompRange(struct basicCompMap *map, struct basefile *basefile, uint32_t start, uint32_t length,
+                           struct aes128_ctx *aes, uint8_t *iv);
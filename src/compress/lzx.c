@@ -0,0 +1,806 @@
+// This file is part of SynthXEX, one component of the
+// OpenXeChain development toolchain
+//
+// Copyright (c) 2025 Aiden Isik
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include "lzx.h"
+
+// Frames are handed out to the match finding workers this many at a time per worker, then encoded in order.
+// Bounds how many frames' worth of tokens are held at once.
+#define LZX_FRAMES_PER_JOB 4
+
+struct lzxLevel
+{
+    uint32_t chainLength; // Most candidates to try per position
+    uint32_t niceLength; // Stop looking once a match this long is found
+    bool lazy; // Check if the next position has a longer match before taking one
+};
+
+const struct lzxLevel lzxLevels[] =
+{
+    { 8, 32, false }, // LZX_LEVEL_FAST
+    { 64, 128, true }, // LZX_LEVEL_DEFAULT
+    { 1024, LZX_MAX_MATCH, true } // LZX_LEVEL_MAX
+};
+
+// Internal struct, shared between the match finding workers
+struct lzxMatchState
+{
+    const uint8_t *data;
+    uint32_t size;
+    const struct lzxLevel *level;
+    pthread_mutex_t mutex; // Guards nextFrame and ret
+    uint32_t firstFrame; // Frames in the current batch
+    uint32_t endFrame;
+    uint32_t nextFrame;
+    int ret;
+    struct lzxToken **tokens; // Per frame in the batch, at most one per byte
+    uint32_t *tokenCounts;
+};
+
+// Carried from one frame to the next while encoding
+struct lzxEncoder
+{
+    uint32_t R[3]; // Repeated offsets
+    uint8_t mainLengths[LZX_MAIN_TREE_SIZE]; // Tree lengths are sent relative to the previous block's
+    uint8_t lengthLengths[LZX_NUM_SECONDARY_LENGTHS];
+    bool headerWritten;
+};
+
+// 16 bit little endian words, filled from the most significant bit down
+struct lzxBitWriter
+{
+    uint8_t *data;
+    uint32_t size;
+    uint32_t capacity;
+    uint64_t bitBuffer;
+    uint32_t bitCount;
+};
+
+// Symbols for one frame, once offsets have been turned into position slots
+struct lzxSymbols
+{
+    uint16_t *main;
+    uint8_t *lengthFooters; // 0xFF if there isn't one
+    uint32_t *extraBits; // Verbatim position bits, (count << 24) | value
+    uint32_t count;
+};
+
+const uint8_t lzxExtraBits[LZX_NUM_POSITION_SLOTS] =
+{
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+const uint32_t lzxPositionBase[LZX_NUM_POSITION_SLOTS] =
+{
+    0, 1, 2, 3, 4, 6, 8, 12, 16, 24, 32, 48, 64, 96, 128, 192,
+    256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096, 6144, 8192, 12288, 16384, 24576
+};
+
+uint32_t lzxHash(const uint8_t *data)
+{
+    return ((((uint32_t)data[0] << 16) | ((uint32_t)data[1] << 8) | data[2]) * 2654435761U) >> (32 - LZX_HASH_BITS);
+}
+
+void lzxInsert(const uint8_t *data, uint32_t size, uint32_t pos, int32_t *head, int32_t *prev)
+{
+    if(pos + 2 >= size)
+    { return; }
+
+    uint32_t hash = lzxHash(data + pos);
+    prev[pos % LZX_HISTORY_SIZE] = head[hash];
+    head[hash] = pos;
+}
+
+// Longest match for pos among earlier positions with the same hash, not running past end
+uint32_t lzxFindMatch(const uint8_t *data, uint32_t size, uint32_t pos, uint32_t end, const struct lzxLevel *level,
+                             int32_t *head, int32_t *prev, uint32_t *distance)
+{
+    uint32_t limit = (end - pos < LZX_MAX_MATCH) ? end - pos : LZX_MAX_MATCH;
+    uint32_t bestLength = 0;
+
+    if(limit < 3 || pos + 2 >= size)
+    { return 0; }
+
+    int32_t candidate = head[lzxHash(data + pos)];
+
+    for(uint32_t chain = level->chainLength; candidate >= 0 && chain > 0; chain--)
+    {
+        if(pos - candidate > LZX_MAX_DISTANCE)
+        { break; } // Chains go backwards, so everything further along is too far away as well
+
+        const uint8_t *a = data + candidate;
+        const uint8_t *b = data + pos;
+
+        if(bestLength == 0 || a[bestLength] == b[bestLength])
+        {
+            uint32_t length = 0;
+
+            while(length < limit && a[length] == b[length])
+            { length++; }
+
+            if(length > bestLength)
+            {
+                bestLength = length;
+                *distance = pos - candidate;
+
+                if(length >= level->niceLength || length == limit)
+                { break; }
+            }
+        }
+
+        candidate = prev[candidate % LZX_HISTORY_SIZE];
+    }
+
+    return (bestLength >= 3) ? bestLength : 0;
+}
+
+// Turns one frame into literals and matches. Matches only depend on the data, not on anything encoded before,
+// so every frame can be done independently, looking back into the window before it.
+void lzxParseFrame(struct lzxMatchState *state, uint32_t frame, int32_t *head, int32_t *prev)
+{
+    const uint8_t *data = state->data;
+    uint32_t start = frame * LZX_FRAME_SIZE;
+    uint32_t end = (state->size - start < LZX_FRAME_SIZE) ? state->size : start + LZX_FRAME_SIZE;
+    struct lzxToken *tokens = state->tokens[frame - state->firstFrame];
+    uint32_t count = 0;
+
+    memset(head, 0xFF, sizeof(int32_t) << LZX_HASH_BITS);
+
+    for(uint32_t pos = (start > LZX_WINDOW_SIZE) ? start - LZX_WINDOW_SIZE : 0; pos < start; pos++)
+    { lzxInsert(data, state->size, pos, head, prev); }
+
+    // Lookahead from lazy matching, still valid on the next position as nothing has been inserted since
+    uint32_t nextLength = 0;
+    uint32_t nextDistance = 0;
+    bool haveNext = false;
+
+    for(uint32_t pos = start; pos < end;)
+    {
+        uint32_t distance = 0;
+        uint32_t length;
+
+        if(haveNext)
+        {
+            length = nextLength;
+            distance = nextDistance;
+            haveNext = false;
+        }
+        else
+        { length = lzxFindMatch(data, state->size, pos, end, state->level, head, prev, &distance); }
+
+        lzxInsert(data, state->size, pos, head, prev);
+
+        if(length != 0 && state->level->lazy && length < state->level->niceLength && pos + 1 < end)
+        {
+            nextLength = lzxFindMatch(data, state->size, pos + 1, end, state->level, head, prev, &nextDistance);
+            haveNext = true;
+
+            if(nextLength > length)
+            { length = 0; } // Better to take a literal here and the longer match after it
+        }
+
+        if(length == 0)
+        {
+            tokens[count].length = 0;
+            tokens[count].literal = data[pos];
+            count++;
+            pos++;
+            continue;
+        }
+
+        tokens[count].length = length;
+        tokens[count].distance = distance;
+        count++;
+        haveNext = false;
+
+        for(uint32_t i = 1; i < length; i++)
+        { lzxInsert(data, state->size, pos + i, head, prev); }
+
+        pos += length;
+    }
+
+    state->tokenCounts[frame - state->firstFrame] = count;
+}
+
+void *lzxFindMatches(void *arg)
+{
+    struct lzxMatchState *state = arg;
+    int32_t *head = malloc(sizeof(int32_t) << LZX_HASH_BITS);
+    int32_t *prev = malloc(LZX_HISTORY_SIZE * sizeof(int32_t));
+
+    if(!head || !prev)
+    {
+        nullAndFree((void **)&head);
+        nullAndFree((void **)&prev);
+
+        pthread_mutex_lock(&(state->mutex));
+        state->ret = ERR_OUT_OF_MEM;
+        pthread_mutex_unlock(&(state->mutex));
+        return NULL;
+    }
+
+    while(true)
+    {
+        pthread_mutex_lock(&(state->mutex));
+
+        if(state->nextFrame >= state->endFrame || state->ret != SUCCESS)
+        {
+            pthread_mutex_unlock(&(state->mutex));
+            break;
+        }
+
+        uint32_t frame = state->nextFrame;
+        state->nextFrame++;
+
+        pthread_mutex_unlock(&(state->mutex));
+
+        lzxParseFrame(state, frame, head, prev);
+    }
+
+    nullAndFree((void **)&head);
+    nullAndFree((void **)&prev);
+    return NULL;
+}
+
+// Huffman code lengths for freqs, no longer than maxLength. Any code with symbols in it is complete,
+// as the decoder requires, so a lone symbol gets a partner.
+void lzxBuildLengths(const uint32_t *freqs, uint32_t count, uint8_t maxLength, uint8_t *lengths)
+{
+    uint32_t symbols[LZX_MAIN_TREE_SIZE];
+    uint32_t weights[LZX_MAIN_TREE_SIZE * 2];
+    uint32_t parents[LZX_MAIN_TREE_SIZE * 2];
+    uint32_t depths[LZX_MAIN_TREE_SIZE * 2];
+    uint32_t lengthCounts[LZX_MAIN_TREE_SIZE + 1];
+    uint32_t used = 0;
+
+    memset(lengths, 0, count);
+
+    for(uint32_t i = 0; i < count; i++)
+        if(freqs[i] != 0)
+        { symbols[used++] = i; }
+
+    if(used == 0)
+    { return; }
+
+    if(used == 1)
+    {
+        lengths[symbols[0]] = 1;
+        lengths[(symbols[0] == 0) ? 1 : 0] = 1;
+        return;
+    }
+
+    // Sort by frequency (insertion sort, there are only a few hundred symbols at most)
+    for(uint32_t i = 1; i < used; i++)
+    {
+        uint32_t symbol = symbols[i];
+        uint32_t j = i;
+
+        for(; j > 0 && freqs[symbols[j - 1]] > freqs[symbol]; j--)
+        { symbols[j] = symbols[j - 1]; }
+
+        symbols[j] = symbol;
+    }
+
+    // Two queue Huffman: leaves are 0 to used - 1 in order, internal nodes follow in the order they're made
+    for(uint32_t i = 0; i < used; i++)
+    { weights[i] = freqs[symbols[i]]; }
+
+    uint32_t nextLeaf = 0;
+    uint32_t nextNode = used;
+
+    for(uint32_t node = used; node < (used * 2) - 1; node++)
+    {
+        uint32_t children[2];
+
+        for(uint32_t c = 0; c < 2; c++)
+        {
+            if(nextLeaf < used && (nextNode >= node || weights[nextLeaf] <= weights[nextNode]))
+            { children[c] = nextLeaf++; }
+            else
+            { children[c] = nextNode++; }
+        }
+
+        weights[node] = weights[children[0]] + weights[children[1]];
+        parents[children[0]] = node;
+        parents[children[1]] = node;
+    }
+
+    uint32_t root = (used * 2) - 2;
+    uint32_t maxDepth = 0;
+    depths[root] = 0;
+    memset(lengthCounts, 0, sizeof(lengthCounts));
+
+    for(int64_t node = root - 1; node >= 0; node--)
+    {
+        depths[node] = depths[parents[node]] + 1;
+
+        if(node < used)
+        {
+            lengthCounts[depths[node]]++;
+            maxDepth = (depths[node] > maxDepth) ? depths[node] : maxDepth;
+        }
+    }
+
+    // Push anything too deep back up, keeping the code complete (as in JPEG, ITU T.81 K.3)
+    for(uint32_t i = maxDepth; i > maxLength; i--)
+    {
+        while(lengthCounts[i] > 0)
+        {
+            uint32_t j = i - 2;
+
+            while(lengthCounts[j] == 0)
+            { j--; }
+
+            lengthCounts[i] -= 2;
+            lengthCounts[i - 1]++;
+            lengthCounts[j + 1] += 2;
+            lengthCounts[j]--;
+        }
+    }
+
+    // Most frequent symbols get the shortest codes
+    uint32_t length = 1;
+
+    for(int64_t i = used - 1; i >= 0; i--)
+    {
+        while(lengthCounts[length] == 0)
+        { length++; }
+
+        lengths[symbols[i]] = length;
+        lengthCounts[length]--;
+    }
+}
+
+// Canonical codes, shortest first and in symbol order within each length
+void lzxBuildCodes(const uint8_t *lengths, uint32_t count, uint16_t *codes)
+{
+    uint32_t lengthCounts[LZX_MAX_CODE_LENGTH + 1] = { 0 };
+    uint32_t nextCode[LZX_MAX_CODE_LENGTH + 1];
+    uint32_t code = 0;
+
+    for(uint32_t i = 0; i < count; i++)
+    { lengthCounts[lengths[i]]++; }
+
+    lengthCounts[0] = 0;
+
+    for(uint32_t i = 1; i <= LZX_MAX_CODE_LENGTH; i++)
+    {
+        code = (code + lengthCounts[i - 1]) << 1;
+        nextCode[i] = code;
+    }
+
+    for(uint32_t i = 0; i < count; i++)
+        if(lengths[i] != 0)
+        { codes[i] = nextCode[lengths[i]]++; }
+}
+
+void lzxPutBits(struct lzxBitWriter *writer, uint32_t value, uint32_t count)
+{
+    writer->bitBuffer = (writer->bitBuffer << count) | value;
+    writer->bitCount += count;
+
+    while(writer->bitCount >= 16)
+    {
+        writer->bitCount -= 16;
+        uint16_t word = (uint16_t)(writer->bitBuffer >> writer->bitCount);
+
+        // Overflow is caught by the caller from the size
+        if(writer->size + 2 <= writer->capacity)
+        {
+            writer->data[writer->size] = word & 0xFF;
+            writer->data[writer->size + 1] = word >> 8;
+        }
+
+        writer->size += 2;
+    }
+}
+
+// Pads out to a 16 bit boundary, as the decoder realigns after every frame
+void lzxAlign(struct lzxBitWriter *writer)
+{
+    if(writer->bitCount != 0)
+    { lzxPutBits(writer, 0, 16 - writer->bitCount); }
+}
+
+// Sends lengths as deltas from previous, run length coded through a pretree
+void lzxWriteLengths(struct lzxBitWriter *writer, const uint8_t *previous, const uint8_t *lengths, uint32_t count)
+{
+    uint8_t ops[LZX_MAIN_TREE_SIZE]; // Pretree symbol
+    uint8_t opExtras[LZX_MAIN_TREE_SIZE]; // Run length bits, and the delta symbol for runs of the same length
+    uint32_t opCount = 0;
+    uint32_t freqs[LZX_PRETREE_SIZE] = { 0 };
+
+    for(uint32_t x = 0; x < count;)
+    {
+        uint32_t run = 1;
+
+        while(x + run < count && lengths[x + run] == lengths[x])
+        { run++; }
+
+        if(lengths[x] == 0 && run >= 20)
+        {
+            run = (run > 51) ? 51 : run;
+            ops[opCount] = 18;
+            opExtras[opCount++] = run - 20;
+        }
+        else if(lengths[x] == 0 && run >= 4)
+        {
+            run = (run > 19) ? 19 : run;
+            ops[opCount] = 17;
+            opExtras[opCount++] = run - 4;
+        }
+        else if(run >= 4)
+        {
+            run = (run > 5) ? 5 : run;
+            uint8_t delta = (previous[x] + 17 - lengths[x]) % 17;
+            ops[opCount] = 19;
+            opExtras[opCount++] = ((run - 4) << 7) | delta;
+            freqs[delta]++;
+        }
+        else
+        {
+            run = 1;
+            ops[opCount] = (previous[x] + 17 - lengths[x]) % 17;
+            opExtras[opCount++] = 0;
+        }
+
+        freqs[ops[opCount - 1]]++;
+        x += run;
+    }
+
+    uint8_t pretreeLengths[LZX_PRETREE_SIZE];
+    uint16_t pretreeCodes[LZX_PRETREE_SIZE];
+    lzxBuildLengths(freqs, LZX_PRETREE_SIZE, LZX_MAX_PRETREE_LENGTH, pretreeLengths);
+    lzxBuildCodes(pretreeLengths, LZX_PRETREE_SIZE, pretreeCodes);
+
+    for(uint32_t i = 0; i < LZX_PRETREE_SIZE; i++)
+    { lzxPutBits(writer, pretreeLengths[i], 4); }
+
+    for(uint32_t i = 0; i < opCount; i++)
+    {
+        lzxPutBits(writer, pretreeCodes[ops[i]], pretreeLengths[ops[i]]);
+
+        if(ops[i] == 17)
+        { lzxPutBits(writer, opExtras[i], 4); }
+        else if(ops[i] == 18)
+        { lzxPutBits(writer, opExtras[i], 5); }
+        else if(ops[i] == 19)
+        {
+            uint8_t delta = opExtras[i] & 0x7F;
+            lzxPutBits(writer, opExtras[i] >> 7, 1);
+            lzxPutBits(writer, pretreeCodes[delta], pretreeLengths[delta]);
+        }
+    }
+}
+
+uint32_t lzxPositionSlot(uint32_t formattedOffset)
+{
+    if(formattedOffset < 4)
+    { return formattedOffset; }
+
+    uint32_t highBit = 31 - __builtin_clz(formattedOffset);
+    return (highBit * 2) + ((formattedOffset >> (highBit - 1)) & 1);
+}
+
+// Encodes one frame as a single verbatim block. The encoder state is only updated if it fits in a chunk.
+int lzxEncodeFrame(struct lzxEncoder *encoder, const struct lzxToken *tokens, uint32_t tokenCount, uint32_t frameSize,
+                          struct lzxSymbols *symbols, struct lzxBitWriter *writer)
+{
+    uint32_t R[3] = { encoder->R[0], encoder->R[1], encoder->R[2] };
+    uint32_t mainFreqs[LZX_MAIN_TREE_SIZE] = { 0 };
+    uint32_t lengthFreqs[LZX_NUM_SECONDARY_LENGTHS] = { 0 };
+
+    for(uint32_t i = 0; i < tokenCount; i++)
+    {
+        symbols->lengthFooters[i] = 0xFF;
+        symbols->extraBits[i] = 0;
+
+        if(tokens[i].length == 0)
+        {
+            symbols->main[i] = tokens[i].literal;
+            mainFreqs[tokens[i].literal]++;
+            continue;
+        }
+
+        uint32_t distance = tokens[i].distance;
+        uint32_t slot;
+
+        if(distance == R[0])
+        { slot = 0; }
+        else if(distance == R[1])
+        {
+            slot = 1;
+            R[1] = R[0];
+            R[0] = distance;
+        }
+        else if(distance == R[2])
+        {
+            slot = 2;
+            R[2] = R[0];
+            R[0] = distance;
+        }
+        else
+        {
+            uint32_t formattedOffset = distance + 2;
+            slot = lzxPositionSlot(formattedOffset);
+            symbols->extraBits[i] = ((uint32_t)lzxExtraBits[slot] << 24) | (formattedOffset - lzxPositionBase[slot]);
+            R[2] = R[1];
+            R[1] = R[0];
+            R[0] = distance;
+        }
+
+        uint32_t lengthHeader = tokens[i].length - LZX_MIN_MATCH;
+
+        if(lengthHeader >= LZX_NUM_PRIMARY_LENGTHS)
+        {
+            symbols->lengthFooters[i] = lengthHeader - LZX_NUM_PRIMARY_LENGTHS;
+            lengthFreqs[lengthHeader - LZX_NUM_PRIMARY_LENGTHS]++;
+            lengthHeader = LZX_NUM_PRIMARY_LENGTHS;
+        }
+
+        symbols->main[i] = LZX_NUM_CHARS + ((slot << 3) | lengthHeader);
+        mainFreqs[symbols->main[i]]++;
+    }
+
+    uint8_t mainLengths[LZX_MAIN_TREE_SIZE];
+    uint8_t lengthLengths[LZX_NUM_SECONDARY_LENGTHS];
+    uint16_t mainCodes[LZX_MAIN_TREE_SIZE];
+    uint16_t lengthCodes[LZX_NUM_SECONDARY_LENGTHS];
+
+    lzxBuildLengths(mainFreqs, LZX_MAIN_TREE_SIZE, LZX_MAX_CODE_LENGTH, mainLengths);
+    lzxBuildLengths(lengthFreqs, LZX_NUM_SECONDARY_LENGTHS, LZX_MAX_CODE_LENGTH, lengthLengths);
+    lzxBuildCodes(mainLengths, LZX_MAIN_TREE_SIZE, mainCodes);
+    lzxBuildCodes(lengthLengths, LZX_NUM_SECONDARY_LENGTHS, lengthCodes);
+
+    writer->size = 0;
+    writer->bitBuffer = 0;
+    writer->bitCount = 0;
+
+    if(!encoder->headerWritten)
+    { lzxPutBits(writer, 0, 1); } // No E8 call translation
+
+    lzxPutBits(writer, LZX_BLOCKTYPE_VERBATIM, 3);
+    lzxPutBits(writer, frameSize >> 8, 16);
+    lzxPutBits(writer, frameSize & 0xFF, 8);
+
+    lzxWriteLengths(writer, encoder->mainLengths, mainLengths, LZX_NUM_CHARS);
+    lzxWriteLengths(writer, encoder->mainLengths + LZX_NUM_CHARS, mainLengths + LZX_NUM_CHARS, LZX_MAIN_TREE_SIZE - LZX_NUM_CHARS);
+    lzxWriteLengths(writer, encoder->lengthLengths, lengthLengths, LZX_NUM_SECONDARY_LENGTHS);
+
+    for(uint32_t i = 0; i < tokenCount; i++)
+    {
+        lzxPutBits(writer, mainCodes[symbols->main[i]], mainLengths[symbols->main[i]]);
+
+        if(symbols->lengthFooters[i] != 0xFF)
+        { lzxPutBits(writer, lengthCodes[symbols->lengthFooters[i]], lengthLengths[symbols->lengthFooters[i]]); }
+
+        if(symbols->extraBits[i] != 0)
+        { lzxPutBits(writer, symbols->extraBits[i] & 0xFFFFFF, symbols->extraBits[i] >> 24); }
+    }
+
+    lzxAlign(writer);
+
+    if(writer->size > LZX_MAX_CHUNK_SIZE || writer->size > writer->capacity)
+    { return ERR_DATA_OVERFLOW; }
+
+    memcpy(encoder->R, R, sizeof(R));
+    memcpy(encoder->mainLengths, mainLengths, sizeof(mainLengths));
+    memcpy(encoder->lengthLengths, lengthLengths, sizeof(lengthLengths));
+    encoder->headerWritten = true;
+    return SUCCESS;
+}
+
+// Appends a compressed frame as a block of its own: room for the next block's size and hash, the chunk, and an empty chunk to end it
+int lzxAddBlock(struct basefileFormat *basefileFormat, uint32_t *capacity, const uint8_t *chunk, uint32_t chunkSize)
+{
+    uint8_t *compData = basefileFormat->normalCompData; // Avoid dereferencing unaligned pointer
+    uint32_t blockSize = sizeof(struct normalCompBlockInfo) + 2 + chunkSize + 2;
+
+    if(basefileFormat->normalCompDataSize + blockSize > *capacity)
+    {
+        uint32_t newCapacity = (*capacity == 0) ? 0x100000 : *capacity * 2;
+
+        while(basefileFormat->normalCompDataSize + blockSize > newCapacity)
+        { newCapacity *= 2; }
+
+        uint8_t *newData = realloc(compData, newCapacity);
+
+        if(newData == NULL)
+        { return ERR_OUT_OF_MEM; }
+
+        compData = newData;
+        basefileFormat->normalCompData = compData;
+        *capacity = newCapacity;
+    }
+
+    uint8_t *block = compData + basefileFormat->normalCompDataSize;
+    memset(block, 0, sizeof(struct normalCompBlockInfo));
+    block[sizeof(struct normalCompBlockInfo)] = chunkSize >> 8;
+    block[sizeof(struct normalCompBlockInfo) + 1] = chunkSize & 0xFF;
+    memcpy(block + sizeof(struct normalCompBlockInfo) + 2, chunk, chunkSize);
+    block[blockSize - 2] = 0;
+    block[blockSize - 1] = 0;
+
+    basefileFormat->normalCompDataSize += blockSize;
+    return SUCCESS;
+}
+
+// Each block starts with the size and hash of the one after it, so they're hashed from the back.
+// The first block's info goes in the basefile format header.
+void lzxHashBlocks(struct basefileFormat *basefileFormat, uint32_t *blockStarts, uint32_t blockCount)
+{
+    uint8_t *compData = basefileFormat->normalCompData; // Avoid dereferencing unaligned pointer
+    struct normalCompBlockInfo next;
+    memset(&next, 0, sizeof(next));
+
+    for(int64_t i = blockCount - 1; i >= 0; i--)
+    {
+        uint32_t end = (i == blockCount - 1) ? basefileFormat->normalCompDataSize : blockStarts[i + 1];
+        uint8_t *block = compData + blockStarts[i];
+
+#ifdef LITTLE_ENDIAN_SYSTEM
+        next.size = __builtin_bswap32(next.size);
+#endif
+
+        memcpy(block, &next, sizeof(next));
+
+        struct sha1_ctx shaContext;
+        sha1_init(&shaContext);
+        sha1_update(&shaContext, end - blockStarts[i], block);
+        sha1_digest(&shaContext, 0x14, next.sha1);
+        next.size = end - blockStarts[i];
+    }
+
+    memcpy(&(basefileFormat->firstBlock), &next, sizeof(next));
+}
+
+int lzxCompressBasefile(struct basefile *basefile, uint8_t level, uint32_t jobs, struct taskPool *pool,
+                        struct basefileFormat *basefileFormat)
+{
+    uint32_t frameCount = (basefile->size + LZX_FRAME_SIZE - 1) / LZX_FRAME_SIZE;
+
+    if(jobs == 0)
+    { jobs = 1; }
+
+    uint32_t batchSize = (jobs * LZX_FRAMES_PER_JOB < frameCount) ? jobs * LZX_FRAMES_PER_JOB : frameCount;
+
+    struct lzxMatchState state;
+    memset(&state, 0, sizeof(state));
+    state.data = basefile->data;
+    state.size = basefile->size;
+    state.level = &lzxLevels[level];
+
+    struct lzxEncoder encoder;
+    memset(&encoder, 0, sizeof(encoder));
+    encoder.R[0] = encoder.R[1] = encoder.R[2] = 1;
+
+    struct lzxSymbols symbols;
+    symbols.main = malloc(LZX_FRAME_SIZE * sizeof(uint16_t));
+    symbols.lengthFooters = malloc(LZX_FRAME_SIZE);
+    symbols.extraBits = malloc(LZX_FRAME_SIZE * sizeof(uint32_t));
+
+    struct lzxBitWriter writer;
+    memset(&writer, 0, sizeof(writer));
+    writer.capacity = LZX_MAX_CHUNK_SIZE + 1;
+    writer.data = malloc(writer.capacity);
+
+    struct lzxToken *literals = malloc(LZX_FRAME_SIZE * sizeof(struct lzxToken)); // Fallback for frames which don't fit in a chunk
+    uint32_t *blockStarts = malloc(frameCount * sizeof(uint32_t));
+    state.tokens = calloc(batchSize, sizeof(struct lzxToken *));
+    state.tokenCounts = calloc(batchSize, sizeof(uint32_t));
+
+    int ret = SUCCESS;
+    uint32_t capacity = 0;
+    basefileFormat->normalCompData = NULL;
+    basefileFormat->normalCompDataSize = 0;
+
+    if(!symbols.main || !symbols.lengthFooters || !symbols.extraBits || !writer.data || !literals || !blockStarts
+            || !state.tokens || !state.tokenCounts)
+    {
+        ret = ERR_OUT_OF_MEM;
+        goto cleanup;
+    }
+
+    for(uint32_t i = 0; i < batchSize; i++)
+    {
+        state.tokens[i] = malloc(LZX_FRAME_SIZE * sizeof(struct lzxToken));
+
+        if(!state.tokens[i])
+        {
+            ret = ERR_OUT_OF_MEM;
+            goto cleanup;
+        }
+    }
+
+    if(pthread_mutex_init(&(state.mutex), NULL) != 0)
+    {
+        ret = ERR_OUT_OF_MEM;
+        goto cleanup;
+    }
+
+    for(uint32_t first = 0; first < frameCount && ret == SUCCESS; first += batchSize)
+    {
+        state.firstFrame = first;
+        state.endFrame = (frameCount - first < batchSize) ? frameCount : first + batchSize;
+        state.nextFrame = first;
+
+        // No point in having more workers than frames. The calling thread is always one of them.
+        uint32_t workers = (jobs < state.endFrame - first) ? jobs : state.endFrame - first;
+
+        if(runParallel(pool, lzxFindMatches, &state, workers) != SUCCESS)
+        {
+            ret = ERR_OUT_OF_MEM;
+            break;
+        }
+
+        ret = state.ret;
+
+        // Encoding carries state from frame to frame, so this part goes in order
+        for(uint32_t frame = first; frame < state.endFrame && ret == SUCCESS; frame++)
+        {
+            uint32_t start = frame * LZX_FRAME_SIZE;
+            uint32_t frameSize = (basefile->size - start < LZX_FRAME_SIZE) ? basefile->size - start : LZX_FRAME_SIZE;
+
+            ret = lzxEncodeFrame(&encoder, state.tokens[frame - first], state.tokenCounts[frame - first], frameSize, &symbols, &writer);
+
+            if(ret == ERR_DATA_OVERFLOW)
+            {
+                // Matches can cost more than the bytes they cover in pathological cases. Literals alone always fit.
+                for(uint32_t i = 0; i < frameSize; i++)
+                {
+                    literals[i].length = 0;
+                    literals[i].literal = basefile->data[start + i];
+                }
+
+                ret = lzxEncodeFrame(&encoder, literals, frameSize, frameSize, &symbols, &writer);
+            }
+
+            if(ret != SUCCESS)
+            { break; }
+
+            blockStarts[frame] = basefileFormat->normalCompDataSize;
+            ret = lzxAddBlock(basefileFormat, &capacity, writer.data, writer.size);
+        }
+    }
+
+    pthread_mutex_destroy(&(state.mutex));
+
+    if(ret == SUCCESS)
+    { lzxHashBlocks(basefileFormat, blockStarts, frameCount); }
+
+cleanup:
+
+    if(ret != SUCCESS)
+    {
+        uint8_t *compData = basefileFormat->normalCompData; // Avoid dereferencing unaligned pointer
+        nullAndFree((void **)&compData);
+        basefileFormat->normalCompData = NULL;
+    }
+
+    for(uint32_t i = 0; state.tokens != NULL && i < batchSize; i++)
+    { nullAndFree((void **) & (state.tokens[i])); }
+
+    nullAndFree((void **)&state.tokens);
+    nullAndFree((void **)&state.tokenCounts);
+    nullAndFree((void **)&blockStarts);
+    nullAndFree((void **)&literals);
+    nullAndFree((void **)&writer.data);
+    nullAndFree((void **)&symbols.main);
+    nullAndFree((void **)&symbols.lengthFooters);
+    nullAndFree((void **)&symbols.extraBits);
+    return ret;
+}
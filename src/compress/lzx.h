@@ -0,0 +1,67 @@
+// This file is part of SynthXEX, one component of the
+// OpenXeChain development toolchain
+//
+// Copyright (c) 2025 Aiden Isik
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "../common/common.h"
+#include "../common/crypto.h"
+#include "../common/datastorage.h"
+#include "../common/taskpool.h"
+
+#include <pthread.h>
+
+// LZX parameters. The window is the smallest LZX allows, which every XEX loader supports.
+#define LZX_WINDOW_SIZE           0x8000
+#define LZX_FRAME_SIZE            0x8000 // Output is produced in frames of this size, matches can't cross them
+#define LZX_NUM_POSITION_SLOTS    30     // For a 32KiB window
+#define LZX_MIN_MATCH             2
+#define LZX_MAX_MATCH             257
+#define LZX_MAX_DISTANCE          (LZX_WINDOW_SIZE - 3)
+#define LZX_NUM_CHARS             256
+#define LZX_NUM_PRIMARY_LENGTHS   7
+#define LZX_NUM_SECONDARY_LENGTHS 249
+#define LZX_MAIN_TREE_SIZE        (LZX_NUM_CHARS + (LZX_NUM_POSITION_SLOTS << 3))
+#define LZX_PRETREE_SIZE          20
+#define LZX_MAX_CODE_LENGTH       16
+#define LZX_MAX_PRETREE_LENGTH    15 // Pretree lengths are sent in 4 bits
+#define LZX_BLOCKTYPE_VERBATIM    1
+
+// Compressed frames (chunks) are prefixed with a 16 bit size in the XEX
+#define LZX_MAX_CHUNK_SIZE 0xFFFF
+
+// Match finder
+#define LZX_HASH_BITS    15
+#define LZX_HISTORY_SIZE (LZX_WINDOW_SIZE + LZX_FRAME_SIZE) // Everything a frame's matches can reach
+
+// How hard to look for matches
+#define LZX_LEVEL_FAST    0
+#define LZX_LEVEL_DEFAULT 1
+#define LZX_LEVEL_MAX     2
+
+// One literal (length == 0) or match found in a frame
+struct lzxToken
+{
+    uint16_t length;
+    uint16_t distance;
+    uint8_t literal;
+};
+
+// Compresses the basefile into the chain of hashed blocks XEX "normal" compression uses,
+// with the match finding for each frame spread over jobs threads (taken from pool if it isn't NULL)
+int lzxCompressBasefile(struct basefile *basefile, uint8_t level, uint32_t jobs, struct taskPool *pool,
+                        struct basefileFormat *basefileFormat);
@@ -0,0 +1,235 @@
+// This file is part of SynthXEX, one component of the
+// OpenXeChain development toolchain
+//
+// Copyright (c) 2025 Aiden Isik
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "batch.h"
+
+int addBatchEntry(struct batchEntry **entries, uint32_t *count, const char *pePath, const char *xexfilePath, uint32_t moduleFlags)
+{
+    struct batchEntry *newEntries = realloc(*entries, (*count + 1) * sizeof(struct batchEntry));
+
+    if(newEntries == NULL)
+    { return ERR_OUT_OF_MEM; }
+
+    *entries = newEntries;
+    struct batchEntry *entry = &(newEntries[*count]);
+    memset(entry, 0, sizeof(struct batchEntry));
+
+    entry->pePath = malloc(strlen(pePath) + 1);
+    entry->xexfilePath = malloc(strlen(xexfilePath) + 1);
+
+    if(entry->pePath == NULL || entry->xexfilePath == NULL)
+    {
+        nullAndFree((void **) & (entry->pePath));
+        nullAndFree((void **) & (entry->xexfilePath));
+        return ERR_OUT_OF_MEM;
+    }
+
+    strcpy(entry->pePath, pePath);
+    strcpy(entry->xexfilePath, xexfilePath);
+    entry->moduleFlags = moduleFlags;
+    (*count)++;
+    return SUCCESS;
+}
+
+// Splits off the next tab separated field of a line (fields are terminated in place)
+char *nextManifestField(char **pos, char *end)
+{
+    if(*pos >= end)
+    { return NULL; }
+
+    char *field = *pos;
+    char *tab = memchr(field, '\t', end - field);
+
+    if(tab == NULL)
+    {
+        *end = '\0';
+        *pos = end;
+    }
+    else
+    {
+        *tab = '\0';
+        *pos = tab + 1;
+    }
+
+    return field;
+}
+
+// A manifest has one entry per line: input PE path, a tab, output XEX path, and optionally another tab and a type
+// override (title, titledll, sysdll or dll). Empty lines and lines starting with '#' are skipped.
+// On ERR_INVALID_MANIFEST, badLine is set to the (1-based) line at fault.
+int readBatchManifest(const char *path, struct batchEntry **entries, uint32_t *count, uint32_t *badLine)
+{
+    *badLine = 0;
+
+    struct mappedFile manifest;
+    int ret = mapInputFile(path, &manifest);
+
+    if(ret != SUCCESS)
+    { return ret; }
+
+    // We terminate fields in place, so work on a copy with room for a final terminator
+    char *text = malloc(manifest.size + 1);
+
+    if(text == NULL)
+    {
+        freeMappedFileStruct(&manifest);
+        return ERR_OUT_OF_MEM;
+    }
+
+    if(manifest.size > 0)
+    { memcpy(text, manifest.data, manifest.size); }
+
+    text[manifest.size] = '\0';
+    char *textEnd = text + manifest.size;
+    freeMappedFileStruct(&manifest);
+
+    uint32_t lineNum = 0;
+
+    for(char *line = text; line < textEnd && ret == SUCCESS;)
+    {
+        lineNum++;
+
+        char *lineEnd = memchr(line, '\n', textEnd - line);
+
+        if(lineEnd == NULL)
+        { lineEnd = textEnd; }
+
+        char *next = lineEnd + 1;
+
+        // Manifests written on Windows
+        if(lineEnd > line && lineEnd[-1] == '\r')
+        { lineEnd--; }
+
+        *lineEnd = '\0';
+
+        if(lineEnd == line || line[0] == '#')
+        {
+            line = next;
+            continue;
+        }
+
+        char *pos = line;
+        char *pePath = nextManifestField(&pos, lineEnd);
+        char *xexfilePath = nextManifestField(&pos, lineEnd);
+        char *type = nextManifestField(&pos, lineEnd);
+        uint32_t moduleFlags = 0;
+
+        if(pePath == NULL || xexfilePath == NULL || pePath[0] == '\0' || xexfilePath[0] == '\0'
+                || pos < lineEnd || (type != NULL && !parseModuleType(type, &moduleFlags)))
+        {
+            *badLine = lineNum;
+            ret = ERR_INVALID_MANIFEST;
+            break;
+        }
+
+        ret = addBatchEntry(entries, count, pePath, xexfilePath, moduleFlags);
+        line = next;
+    }
+
+    nullAndFree((void **)&text);
+    return ret;
+}
+
+// Prints how an entry went. Each line goes out in one call, so entries finishing at once don't interleave.
+void reportBatchEntry(const struct batchEntry *entry)
+{
+    if(entry->ret == SUCCESS)
+    { printf("%s Built %s\n", SYNTHXEX_PRINT_STEM, entry->xexfilePath); }
+    else
+    {
+        const char *message = getErrorString(entry->ret);
+
+        if(message != NULL)
+        { fprintf(stderr, "%s ERROR: %s: %s Skipping.\n", SYNTHXEX_PRINT_STEM, entry->pePath, message); }
+        else
+        { fprintf(stderr, "%s ERROR: %s: Unknown error: %d. Skipping.\n", SYNTHXEX_PRINT_STEM, entry->pePath, entry->ret); }
+    }
+}
+
+void *convertBatchEntry(void *arg)
+{
+    struct batchEntry *entry = arg;
+    struct convertOptions options = *(entry->options);
+
+    if(entry->moduleFlags != 0)
+    { options.moduleFlags = entry->moduleFlags; }
+
+    entry->ret = convertPE(entry->pePath, entry->xexfilePath, &options);
+    reportBatchEntry(entry);
+    return NULL;
+}
+
+// Converts every entry, each as a task on a pool of options->jobs threads (counting the calling one).
+// Big modules split their page hashing and compression into further tasks on the same pool.
+// A failed entry doesn't stop the others. Returns how many failed.
+uint32_t runBatch(struct batchEntry *entries, uint32_t count, const struct convertOptions *options)
+{
+    struct convertOptions batchOptions = *options;
+    batchOptions.verbose = false;
+    batchOptions.batched = true;
+
+    struct taskPool pool;
+    struct taskGroup group;
+    bool havePool = (createTaskPool(&pool, options->jobs - 1, options->jobServer) == SUCCESS);
+
+    if(havePool && initTaskGroup(&group) != SUCCESS)
+    {
+        destroyTaskPool(&pool);
+        havePool = false;
+    }
+
+    batchOptions.pool = havePool ? &pool : NULL;
+
+    for(uint32_t i = 0; i < count; i++)
+    {
+        entries[i].options = &batchOptions;
+
+        // Without a pool, or if the task can't be queued, just do it here
+        if(!havePool || submitTask(&pool, &group, convertBatchEntry, &(entries[i])) != SUCCESS)
+        { convertBatchEntry(&(entries[i])); }
+    }
+
+    if(havePool)
+    {
+        waitTaskGroup(&pool, &group);
+        destroyTaskGroup(&group);
+        destroyTaskPool(&pool);
+    }
+
+    uint32_t failed = 0;
+
+    for(uint32_t i = 0; i < count; i++)
+        if(entries[i].ret != SUCCESS)
+        { failed++; }
+
+    return failed;
+}
+
+void freeBatchEntries(struct batchEntry **entries, uint32_t count)
+{
+    if(*entries == NULL)
+    { return; }
+
+    for(uint32_t i = 0; i < count; i++)
+    {
+        nullAndFree((void **) & ((*entries)[i].pePath));
+        nullAndFree((void **) & ((*entries)[i].xexfilePath));
+    }
+
+    nullAndFree((void **)entries);
+}
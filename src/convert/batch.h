@@ -0,0 +1,39 @@
+// This file is part of SynthXEX, one component of the
+// OpenXeChain development toolchain
+//
+// Copyright (c) 2025 Aiden Isik
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "../common/common.h"
+#include "../common/taskpool.h"
+#include "convert.h"
+
+// One PE to convert as part of a batch
+struct batchEntry
+{
+    char *pePath;
+    char *xexfilePath;
+    uint32_t moduleFlags; // Type override for this entry only, 0 to use the batch's
+    int ret;
+    const struct convertOptions *options;
+};
+
+int addBatchEntry(struct batchEntry **entries, uint32_t *count, const char *pePath, const char *xexfilePath, uint32_t moduleFlags);
+int readBatchManifest(const char *path, struct batchEntry **entries, uint32_t *count, uint32_t *badLine);
+void reportBatchEntry(const struct batchEntry *entry);
+uint32_t runBatch(struct batchEntry *entries, uint32_t count, const struct convertOptions *options);
+void freeBatchEntries(struct batchEntry **entries, uint32_t count);
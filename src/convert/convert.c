@@ -0,0 +1,538 @@
+// This file is part of SynthXEX, one component of the
+// OpenXeChain development toolchain
+//
+// Copyright (c) 2025 Aiden Isik
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "convert.h"
+
+// Generated at build time, see cmake/buildid.cmake. Only this file uses it, so only this file rebuilds when it changes.
+#include "buildid.h"
+
+const char *getErrorString(int ret)
+{
+    switch(ret)
+    {
+        case ERR_UNKNOWN_DATA_REQUEST:
+            return "Internal error getting data from PE file. THIS IS A BUG, please report it.";
+
+        case ERR_FILE_OPEN:
+            return "Failed to open or create file.";
+
+        case ERR_FILE_READ:
+            return "Failed to read data from PE file.";
+
+        case ERR_FILE_WRITE:
+            return "Failed to write data to file.";
+
+        case ERR_OUT_OF_MEM:
+            return "Out of memory.";
+
+        case ERR_MISSING_SECTION_FLAG:
+            return "R/W/X flag missing from PE section.";
+
+        case ERR_UNSUPPORTED_STRUCTURE:
+            return "Encountered an unsupported data structure in PE.";
+
+        case ERR_INVALID_RVA_OR_OFFSET:
+            return "Invalid RVA or offset found.";
+
+        case ERR_INVALID_IMPORT_NAME:
+            return "Invalid import name found.";
+
+        case ERR_DATA_OVERFLOW:
+            return "Data overflow.";
+
+        case ERR_INVALID_PE:
+            return "Input PE is not Xbox 360 PE.";
+
+        case ERR_PE_OPEN:
+            return "Failed to open PE file. Do you have read permissions?";
+
+        case ERR_XEX_CREATE:
+            return "Failed to create XEX file. Do you have write permissions?";
+
+        case ERR_INVALID_MANIFEST:
+            return "Invalid batch manifest.";
+
+        case ERR_INVALID_OPTION:
+            return "Invalid option.";
+
+        case ERR_SOCKET:
+            return "Failed to set up or use the server socket.";
+
+        case ERR_PROTOCOL:
+            return "Malformed request or reply from the other end of the server socket.";
+
+        case ERR_INVALID_XEX:
+            return "Input XEX is invalid, or doesn't have the header being edited.";
+
+        case ERR_INVALID_PATCH:
+            return "Delta patch is invalid or corrupt.";
+
+        case ERR_PATCH_MISMATCH:
+            return "Delta patch was made from a different XEX than the one being patched.";
+
+        case ERR_PATCH_UNDIFFABLE:
+            return "Can't make a useful delta patch to an LZX compressed or encrypted XEX (every byte differs), build it with -z none or basic and without -e.";
+
+        default:
+            return NULL;
+    }
+}
+
+void handleError(int ret)
+{
+    const char *message = getErrorString(ret);
+
+    if(message != NULL)
+    { fprintf(stderr, "%s ERROR: %s Aborting.\n", SYNTHXEX_PRINT_STEM, message); }
+    else
+    { fprintf(stderr, "%s ERROR: Unknown error: %d. Aborting.\n", SYNTHXEX_PRINT_STEM, ret); }
+}
+
+// Turns a type override name into module flags. Returns false if the name isn't known.
+bool parseModuleType(const char *name, uint32_t *moduleFlags)
+{
+    if(strcmp(name, "title") == 0)
+    { *moduleFlags = XEX_MOD_FLAG_TITLE; }
+    else if(strcmp(name, "titledll") == 0)
+    { *moduleFlags = XEX_MOD_FLAG_TITLE | XEX_MOD_FLAG_DLL; }
+    else if(strcmp(name, "sysdll") == 0)
+    { *moduleFlags = XEX_MOD_FLAG_EXPORTS | XEX_MOD_FLAG_DLL; }
+    else if(strcmp(name, "dll") == 0)
+    { *moduleFlags = XEX_MOD_FLAG_DLL; }
+    else
+    { return false; }
+
+    return true;
+}
+
+// Turns a compression mode name into a COMP_MODE_* value. Returns false if the name isn't known.
+bool parseCompMode(const char *name, uint8_t *compMode)
+{
+    if(strcmp(name, "none") == 0)
+    { *compMode = COMP_MODE_NONE; }
+    else if(strcmp(name, "basic") == 0)
+    { *compMode = COMP_MODE_BASIC; }
+    else if(strcmp(name, "fast") == 0)
+    { *compMode = COMP_MODE_FAST; }
+    else if(strcmp(name, "default") == 0)
+    { *compMode = COMP_MODE_DEFAULT; }
+    else if(strcmp(name, "max") == 0)
+    { *compMode = COMP_MODE_MAX; }
+    else
+    { return false; }
+
+    return true;
+}
+
+void printStep(const struct convertOptions *options, const char *message)
+{
+    if(options->verbose)
+    { printf("%s %s\n", SYNTHXEX_PRINT_STEM, message); }
+}
+
+// Sets up everything one conversion needs. Contexts share nothing, so any number can be used at once.
+int initConvertContext(struct convertContext *context, const struct convertOptions *options)
+{
+    memset(context, 0, sizeof(struct convertContext));
+    context->options = options;
+    context->offsets = calloc(1, sizeof(struct offsets));
+    context->xexHeader = calloc(1, sizeof(struct xexHeader));
+    context->secInfoHeader = calloc(1, sizeof(struct secInfoHeader));
+    context->peData = calloc(1, sizeof(struct peData));
+    context->optHeaderEntries = calloc(1, sizeof(struct optHeaderEntries));
+    context->optHeaders = calloc(1, sizeof(struct optHeaders));
+
+    if(context->offsets == NULL || context->xexHeader == NULL || context->secInfoHeader == NULL ||
+            context->peData == NULL || context->optHeaderEntries == NULL || context->optHeaders == NULL)
+    {
+        freeConvertContext(context);
+        context->ret = ERR_OUT_OF_MEM;
+        return ERR_OUT_OF_MEM;
+    }
+
+    // populateheaders only detects the type if it hasn't been overridden
+    context->xexHeader->moduleFlags = options->moduleFlags;
+    return SUCCESS;
+}
+
+void freeConvertContext(struct convertContext *context)
+{
+    if(context->xex != NULL)
+    {
+        fclose(context->xex);
+        context->xex = NULL;
+    }
+
+    freeMappedFileStruct(&(context->pe));
+    freeMappedFileStruct(&(context->existingXex));
+    freeBasefileStruct(&(context->basefile));
+    freeAllMainStructs(&(context->offsets), &(context->xexHeader), &(context->secInfoHeader), &(context->peData),
+                       &(context->optHeaderEntries), &(context->optHeaders));
+
+    if(context->hashCache != NULL)
+    {
+        freePageHashCache(context->hashCache);
+        nullAndFree((void **) & (context->hashCache));
+    }
+}
+
+// Everything besides the input that decides what the XEX comes out as, for keying the output cache.
+// Options which change the output have to be added here, or the cache would hand back XEXes built without them.
+void describeOutputSettings(const struct convertOptions *options, char *settings, size_t size)
+{
+    snprintf(settings, size, "%s build=%s type=%08x skipcheck=%u encrypt=%u comp=%u coalesce=%u", SYNTHXEX_VERSION_STRING, SYNTHXEX_BUILD_ID,
+             options->moduleFlags, options->skipMachineCheck, options->encrypt, options->compMode, options->maxPageRun);
+}
+
+// Opens the XEX at path to be updated in place, keeping a view of what it holds now to compare against.
+// Leaves context->xex NULL if that can't be done, and it's written from scratch instead: when it doesn't
+// exist yet, or it has other hard links (a cache entry, say) which would change along with it.
+void openXEXForUpdate(struct convertContext *context, const char *path)
+{
+    struct stat xexStat;
+
+    if(stat(path, &xexStat) != 0 || xexStat.st_nlink > 1 || xexStat.st_size == 0)
+    {
+        remove(path);
+        return;
+    }
+
+    if(mapInputFile(path, &(context->existingXex)) != SUCCESS)
+    { return; }
+
+    context->xex = fopen(path, "rb+");
+
+    if(context->xex == NULL)
+    { freeMappedFileStruct(&(context->existingXex)); }
+}
+
+// Converts one PE into a XEX, given paths. The result is also left in context->ret.
+int runConversion(struct convertContext *context, const char *pePath, const char *xexfilePath)
+{
+    const struct convertOptions *options = context->options;
+    char *cacheEntryPath = NULL;
+    char *hashCachePath = NULL;
+    int ret = mapInputFile(pePath, &(context->pe));
+
+    if(ret != SUCCESS)
+    {
+        ret = (ret == ERR_FILE_OPEN) ? ERR_PE_OPEN : ret;
+        goto done;
+    }
+
+    if(options->cacheDir != NULL)
+    {
+        char settings[256];
+        describeOutputSettings(options, settings, sizeof(settings));
+        ret = getCachedOutputPath(options->cacheDir, context->pe.data, context->pe.size, settings, &cacheEntryPath);
+
+        if(ret != SUCCESS)
+        { goto done; }
+
+        // Anything wrong with the cache just means converting as usual
+        if(fetchCachedOutput(cacheEntryPath, xexfilePath, options->cacheLink) == SUCCESS)
+        {
+            printStep(options, "Found XEX in cache!");
+            goto done;
+        }
+
+    }
+
+    // The output may be a hard link to a cache entry from an earlier build (whether or not this one uses the
+    // cache), which mustn't be written through
+    if(options->update)
+    { openXEXForUpdate(context, xexfilePath); }
+    else
+    { unshareOutput(xexfilePath); }
+
+    if(context->xex == NULL)
+    { context->xex = fopen(xexfilePath, "wb+"); }
+
+    if(context->xex == NULL)
+    {
+        ret = ERR_XEX_CREATE;
+        goto done;
+    }
+
+    if(options->incremental || options->update)
+    {
+        hashCachePath = malloc(strlen(xexfilePath) + strlen(HASH_CACHE_SUFFIX) + 1);
+        context->hashCache = malloc(sizeof(struct pageHashCache));
+
+        if(hashCachePath == NULL || context->hashCache == NULL)
+        {
+            nullAndFree((void **) & (context->hashCache));
+            ret = ERR_OUT_OF_MEM;
+            goto done;
+        }
+
+        strcpy(hashCachePath, xexfilePath);
+        strcat(hashCachePath, HASH_CACHE_SUFFIX);
+        ret = loadPageHashCache(hashCachePath, context->hashCache);
+
+        if(ret != SUCCESS)
+        { goto done; }
+    }
+
+    ret = runOpenedConversion(context);
+
+    // Updated in place, so anything left over from a bigger XEX has to go
+    if(ret == SUCCESS && context->existingXex.data != NULL)
+    {
+        ret = setFileSize(context->xex, (uint64_t)context->offsets->basefile
+                          + getStoredBasefileSize(&(context->optHeaders->basefileFormat)));
+    }
+
+    if(fclose(context->xex) != 0 && ret == SUCCESS)
+    { ret = ERR_FILE_WRITE; }
+
+    context->xex = NULL;
+
+    // A sidecar that can't be written only costs a full rehash next time, the XEX is fine either way.
+    // Likewise for the cache.
+    if(ret == SUCCESS && context->hashCache != NULL)
+    { savePageHashCache(hashCachePath, context->hashCache); }
+
+    if(ret == SUCCESS && cacheEntryPath != NULL)
+    { storeCachedOutput(cacheEntryPath, xexfilePath); }
+
+done:
+    nullAndFree((void **)&cacheEntryPath);
+    nullAndFree((void **)&hashCachePath);
+    context->ret = ret;
+    return ret;
+}
+
+// Converts context->pe into context->xex, which the caller has set up. The XEX is left open (and flushed).
+// The result is also left in context->ret.
+int runOpenedConversion(struct convertContext *context)
+{
+    const struct convertOptions *options = context->options;
+    int ret = SUCCESS;
+
+    // The headers are parsed once, everything after this (including validation) works on peData
+    printStep(options, "Retrieving header data from PE...");
+    ret = getHdrData(&(context->pe), context->peData, 0);
+
+    if(ret != SUCCESS)
+    { goto done; }
+
+    printStep(options, "Got header data from PE!");
+    printStep(options, "Validating PE file...");
+    ret = validatePE(context->peData, options->skipMachineCheck);
+
+    if(ret != SUCCESS)
+    { goto done; }
+
+    printStep(options, "PE valid!");
+
+    printStep(options, "Retrieving import data from PE...");
+    ret = getImports(&(context->pe), context->peData);
+
+    if(ret != SUCCESS)
+    { goto done; }
+
+    printStep(options, "Got import data from PE!");
+
+    printStep(options, "Creating basefile from PE...");
+
+    // Map the PE into the basefile (RVAs become offsets)
+    ret = mapPEToBasefile(&(context->pe), &(context->basefile), context->peData, options->memLimit);
+    freeMappedFileStruct(&(context->pe));
+
+    if(ret != SUCCESS)
+    { goto done; }
+
+    printStep(options, "Created basefile!");
+
+    // Only big modules are worth spreading over the pool, small ones are a task of their own already
+    uint32_t jobs = options->jobs;
+
+    if(options->pool != NULL && options->batched && context->basefile.size < CONVERT_SPLIT_THRESHOLD)
+    { jobs = 1; }
+
+    // Setting final XEX data structs
+    printStep(options, "Building security header...");
+    ret = setSecInfoHeader(context->secInfoHeader, context->peData);
+
+    if(ret == SUCCESS)
+    { ret = setPageDescriptorRuns(context->secInfoHeader, context->peData, options->maxPageRun); }
+
+    if(ret != SUCCESS)
+    { goto done; }
+
+    printStep(options, "Building optional headers...");
+    ret = setOptHeaders(context->secInfoHeader, context->peData, context->optHeaderEntries, context->optHeaders, &(context->basefile),
+                        options->compMode, options->encrypt, jobs, options->pool);
+
+    if(ret != SUCCESS)
+    { goto done; }
+
+    printStep(options, "Building XEX header...");
+    ret = setXEXHeader(context->xexHeader, context->optHeaderEntries, context->peData);
+
+    if(ret != SUCCESS)
+    { goto done; }
+
+    // Done with this now
+    freePeImportInfoStruct(&(context->peData->peImportInfo));
+
+    // Setting data positions
+    printStep(options, "Aligning data...");
+    ret = placeStructs(context->offsets, context->xexHeader, context->optHeaderEntries, context->secInfoHeader, context->optHeaders);
+
+    if(ret != SUCCESS)
+    { goto done; }
+
+    // The page hashes are only needed when writing, so the basefile is hashed and written in the same pass
+    printStep(options, "Setting page descriptors and writing basefile...");
+    ret = setPageDescriptors(&(context->basefile), context->peData, context->secInfoHeader, &(context->optHeaders->basefileFormat),
+                             context->offsets, context->xex, jobs, options->pool, context->hashCache,
+                             (context->existingXex.data != NULL) ? &(context->existingXex) : NULL);
+
+    if(ret != SUCCESS)
+    { goto done; }
+
+    // The basefile is in the XEX now, so we're done with it
+    freeBasefileStruct(&(context->basefile));
+
+    // Write out the XEX headers, along with their SHA1
+    printStep(options, "Writing XEX headers...");
+    ret = writeXEX(context->xexHeader, context->optHeaderEntries, context->secInfoHeader, context->optHeaders, context->offsets, context->xex);
+
+    if(ret == SUCCESS && fflush(context->xex) != 0)
+    { ret = ERR_FILE_WRITE; }
+
+done:
+    context->ret = ret;
+    return ret;
+}
+
+int convertPE(const char *pePath, const char *xexfilePath, const struct convertOptions *options)
+{
+    // Under a jobserver, the extra threads have to wait their turn for tokens, which the pool's workers do
+    struct convertOptions poolOptions = *options;
+    struct taskPool pool;
+    bool ownPool = (options->pool == NULL && options->jobServer != NULL && options->jobs > 1
+                    && createTaskPool(&pool, options->jobs - 1, options->jobServer) == SUCCESS);
+
+    if(ownPool)
+    { poolOptions.pool = &pool; }
+
+    struct convertContext context;
+    int ret = initConvertContext(&context, &poolOptions);
+
+    if(ret == SUCCESS)
+    { ret = runConversion(&context, pePath, xexfilePath); }
+
+    freeConvertContext(&context);
+
+    if(ownPool)
+    { destroyTaskPool(&pool); }
+
+    return ret;
+}
+
+// Lays out the XEX converting the PE at pePath with options would give, running only as far as placing the
+// structs. Nothing is hashed or written, and the image is only read for basic compression, which has to find
+// the runs of zeroes it leaves out.
+int planConversion(const char *pePath, const struct convertOptions *options, struct xexPlan *plan)
+{
+    memset(plan, 0, sizeof(struct xexPlan));
+
+    struct convertContext context;
+    int ret = initConvertContext(&context, options);
+
+    if(ret != SUCCESS)
+    { return ret; }
+
+    ret = mapInputFile(pePath, &(context.pe));
+
+    if(ret != SUCCESS)
+    {
+        ret = (ret == ERR_FILE_OPEN) ? ERR_PE_OPEN : ret;
+        goto done;
+    }
+
+    ret = getHdrData(&(context.pe), context.peData, 0);
+
+    if(ret == SUCCESS)
+    { ret = validatePE(context.peData, options->skipMachineCheck); }
+
+    if(ret == SUCCESS)
+    { ret = getImports(&(context.pe), context.peData); }
+
+    if(ret != SUCCESS)
+    { goto done; }
+
+    // Without compression only the image size matters, so the basefile needn't exist. Normal compression is
+    // laid out the same way, it's format header is always the same size (but the data can't be known).
+    uint8_t compMode = COMP_MODE_NONE;
+
+    if(options->compMode == COMP_MODE_BASIC)
+    {
+        ret = mapPEToBasefile(&(context.pe), &(context.basefile), context.peData, options->memLimit);
+        compMode = COMP_MODE_BASIC;
+    }
+    else
+    {
+        ret = getBasefileSize(context.peData, &(context.basefile.size));
+        context.peData->size = context.basefile.size;
+    }
+
+    if(ret == SUCCESS)
+    { ret = setSecInfoHeader(context.secInfoHeader, context.peData); }
+
+    if(ret == SUCCESS)
+    { ret = setPageDescriptorRuns(context.secInfoHeader, context.peData, options->maxPageRun); }
+
+    // Encryption doesn't change any sizes
+    if(ret == SUCCESS)
+    {
+        ret = setOptHeaders(context.secInfoHeader, context.peData, context.optHeaderEntries, context.optHeaders, &(context.basefile),
+                            compMode, false, 1, NULL);
+    }
+
+    if(ret == SUCCESS && options->compMode >= COMP_MODE_FAST)
+    { context.optHeaders->basefileFormat.size = BASEFILE_FORMAT_NORMAL_SIZE; }
+
+    if(ret == SUCCESS)
+    { ret = setXEXHeader(context.xexHeader, context.optHeaderEntries, context.peData); }
+
+    if(ret == SUCCESS)
+    { ret = placeStructs(context.offsets, context.xexHeader, context.optHeaderEntries, context.secInfoHeader, context.optHeaders); }
+
+    if(ret != SUCCESS)
+    { goto done; }
+
+    plan->headerSize = context.offsets->basefile;
+    plan->pageSize = context.peData->pageSize;
+    plan->pageCount = context.secInfoHeader->peSize / context.peData->pageSize;
+    plan->pageDescCount = context.secInfoHeader->pageDescCount;
+    plan->basefileSizeKnown = (options->compMode < COMP_MODE_FAST);
+
+    if(plan->basefileSizeKnown)
+    {
+        plan->basefileSize = getStoredBasefileSize(&(context.optHeaders->basefileFormat));
+        plan->totalSize = plan->headerSize + plan->basefileSize;
+    }
+
+done:
+    freeConvertContext(&context);
+    return ret;
+}
@@ -0,0 +1,100 @@
+// This file is part of SynthXEX, one component of the
+// OpenXeChain development toolchain
+//
+// Copyright (c) 2025 Aiden Isik
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "../common/common.h"
+#include "../common/datastorage.h"
+#include "../common/taskpool.h"
+#include "../pemapper/pemapper.h"
+#include "../getdata/gethdrdata.h"
+#include "../getdata/getimports.h"
+#include "../setdata/populateheaders.h"
+#include "../setdata/pagedescriptors.h"
+#include "../setdata/optheaders.h"
+#include "../placer/placer.h"
+#include "../write/writexex.h"
+#include "../cache/hashcache.h"
+#include "../cache/outputcache.h"
+
+// Basefiles smaller than this are converted by one thread in a batch. Splitting them up
+// costs more than it saves, there's other modules to keep the pool busy with instead.
+#define CONVERT_SPLIT_THRESHOLD (4 * 1024 * 1024)
+
+// Everything about how one PE is turned into a XEX
+struct convertOptions
+{
+    uint32_t moduleFlags; // 0 to detect automatically
+    bool skipMachineCheck;
+    bool encrypt;
+    bool verbose; // Print each step as it's done
+    uint8_t compMode;
+    uint32_t maxPageRun;
+    bool incremental; // Keep page hashes in a sidecar next to the XEX, and reuse them from the last build
+    const char *cacheDir; // Reuse whole XEXes built from the same input and settings (see describeOutputSettings)
+    bool cacheLink; // Hard link XEXes out of the cache rather than copying them
+    bool update; // Rewrite only what changed in an existing XEX (keeping a hash sidecar as with incremental)
+    uint32_t jobs;
+    uint64_t memLimit;
+    struct taskPool *pool; // Set when converting as part of a batch, or under a jobserver
+    bool batched; // Other conversions share the pool
+    struct jobServer *jobServer; // Make's, if we're part of a parallel build
+};
+
+// Everything one conversion works on. Nothing is kept anywhere else, so conversions with
+// separate contexts can run concurrently.
+struct convertContext
+{
+    const struct convertOptions *options;
+    struct mappedFile pe; // The input, all reads go through this
+    struct basefile basefile;
+    FILE *xex;
+    struct offsets *offsets;
+    struct xexHeader *xexHeader;
+    struct secInfoHeader *secInfoHeader;
+    struct peData *peData;
+    struct optHeaderEntries *optHeaderEntries;
+    struct optHeaders *optHeaders;
+    struct pageHashCache *hashCache; // Only for incremental builds
+    struct mappedFile existingXex; // What's being updated, when updating in place
+    int ret; // Result of the last conversion
+};
+
+// Where everything in a XEX will be, worked out without hashing or writing anything (see planConversion).
+// Sizes are in bytes, ready to preallocate the output with.
+struct xexPlan
+{
+    uint32_t headerSize; // Everything before the basefile, so also where it starts
+    uint32_t pageSize;
+    uint32_t pageCount;
+    uint32_t pageDescCount;
+    bool basefileSizeKnown; // Not with normal compression, that takes compressing the image
+    uint64_t basefileSize; // As stored
+    uint64_t totalSize;
+};
+
+const char *getErrorString(int ret);
+void handleError(int ret);
+bool parseModuleType(const char *name, uint32_t *moduleFlags);
+bool parseCompMode(const char *name, uint8_t *compMode);
+int initConvertContext(struct convertContext *context, const struct convertOptions *options);
+void freeConvertContext(struct convertContext *context);
+int runConversion(struct convertContext *context, const char *pePath, const char *xexfilePath);
+int runOpenedConversion(struct convertContext *context);
+int convertPE(const char *pePath, const char *xexfilePath, const struct convertOptions *options);
+int planConversion(const char *pePath, const struct convertOptions *options, struct xexPlan *plan);
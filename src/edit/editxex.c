@@ -0,0 +1,180 @@
+// This file is part of SynthXEX, one component of the
+// OpenXeChain development toolchain
+//
+// Copyright (c) 2025 Aiden Isik
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "editxex.h"
+
+// Applies edits to the headers (everything before the basefile, headerSize bytes of it) and rehashes them.
+// The header layout was written by SynthXEX or something like it, but it's still checked before being trusted.
+int applyXEXEdits(uint8_t *headers, uint32_t headerSize, const struct xexEdits *edits)
+{
+    uint32_t optHeaderCount = get32BitBE(headers + 0x14);
+    struct offsets offsets;
+    memset(&offsets, 0, sizeof(offsets));
+    offsets.secInfoHeader = get32BitBE(headers + 0x10);
+    offsets.basefile = headerSize;
+
+    if(memcmp(headers, "XEX2", 4) != 0 || offsets.secInfoHeader < sizeof(struct xexHeader)
+            || offsets.secInfoHeader > headerSize || headerSize - offsets.secInfoHeader < SEC_INFO_MIN_SIZE
+            || optHeaderCount > (offsets.secInfoHeader - sizeof(struct xexHeader)) / sizeof(struct optHeaderEntry))
+    { return ERR_INVALID_XEX; }
+
+    if(edits->moduleFlags != 0)
+    { put32BitBE(headers + 0x04, edits->moduleFlags); }
+
+    if(edits->setSysFlags)
+    {
+        // Small values like the flags live right in the optional header entry
+        uint8_t *entry = NULL;
+
+        for(uint32_t i = 0; i < optHeaderCount && entry == NULL; i++)
+            if(get32BitBE(headers + sizeof(struct xexHeader) + i * sizeof(struct optHeaderEntry)) == XEX_OPT_ID_SYS_FLAGS)
+            { entry = headers + sizeof(struct xexHeader) + i * sizeof(struct optHeaderEntry); }
+
+        // Adding one would move everything after it, that's a job for a full conversion
+        if(entry == NULL)
+        { return ERR_INVALID_XEX; }
+
+        put32BitBE(entry + 0x4, edits->sysFlags);
+    }
+
+    uint8_t *secInfo = headers + offsets.secInfoHeader;
+
+    if(edits->setGameRegion)
+    {
+        uint32_t imageFlags = get32BitBE(secInfo + SEC_INFO_IMAGE_FLAGS_OFFSET);
+
+        if(edits->gameRegion == XEX_REG_FLAG_REGION_FREE)
+        { imageFlags |= XEX_IMG_FLAG_REGION_FREE; }
+        else
+        { imageFlags &= ~XEX_IMG_FLAG_REGION_FREE; }
+
+        put32BitBE(secInfo + SEC_INFO_IMAGE_FLAGS_OFFSET, imageFlags);
+        put32BitBE(secInfo + SEC_INFO_GAME_REGION_OFFSET, edits->gameRegion);
+    }
+
+    if(edits->setMediaTypes)
+    { put32BitBE(secInfo + SEC_INFO_MEDIA_TYPES_OFFSET, edits->mediaTypes); }
+
+    setHeaderSha1(headers, &offsets);
+    return SUCCESS;
+}
+
+// Edits the XEX at path in place. Only the headers are mapped and touched, however big the basefile is.
+int editXEX(const char *path, const struct xexEdits *edits)
+{
+    // A hard link (out of a cache, say) gets a file of it's own first, so the edit doesn't reach the other names
+    struct stat xexStat;
+
+    if(stat(path, &xexStat) == 0 && xexStat.st_nlink > 1)
+    {
+        int ret = copyFileAtomically(path, path);
+
+        if(ret != SUCCESS)
+        { return ret; }
+    }
+
+    FILE *xex = fopen(path, "rb+");
+
+    if(xex == NULL)
+    { return ERR_FILE_OPEN; }
+
+    uint8_t xexHeader[sizeof(struct xexHeader)];
+
+    if(fread(xexHeader, sizeof(uint8_t), sizeof(xexHeader), xex) != sizeof(xexHeader))
+    {
+        fclose(xex);
+        return ERR_INVALID_XEX;
+    }
+
+    // The basefile starts where the headers end
+    uint32_t headerSize = get32BitBE(xexHeader + 0x08);
+
+    if(fseek(xex, 0, SEEK_END) != 0 || ftell(xex) < (long)headerSize || headerSize < sizeof(struct xexHeader))
+    {
+        fclose(xex);
+        return ERR_INVALID_XEX;
+    }
+
+    int ret;
+
+#ifndef _WIN32
+    uint8_t *headers = mmap(NULL, headerSize, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(xex), 0);
+
+    if(headers == MAP_FAILED)
+    {
+        fclose(xex);
+        return ERR_FILE_READ;
+    }
+
+    ret = applyXEXEdits(headers, headerSize, edits);
+
+    if(msync(headers, headerSize, MS_SYNC) != 0 && ret == SUCCESS)
+    { ret = ERR_FILE_WRITE; }
+
+    munmap(headers, headerSize);
+#else
+    // No mmap here, the headers are small enough to just read and write back
+    uint8_t *headers = malloc(headerSize);
+
+    if(headers == NULL)
+    {
+        fclose(xex);
+        return ERR_OUT_OF_MEM;
+    }
+
+    if(fseek(xex, 0, SEEK_SET) != 0 || fread(headers, sizeof(uint8_t), headerSize, xex) != headerSize)
+    { ret = ERR_FILE_READ; }
+    else
+    { ret = applyXEXEdits(headers, headerSize, edits); }
+
+    if(ret == SUCCESS)
+    { ret = writeAtOffset(xex, headers, headerSize, 0); }
+
+    nullAndFree((void **)&headers);
+#endif
+
+    if(fclose(xex) != 0 && ret == SUCCESS)
+    { ret = ERR_FILE_WRITE; }
+
+    return ret;
+}
+
+// Writes a variant of the XEX at xexfilePath. The basefile and page descriptors are the same, so it's a copy
+// (a reflink where the filesystem has them) with the headers edited, rather than a conversion of it's own.
+int writeXEXVariant(const char *xexfilePath, const struct xexVariant *variant)
+{
+    char *tempPath = NULL;
+    int ret = getTempPath(variant->xexfilePath, &tempPath);
+
+    if(ret != SUCCESS)
+    { return ret; }
+
+    ret = copyFileAtomically(xexfilePath, tempPath);
+
+    if(ret == SUCCESS)
+    { ret = editXEX(tempPath, &(variant->edits)); }
+
+    // Only put in place once edited, nobody should see the variant with the wrong headers
+    if(ret == SUCCESS)
+    { ret = replaceFile(tempPath, variant->xexfilePath); }
+    else
+    { remove(tempPath); }
+
+    nullAndFree((void **)&tempPath);
+    return ret;
+}
@@ -0,0 +1,59 @@
+// This file is part of SynthXEX, one component of the
+// OpenXeChain development toolchain
+//
+// Copyright (c) 2025 Aiden Isik
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "../common/common.h"
+#include "../common/datastorage.h"
+#include "../write/headerhash.h"
+#include "../cache/outputcache.h"
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/stat.h>
+#endif
+
+// Where the fields edited live, relative to the start of the security info
+#define SEC_INFO_IMAGE_FLAGS_OFFSET 0x10C
+#define SEC_INFO_HEADERS_HASH_OFFSET 0x164
+#define SEC_INFO_GAME_REGION_OFFSET 0x178
+#define SEC_INFO_MEDIA_TYPES_OFFSET 0x17C
+#define SEC_INFO_MIN_SIZE 0x180
+
+// What to change in an existing XEX. None of it affects the basefile or page descriptors,
+// so only the headers (and their hash) are rewritten.
+struct xexEdits
+{
+    uint32_t moduleFlags; // 0 to leave as is
+    bool setSysFlags;
+    uint32_t sysFlags;
+    bool setGameRegion;
+    uint32_t gameRegion;
+    bool setMediaTypes;
+    uint32_t mediaTypes;
+};
+
+// Another XEX from the same PE, differing only in it's headers (see --variant)
+struct xexVariant
+{
+    const char *xexfilePath;
+    struct xexEdits edits;
+};
+
+int editXEX(const char *path, const struct xexEdits *edits);
+int writeXEXVariant(const char *xexfilePath, const struct xexVariant *variant);
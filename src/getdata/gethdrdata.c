@@ -18,263 +18,144 @@
 
 #include "gethdrdata.h"
 
-// Validate PE. This isn't thorough, but it's enough to catch any non-PE/360 files.
-// I was considering merging this with getHdrData and mapPEToBasefile as we're
-// basically reading the same data twice, but I think it's beneficial to have a
-// dedicated place where we validate the input.
-bool validatePE(FILE *pe, bool skipMachineCheck) // True if valid, else false
+// Offsets of the fields we use, relative to the start of the PE (COFF) header
+#define PE_HDR_MACHINE              0x04
+#define PE_HDR_SECTION_COUNT        0x06
+#define PE_HDR_SIZE_OF_OPT_HDR      0x14
+#define PE_HDR_CHARACTERISTICS      0x16
+#define PE_HDR_ENTRY_POINT          0x28
+#define PE_HDR_BASE_ADDR            0x34
+#define PE_HDR_PAGE_SIZE            0x38
+#define PE_HDR_SUBSYSTEM            0x5C
+#define PE_HDR_EXPORT_TABLE_RVA     0x78
+#define PE_HDR_IMPORT_TABLE_RVA     0x80
+#define PE_HDR_TLS_ADDR             0xC0
+#define PE_HDR_TLS_SIZE             0xC4
+
+// 0x18 == size of COFF header, 0xC8 == end of the TLS data directory (the last field we read)
+#define PE_COFF_HDR_SIZE    0x18
+#define PE_MIN_OPT_HDR_SIZE (0xC8 - PE_COFF_HDR_SIZE)
+
+// Parse the DOS/COFF/optional headers and section table into peData in one pass over
+// the header region. Nothing is checked here beyond what is required to locate the
+// headers safely, validatePE then works on the parsed result.
+int getHdrData(struct mappedFile *pe, struct peData *peData, uint8_t flags)
 {
-    // Check if we have at least the size of a DOS header, so we don't overrun the PE
-    fseek(pe, 0, SEEK_END);
-    size_t finalOffset = ftell(pe);
-
-    if(finalOffset < 0x3C + 0x4)
-    { return false; }
-
-    // Check magic
-    fseek(pe, 0, SEEK_SET);
-    uint16_t magic = get16BitFromPE(pe);
-
-    if(magic != 0x5A4D || errno != SUCCESS) // PE magic
-    { return false; }
-
-    // Check if pointer to PE header is valid
-    fseek(pe, 0x3C, SEEK_SET);
-    size_t peHeaderOffset = get32BitFromPE(pe);
-
-    if(finalOffset < peHeaderOffset || errno != SUCCESS)
-    { return false; }
-
-    // Check if the file is big enough to get size of optional header, and therefore size of whole PE header
-    if(finalOffset < 0x14 + 0x2)
-    { return false; }
-
-    // Check section count
-    fseek(pe, peHeaderOffset + 0x6, SEEK_SET);
-    uint16_t sectionCount = get16BitFromPE(pe);
-
-    if(sectionCount == 0 || errno != SUCCESS)
-    { return false; }
-
-    // Check if the file is large enough to contain the whole PE header
-    fseek(pe, peHeaderOffset + 0x14, SEEK_SET);
-    uint16_t sizeOfOptHdr = get16BitFromPE(pe);
-
-    // 0x18 == size of COFF header, 0x28 == size of one entry in section table
-    if(finalOffset < peHeaderOffset + 0x18 + sizeOfOptHdr + (sectionCount * 0x28) || errno != SUCCESS)
-    { return false; }
-
-    // Check machine ID
-    fseek(pe, peHeaderOffset + 0x4, SEEK_SET);
-
-    // 0x1F2 == POWERPCBE
-    uint16_t machineID = get16BitFromPE(pe);
-
-    if((machineID != 0x1F2 && !skipMachineCheck) || errno != SUCCESS)
-    { return false; }
-
-    // Check subsystem
-    fseek(pe, peHeaderOffset + 0x5C, SEEK_SET);
-
-    uint16_t subsystem = get16BitFromPE(pe);
-
-    if(subsystem != 0xE || errno != SUCCESS) // 0xE == XBOX
-    { return false; }
-
-    // Check page size/alignment
-    fseek(pe, peHeaderOffset + 0x38, SEEK_SET);
-
-    // 4KiB and 64KiB are the only valid sizes
-    uint32_t pageSize = get32BitFromPE(pe);
-
-    if((pageSize != 0x1000 && pageSize != 0x10000) || errno != SUCCESS)
-    { return false; }
-
-    // Check each raw offset + raw size in section table
-    fseek(pe, peHeaderOffset + 0x18 + sizeOfOptHdr + 0x10, SEEK_SET); // 0x10 == raw offset in entry
-
-    for(uint16_t i = 0; i < sectionCount; i++)
-    {
-        // If raw size + raw offset exceeds file size, PE is invalid
-        uint32_t rawSize = get32BitFromPE(pe);
-
-        if(errno != SUCCESS)
-        { return false; }
+    // No flags supported at this time (will be used for getting additional info, for e.g. other optional headers)
+    if(flags)
+    { return ERR_UNKNOWN_DATA_REQUEST; }
 
-        uint32_t rawOffset = get32BitFromPE(pe);
+    // DOS header: magic and pointer to PE header
+    const uint8_t *dosHeader = getSpan(pe, 0, 0x3C + 0x4);
 
-        if(errno != SUCCESS)
-        { return false; }
+    if(dosHeader == NULL || get16BitLE(dosHeader) != 0x5A4D) // PE magic
+    { return ERR_INVALID_PE; }
 
-        if(finalOffset < rawSize + rawOffset)
-        { return false; }
+    peData->fileSize = pe->size;
+    peData->peHeaderOffset = get32BitLE(dosHeader + 0x3C);
 
-        // Next entry
-        fseek(pe, 0x20, SEEK_CUR);
-    }
+    // COFF header, which tells us how large the rest of the header region is
+    const uint8_t *peHeader = getSpan(pe, peData->peHeaderOffset, PE_COFF_HDR_SIZE);
 
-    return true; // Checked enough, this is an Xbox 360 PE file
-}
+    if(peHeader == NULL)
+    { return ERR_INVALID_PE; }
 
-int getSectionInfo(FILE *pe, struct sections *sections)
-{
-    fseek(pe, 0x3C, SEEK_SET);
-    uint32_t peOffset = get32BitFromPE(pe);
+    uint16_t sizeOfOptHdr = get16BitLE(peHeader + PE_HDR_SIZE_OF_OPT_HDR);
+    peData->numberOfSections = get16BitLE(peHeader + PE_HDR_SECTION_COUNT);
+    peData->sectionTableSize = peData->numberOfSections * 0x28; // 0x28 == size of one entry in section table
 
-    if(errno != SUCCESS)
-    { return errno; }
+    if(sizeOfOptHdr < PE_MIN_OPT_HDR_SIZE)
+    { return ERR_INVALID_PE; }
 
-    fseek(pe, peOffset + 0x6, SEEK_SET); // 0x6 == section count
-    sections->count = get16BitFromPE(pe);
+    // The whole header region, from the PE header to the end of the section table
+    peHeader = getSpan(pe, peData->peHeaderOffset, PE_COFF_HDR_SIZE + sizeOfOptHdr + peData->sectionTableSize);
 
-    if(errno != SUCCESS)
-    { return errno; }
+    if(peHeader == NULL)
+    { return ERR_INVALID_PE; }
 
+    // Size of header
+    peData->headerSize = (peData->peHeaderOffset + 1) + PE_COFF_HDR_SIZE + sizeOfOptHdr;
+
+    peData->machine = get16BitLE(peHeader + PE_HDR_MACHINE);
+    peData->characteristics = get16BitLE(peHeader + PE_HDR_CHARACTERISTICS);
+    peData->entryPoint = get32BitLE(peHeader + PE_HDR_ENTRY_POINT); // RVA
+    peData->baseAddr = get32BitLE(peHeader + PE_HDR_BASE_ADDR);
+    peData->pageSize = get32BitLE(peHeader + PE_HDR_PAGE_SIZE); // Page alignment/size
+    peData->subsystem = get16BitLE(peHeader + PE_HDR_SUBSYSTEM);
+    peData->peExportInfo.count = (get32BitLE(peHeader + PE_HDR_EXPORT_TABLE_RVA) == 0 ? 0 : 1); // TODO: Actually read the data
+    peData->peImportInfo.idtRVA = get32BitLE(peHeader + PE_HDR_IMPORT_TABLE_RVA);
+    peData->tlsAddr = get32BitLE(peHeader + PE_HDR_TLS_ADDR);
+    peData->tlsSize = get32BitLE(peHeader + PE_HDR_TLS_SIZE);
+
+    // Section table
+    struct sections *sections = &(peData->sections);
+    sections->count = peData->numberOfSections;
     sections->section = calloc(sections->count, sizeof(struct section)); // free() is called for this in setdata
 
-    if(sections->section == NULL)
+    if(sections->section == NULL && sections->count != 0)
     { return ERR_OUT_OF_MEM; }
 
-    fseek(pe, peOffset + 0xF8, SEEK_SET); // 0xF8 == beginning of section table
+    const uint8_t *entry = peHeader + PE_COFF_HDR_SIZE + sizeOfOptHdr;
 
-    for(uint16_t i = 0; i < sections->count; i++)
+    for(uint16_t i = 0; i < sections->count; i++, entry += 0x28)
     {
-        fseek(pe, 0x8, SEEK_CUR); // Seek to virtual size of section
-        sections->section[i].virtualSize = get32BitFromPE(pe);
-
-        if(errno != SUCCESS)
-        { return errno; }
-
-        sections->section[i].rva = get32BitFromPE(pe);
-
-        if(errno != SUCCESS)
-        { return errno; }
-
-        sections->section[i].rawSize = get32BitFromPE(pe);
-
-        if(errno != SUCCESS)
-        { return errno; }
-
-        sections->section[i].offset = get32BitFromPE(pe);
-
-        if(errno != SUCCESS)
-        { return errno; }
-
-        fseek(pe, 0xC, SEEK_CUR); // Now progress to characteristics, where we will check flags
-        uint32_t characteristics = get32BitFromPE(pe);
-
-        if(errno != SUCCESS)
-        { return errno; }
-
-        if(characteristics & PE_SECTION_FLAG_EXECUTE)
-        {
-            sections->section[i].permFlag = XEX_SECTION_CODE | 0b10000; // | 0b(1)0000 == include size of 1
-        }
-        else if(characteristics & PE_SECTION_FLAG_WRITE || characteristics & PE_SECTION_FLAG_DISCARDABLE)
-        { sections->section[i].permFlag = XEX_SECTION_RWDATA | 0b10000; }
-        else if(characteristics & PE_SECTION_FLAG_READ)
-        { sections->section[i].permFlag = XEX_SECTION_RODATA | 0b10000; }
+        // 0x8 == virtual size of section, followed by RVA, raw size and raw offset
+        sections->section[i].virtualSize = get32BitLE(entry + 0x8);
+        sections->section[i].rva = get32BitLE(entry + 0xC);
+        sections->section[i].rawSize = get32BitLE(entry + 0x10);
+        sections->section[i].offset = get32BitLE(entry + 0x14);
+        sections->section[i].characteristics = get32BitLE(entry + 0x24); // Last field
+
+        // The page count half of the descriptor is filled in when the descriptors are laid out
+        if(sections->section[i].characteristics & PE_SECTION_FLAG_EXECUTE)
+        { sections->section[i].permFlag = XEX_SECTION_CODE; }
+        else if(sections->section[i].characteristics & PE_SECTION_FLAG_WRITE
+                || sections->section[i].characteristics & PE_SECTION_FLAG_DISCARDABLE)
+        { sections->section[i].permFlag = XEX_SECTION_RWDATA; }
+        else if(sections->section[i].characteristics & PE_SECTION_FLAG_READ)
+        { sections->section[i].permFlag = XEX_SECTION_RODATA; }
         else
-        { return ERR_MISSING_SECTION_FLAG; }
+        { sections->section[i].permFlag = 0; } // Rejected by validatePE
     }
 
-    // Don't need to progress any more to get to beginning of next entry, as characteristics is last field
     return SUCCESS;
 }
 
-int getHdrData(FILE *pe, struct peData *peData, uint8_t flags)
+// Validate the parsed PE. This isn't thorough, but it's enough to catch any non-PE/360 files,
+// as well as anything we can't convert.
+int validatePE(struct peData *peData, bool skipMachineCheck)
 {
-    // No flags supported at this time (will be used for getting additional info, for e.g. other optional headers)
-    if(flags)
-    { return ERR_UNKNOWN_DATA_REQUEST; }
-
-    // Getting PE header offset before we go any further..
-    fseek(pe, 0x3C, SEEK_SET);
-    peData->peHeaderOffset = get32BitFromPE(pe);
-
-    if(errno != SUCCESS)
-    { return errno; }
-
-    // Number of sections
-    fseek(pe, peData->peHeaderOffset + 0x6, SEEK_SET);
-    peData->numberOfSections = get16BitFromPE(pe);
-
-    if(errno != SUCCESS)
-    { return errno; }
-
-    // Size of section table
-    peData->sectionTableSize = peData->numberOfSections * 0x28;
-
-    // Size of header
-    // 0x18 == size of COFF header, get16BitFromPE value == size of optional header
-    fseek(pe, peData->peHeaderOffset + 0x14, SEEK_SET);
-    peData->headerSize = (peData->peHeaderOffset + 1) + 0x18 + get16BitFromPE(pe);
-
-    if(errno != SUCCESS)
-    { return errno; }
-
-    // PE characteristics
-    fseek(pe, peData->peHeaderOffset + 0x16, SEEK_SET);
-    peData->characteristics = get16BitFromPE(pe);
-
-    if(errno != SUCCESS)
-    { return errno; }
-
-    // Entry point (RVA)
-    fseek(pe, peData->peHeaderOffset + 0x28, SEEK_SET);
-    peData->entryPoint = get32BitFromPE(pe);
-
-    if(errno != SUCCESS)
-    { return errno; }
-
-    // Base address
-    fseek(pe, peData->peHeaderOffset + 0x34, SEEK_SET);
-    peData->baseAddr = get32BitFromPE(pe);
-
-    if(errno != SUCCESS)
-    { return errno; }
-
-    // Page alignment/size
-    fseek(pe, peData->peHeaderOffset + 0x38, SEEK_SET);
-    peData->pageSize = get32BitFromPE(pe);
+    // Check section count
+    if(peData->numberOfSections == 0)
+    { return ERR_INVALID_PE; }
 
-    if(errno != SUCCESS)
-    { return errno; }
+    // Check machine ID
+    // 0x1F2 == POWERPCBE
+    if(peData->machine != 0x1F2 && !skipMachineCheck)
+    { return ERR_INVALID_PE; }
 
-    // Export tables
-    fseek(pe, peData->peHeaderOffset + 0x78, SEEK_SET);
-    peData->peExportInfo.count = (get32BitFromPE(pe) == 0 ? 0 : 1); // TODO: Actually read the data
+    // Check subsystem
+    if(peData->subsystem != 0xE) // 0xE == XBOX
+    { return ERR_INVALID_PE; }
 
-    if(errno != SUCCESS)
-    { return errno; }
+    // Check page size/alignment
+    // 4KiB and 64KiB are the only valid sizes
+    if(peData->pageSize != 0x1000 && peData->pageSize != 0x10000)
+    { return ERR_INVALID_PE; }
 
-    // Import tables
-    fseek(pe, peData->peHeaderOffset + 0x80, SEEK_SET);
-    peData->peImportInfo.idtRVA = get32BitFromPE(pe);
+    for(uint16_t i = 0; i < peData->sections.count; i++)
+    {
+        // If raw size + raw offset exceeds file size, PE is invalid
+        if(peData->fileSize < (uint64_t)peData->sections.section[i].rawSize + peData->sections.section[i].offset)
+        { return ERR_INVALID_PE; }
 
-    if(errno != SUCCESS)
-    { return errno; }
+        if(peData->sections.section[i].permFlag == 0)
+        { return ERR_MISSING_SECTION_FLAG; }
+    }
 
     // TLS status (PE TLS is currently UNSUPPORTED, so if we find it, we'll need to abort)
-    fseek(pe, peData->peHeaderOffset + 0xC0, SEEK_SET);
-    peData->tlsAddr = get32BitFromPE(pe);
-
-    if(errno != SUCCESS)
-    { return errno; }
-
-    peData->tlsSize = get32BitFromPE(pe);
-
-    if(errno != SUCCESS)
-    { return errno; }
-
     if(peData->tlsAddr != 0 || peData->tlsSize != 0)
     { return ERR_UNSUPPORTED_STRUCTURE; }
 
-    // Section info
-    int ret = getSectionInfo(pe, &(peData->sections));
-
-    if(ret != 0)
-    { return ret; }
-
-    return SUCCESS;
+    return SUCCESS; // Checked enough, this is an Xbox 360 PE file we can handle
 }
@@ -21,8 +21,8 @@
 #include "../common/common.h"
 #include "../common/datastorage.h"
 
-// Returns true if PE is valid Xbox 360 PE, else false
-bool validatePE(FILE *pe, bool skipMachineCheck);
-
 // Gets data required for XEX building from PE
-int getHdrData(FILE *pe, struct peData *peData, uint8_t flags);
+int getHdrData(struct mappedFile *pe, struct peData *peData, uint8_t flags);
+
+// Returns SUCCESS if the parsed PE is a valid Xbox 360 PE we can convert, else an error code
+int validatePE(struct peData *peData, bool skipMachineCheck);
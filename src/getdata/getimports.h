@@ -21,4 +21,4 @@
 #include "../common/common.h"
 #include "../common/datastorage.h"
 
-int getImports(FILE *pe, struct peData *peData);
+int getImports(struct mappedFile *pe, struct peData *peData);
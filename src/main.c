@@ -21,15 +21,11 @@
 
 #include "common/common.h"
 #include "common/datastorage.h"
-#include "pemapper/pemapper.h"
-#include "getdata/gethdrdata.h"
-#include "getdata/getimports.h"
-#include "setdata/populateheaders.h"
-#include "setdata/pagedescriptors.h"
-#include "setdata/optheaders.h"
-#include "placer/placer.h"
-#include "write/writexex.h"
-#include "write/headerhash.h"
+#include "convert/convert.h"
+#include "convert/batch.h"
+#include "server/server.h"
+#include "edit/editxex.h"
+#include "patch/xexpatch.h"
 
 // Using the standalone getopt bundled, as getopt_long is not POSIX, so we can't rely on system <getopt.h>.
 #include <getopt_port/getopt.h>
@@ -110,54 +106,71 @@ void dispHelp(char **argv)
     printf("-l,\t--libs,\t\t\tShow licensing information of libraries used\n");
     printf("-s,\t--skip-machine-check,\tSkip the PE file machine ID check\n");
     printf("-i,\t--input,\t\tSpecify input PE file path\n");
-    printf("-o,\t--output,\t\tSpecify output XEX file path\n");
-    printf("-t,\t--type,\t\t\tOverride automatic executable type detection\n\t\t\t\t(options: title, titledll, sysdll, dll)\n\n");
+    printf("-o,\t--output,\t\tSpecify output XEX file path (give several -i/-o pairs\n\t\t\t\tto convert them all as a batch)\n");
+    printf("-U,\t--update,\t\tLike --output, but update an existing XEX in place, only\n\t\t\t\twriting what changed (applies to every output given)\n");
+    printf("-S,\t--server,\t\tKeep running, converting for clients connecting to this\n\t\t\t\tUnix socket path (with -j threads)\n");
+    printf("-C,\t--client,\t\tHave the server on this Unix socket path do the conversions\n");
+    printf("-b,\t--batch,\t\tConvert every entry of a manifest file, one per line as\n\t\t\t\t<input><TAB><output>[<TAB><type>]\n");
+    printf("-t,\t--type,\t\t\tOverride automatic executable type detection\n\t\t\t\t(options: title, titledll, sysdll, dll)\n");
+    printf("-j,\t--jobs,\t\t\tNumber of threads to use for hashing pages and\n\t\t\t\tcompressing (default: 1, or one per processor when run by\n\t\t\t\tmake -j, which hands out turns for all but one)\n");
+    printf("-m,\t--mem-limit,\t\tLargest basefile to keep in memory, in MiB, beyond which\n\t\t\t\ta temporary file is used (default: 1024)\n");
+    printf("-z,\t--compress,\t\tBasefile compression (options: none, basic (default),\n\t\t\t\twhich leaves out runs of zeroes, or fast, default, max\n\t\t\t\tfor LZX at increasing effort)\n");
+    printf("-e,\t--encrypt,\t\tEncrypt the basefile with a random key\n");
+    printf("-I,\t--incremental,\t\tKeep page hashes in <output>.xexcache, and only hash pages\n\t\t\t\twhich changed since the last build\n");
+    printf("-D,\t--cache-dir,\t\tReuse XEXes built from identical input with the same\n\t\t\t\toptions from this directory, and add new ones to it\n");
+    printf("-L,\t--cache-link,\t\tHard link XEXes out of the cache instead of copying them\n\t\t\t\t(don't edit the outputs in place with this)\n");
+    printf("-E,\t--edit,\t\t\tChange the headers of an existing XEX in place, without\n\t\t\t\trebuilding it (with -t, -r, -M and/or -F)\n");
+    printf("-r,\t--region,\t\tGame region to set when editing (e.g. 0xFFFFFFFF for all)\n");
+    printf("-M,\t--media-types,\t\tAllowed media types to set when editing\n");
+    printf("-F,\t--sys-flags,\t\tSystem flags to set when editing\n");
+    printf("-P,\t--patch-from,\t\tWrite a delta patch (to -o) taking this XEX to the input,\n\t\t\t\teither a newer XEX or a PE to convert (build options\n\t\t\t\tonly apply to a PE). The new XEX can't be LZX\n\t\t\t\tcompressed or encrypted, nothing would match\n");
+    printf("-A,\t--apply-patch,\t\tRebuild a XEX (to -o) from the one a delta patch was made\n\t\t\t\tfrom (-i) and this patch\n");
+    printf("-V,\t--variant,\t\tAlso write a XEX differing only in type and/or system flags,\n\t\t\t\tgiven as [<type>][,<system flags>]:<output>, from the same\n\t\t\t\tconversion (can be given more than once)\n");
+    printf("-p,\t--plan,\t\t\tOnly work out and print the layout of the XEX the input\n\t\t\t\twould give (sizes in bytes), without building it\n");
+    printf("-c,\t--coalesce,\t\tLet one page descriptor cover up to this many consecutive\n\t\t\t\tpages with the same permissions (default: 1, no coalescing)\n\n");
 }
 
-void handleError(int ret)
+// Region, media type and system flag values are bitmasks, so take them in hex (0x...) as well as decimal
+bool parseEditValue(const char *text, uint32_t *value)
 {
-    switch(ret)
-    {
-        case ERR_UNKNOWN_DATA_REQUEST:
-            fprintf(stderr, "%s ERROR: Internal error getting data from PE file. THIS IS A BUG, please report it. Aborting.\n", SYNTHXEX_PRINT_STEM);
-            break;
+    char *end = NULL;
+    unsigned long parsed = strtoul(text, &end, 0);
 
-        case ERR_FILE_READ:
-            fprintf(stderr, "%s ERROR: Failed to read data from PE file. Aborting.\n", SYNTHXEX_PRINT_STEM);
-            break;
+    if(*end != 0 || end == text || parsed > UINT32_MAX)
+    { return false; }
 
-        case ERR_FILE_WRITE:
-            fprintf(stderr, "%s ERROR: Failed to write data to file. Aborting.\n", SYNTHXEX_PRINT_STEM);
-            break;
+    *value = (uint32_t)parsed;
+    return true;
+}
 
-        case ERR_OUT_OF_MEM:
-            fprintf(stderr, "%s ERROR: Out of memory. Aborting.\n", SYNTHXEX_PRINT_STEM);
-            break;
+// A variant is given as [<type>][,<system flags>]:<output>, the type or flags left out being the same as the
+// main output's. Split on the first colon, so Windows paths work.
+bool parseVariant(const char *spec, struct xexVariant *variant)
+{
+    const char *colon = strchr(spec, ':');
+    char fields[64];
 
-        case ERR_MISSING_SECTION_FLAG:
-            fprintf(stderr, "%s ERROR: R/W/X flag missing from PE section. Aborting.\n", SYNTHXEX_PRINT_STEM);
-            break;
+    if(colon == NULL || colon[1] == 0 || (size_t)(colon - spec) >= sizeof(fields))
+    { return false; }
 
-        case ERR_UNSUPPORTED_STRUCTURE:
-            fprintf(stderr, "%s ERROR: Encountered an unsupported data structure in PE. Aborting.\n", SYNTHXEX_PRINT_STEM);
-            break;
+    memset(variant, 0, sizeof(struct xexVariant));
+    variant->xexfilePath = colon + 1;
+    memcpy(fields, spec, colon - spec);
+    fields[colon - spec] = 0;
 
-        case ERR_INVALID_RVA_OR_OFFSET:
-            fprintf(stderr, "%s ERROR: Invalid RVA or offset found. Aborting.\n", SYNTHXEX_PRINT_STEM);
-            break;
+    char *comma = strchr(fields, ',');
 
-        case ERR_INVALID_IMPORT_NAME:
-            fprintf(stderr, "%s ERROR: Invalid import name found. Aborting.\n", SYNTHXEX_PRINT_STEM);
-            break;
+    if(comma != NULL)
+    {
+        *comma = 0;
 
-        case ERR_DATA_OVERFLOW:
-            fprintf(stderr, "%s ERROR: Data overflow. Aborting.\n", SYNTHXEX_PRINT_STEM);
-            break;
+        if(!parseEditValue(comma + 1, &(variant->edits.sysFlags)))
+        { return false; }
 
-        default:
-            fprintf(stderr, "%s ERROR: Unknown error: %d. Aborting.\n", SYNTHXEX_PRINT_STEM, ret);
-            break;
+        variant->edits.setSysFlags = true;
     }
+
+    return fields[0] == 0 || parseModuleType(fields, &(variant->edits.moduleFlags));
 }
 
 int main(int argc, char **argv)
@@ -170,108 +183,274 @@ int main(int argc, char **argv)
         { "skip-machine-check", no_argument, 0, 's' },
         { "input", required_argument, 0, 'i' },
         { "output", required_argument, 0, 'o' },
+        { "update", required_argument, 0, 'U' },
+        { "batch", required_argument, 0, 'b' },
+        { "server", required_argument, 0, 'S' },
+        { "client", required_argument, 0, 'C' },
         { "type", required_argument, 0, 't' },
+        { "jobs", required_argument, 0, 'j' },
+        { "mem-limit", required_argument, 0, 'm' },
+        { "coalesce", required_argument, 0, 'c' },
+        { "compress", required_argument, 0, 'z' },
+        { "encrypt", no_argument, 0, 'e' },
+        { "incremental", no_argument, 0, 'I' },
+        { "cache-dir", required_argument, 0, 'D' },
+        { "cache-link", no_argument, 0, 'L' },
+        { "edit", required_argument, 0, 'E' },
+        { "region", required_argument, 0, 'r' },
+        { "media-types", required_argument, 0, 'M' },
+        { "sys-flags", required_argument, 0, 'F' },
+        { "patch-from", required_argument, 0, 'P' },
+        { "apply-patch", required_argument, 0, 'A' },
+        { "variant", required_argument, 0, 'V' },
+        { "plan", no_argument, 0, 'p' },
         { 0, 0, 0, 0 }
     };
 
-    struct offsets *offsets = calloc(1, sizeof(struct offsets));
-    struct xexHeader *xexHeader = calloc(1, sizeof(struct xexHeader));
-    struct secInfoHeader *secInfoHeader = calloc(1, sizeof(struct secInfoHeader));
-    struct peData *peData = calloc(1, sizeof(struct peData));
-    struct optHeaderEntries *optHeaderEntries = calloc(1, sizeof(struct optHeaderEntries));
-    struct optHeaders *optHeaders = calloc(1, sizeof(struct optHeaders));
-
-    if(offsets == NULL || xexHeader == NULL || secInfoHeader == NULL ||
-            peData == NULL || optHeaderEntries == NULL || optHeaders == NULL)
+    struct convertOptions options;
+    memset(&options, 0, sizeof(options));
+    options.verbose = true;
+    options.jobs = 1;
+    options.memLimit = 1024 * 1024 * 1024; // Largest basefile to keep in memory, 1GiB by default
+    options.maxPageRun = 1; // Most pages one page descriptor may cover
+    options.compMode = COMP_MODE_BASIC;
+    bool jobsGiven = false;
+    struct jobServer jobServer = { -1, -1, false };
+
+    // Inputs and outputs are paired up in the order given. These point into argv.
+    char **pePaths = calloc(argc, sizeof(char *));
+    char **xexfilePaths = calloc(argc, sizeof(char *));
+    struct xexVariant *variants = calloc(argc, sizeof(struct xexVariant));
+    uint32_t peCount = 0;
+    uint32_t xexCount = 0;
+    uint32_t variantCount = 0;
+    bool plan = false;
+    bool buildOptionGiven = false; // Anything only used when converting
+    char *manifestPath = NULL;
+    char *serverPath = NULL;
+    char *clientPath = NULL;
+    char *editPath = NULL;
+    char *patchFromPath = NULL;
+    char *applyPatchPath = NULL;
+    struct xexEdits edits;
+    memset(&edits, 0, sizeof(edits));
+
+    if(pePaths == NULL || xexfilePaths == NULL || variants == NULL)
     {
         printf("%s ERROR: Out of memory. Aborting\n", SYNTHXEX_PRINT_STEM);
-        freeAllMainStructs(&offsets, &xexHeader, &secInfoHeader, &peData,
-                           &optHeaderEntries, &optHeaders);
+        nullAndFree((void **)&pePaths);
+        nullAndFree((void **)&xexfilePaths);
+        nullAndFree((void **)&variants);
         return -1;
     }
 
     int optIndex = 0;
     int option = 0;
+    int ret = SUCCESS;
+    uint64_t memLimit = 0;
+    char *strtoulRet = NULL;
 
-    bool gotInput = false;
-    bool gotOutput = false;
-    bool skipMachineCheck = false;
-
-    char *pePath = NULL;
-    char *xexfilePath = NULL;
-
-    while((option = getopt_long(argc, argv, "hvlsi:o:t:", longOptions, &optIndex)) != -1)
+    while((option = getopt_long(argc, argv, "hvlseILpi:o:U:E:P:A:V:b:S:C:t:j:m:c:z:D:r:M:F:", longOptions, &optIndex)) != -1)
     {
         switch(option)
         {
             case 'v':
                 dispVer();
-                freeAllMainStructs(&offsets, &xexHeader, &secInfoHeader, &peData,
-                                   &optHeaderEntries, &optHeaders);
-                return SUCCESS;
+                goto cleanup;
 
             case 'l':
                 dispLibs();
-                freeAllMainStructs(&offsets, &xexHeader, &secInfoHeader, &peData,
-                                   &optHeaderEntries, &optHeaders);
-                return SUCCESS;
+                goto cleanup;
 
             case 's':
+                buildOptionGiven = true;
                 printf("%s WARNING: Skipping machine ID check.\n", SYNTHXEX_PRINT_STEM);
-                skipMachineCheck = true;
+                options.skipMachineCheck = true;
+                break;
+
+            case 'e':
+                buildOptionGiven = true;
+                options.encrypt = true;
+                break;
+
+            case 'I':
+                buildOptionGiven = true;
+                options.incremental = true;
+                break;
+
+            case 'D':
+                buildOptionGiven = true;
+                options.cacheDir = optarg;
+                break;
+
+            case 'L':
+                buildOptionGiven = true;
+                options.cacheLink = true;
+                break;
+
+            case 'p':
+                plan = true;
                 break;
 
             case 'i':
-                gotInput = true;
-                pePath = malloc(strlen(optarg) + 1);
+                pePaths[peCount++] = optarg;
+                break;
+
+            case 'o':
+                xexfilePaths[xexCount++] = optarg;
+                break;
+
+            case 'U':
+                xexfilePaths[xexCount++] = optarg;
+                options.update = true;
+                break;
+
+            case 'E':
+                editPath = optarg;
+                break;
+
+            case 'P':
+                patchFromPath = optarg;
+                break;
 
-                if(pePath == NULL)
+            case 'A':
+                applyPatchPath = optarg;
+                break;
+
+            case 'V':
+                if(!parseVariant(optarg, &(variants[variantCount++])))
                 {
-                    printf("%s ERROR: Out of memory. Aborting.\n", SYNTHXEX_PRINT_STEM);
-                    nullAndFree((void **)&xexfilePath);
-                    freeAllMainStructs(&offsets, &xexHeader, &secInfoHeader, &peData,
-                                       &optHeaderEntries, &optHeaders);
-                    return -1;
+                    printf("%s ERROR: Invalid variant \"%s\" (expected [<type>][,<system flags>]:<output>). Aborting.\n",
+                           SYNTHXEX_PRINT_STEM, optarg);
+
+                    ret = -1;
+                    goto cleanup;
                 }
 
-                strcpy(pePath, optarg);
                 break;
 
-            case 'o':
-                gotOutput = true;
-                xexfilePath = malloc(strlen(optarg) + 1);
+            case 'r':
+                edits.setGameRegion = true;
 
-                if(xexfilePath == NULL)
+                if(!parseEditValue(optarg, &(edits.gameRegion)))
                 {
-                    printf("%s ERROR: Out of memory. Aborting.\n", SYNTHXEX_PRINT_STEM);
-                    nullAndFree((void **)&pePath);
-                    freeAllMainStructs(&offsets, &xexHeader, &secInfoHeader, &peData,
-                                       &optHeaderEntries, &optHeaders);
-                    return -1;
+                    printf("%s ERROR: Invalid region \"%s\" (must be a number, e.g. 0x%X). Aborting.\n",
+                           SYNTHXEX_PRINT_STEM, optarg, UINT32_MAX);
+
+                    ret = -1;
+                    goto cleanup;
                 }
 
-                strcpy(xexfilePath, optarg);
+                break;
+
+            case 'M':
+                edits.setMediaTypes = true;
+
+                if(!parseEditValue(optarg, &(edits.mediaTypes)))
+                {
+                    printf("%s ERROR: Invalid media types \"%s\" (must be a number, e.g. 0x%X). Aborting.\n",
+                           SYNTHXEX_PRINT_STEM, optarg, UINT32_MAX);
+
+                    ret = -1;
+                    goto cleanup;
+                }
+
+                break;
+
+            case 'F':
+                edits.setSysFlags = true;
+
+                if(!parseEditValue(optarg, &(edits.sysFlags)))
+                {
+                    printf("%s ERROR: Invalid system flags \"%s\" (must be a number, e.g. 0x%X). Aborting.\n",
+                           SYNTHXEX_PRINT_STEM, optarg, UINT32_MAX);
+
+                    ret = -1;
+                    goto cleanup;
+                }
+
+                break;
+
+            case 'b':
+                manifestPath = optarg;
+                break;
+
+            case 'S':
+                serverPath = optarg;
+                break;
+
+            case 'C':
+                clientPath = optarg;
                 break;
 
             case 't':
-                if(strcmp(optarg, "title") == 0)
-                { xexHeader->moduleFlags = XEX_MOD_FLAG_TITLE; }
-                else if(strcmp(optarg, "titledll") == 0)
-                { xexHeader->moduleFlags = XEX_MOD_FLAG_TITLE | XEX_MOD_FLAG_DLL; }
-                else if(strcmp(optarg, "sysdll") == 0)
-                { xexHeader->moduleFlags = XEX_MOD_FLAG_EXPORTS | XEX_MOD_FLAG_DLL; }
-                else if(strcmp(optarg, "dll") == 0)
-                { xexHeader->moduleFlags = XEX_MOD_FLAG_DLL; }
-                else
+                if(!parseModuleType(optarg, &(options.moduleFlags)))
                 {
                     printf("%s ERROR: Invalid type override \"%s\" (valid: title, titledll, sysdll, dll). Aborting.\n",
                            SYNTHXEX_PRINT_STEM, optarg);
 
-                    nullAndFree((void **)&pePath);
-                    nullAndFree((void **)&xexfilePath);
-                    freeAllMainStructs(&offsets, &xexHeader, &secInfoHeader, &peData,
-                                       &optHeaderEntries, &optHeaders);
-                    return -1;
+                    ret = -1;
+                    goto cleanup;
+                }
+
+                break;
+
+            case 'j':
+                buildOptionGiven = true;
+                options.jobs = (uint32_t)strtoul(optarg, &strtoulRet, 10);
+                jobsGiven = true;
+
+                if(*strtoulRet != 0 || strtoulRet == optarg || options.jobs == 0)
+                {
+                    printf("%s ERROR: Invalid job count \"%s\" (must be a number greater than 0). Aborting.\n",
+                           SYNTHXEX_PRINT_STEM, optarg);
+
+                    ret = -1;
+                    goto cleanup;
+                }
+
+                break;
+
+            case 'm':
+                buildOptionGiven = true;
+                memLimit = strtoull(optarg, &strtoulRet, 10);
+
+                if(*strtoulRet != 0 || strtoulRet == optarg || memLimit > UINT32_MAX)
+                {
+                    printf("%s ERROR: Invalid memory limit \"%s\" (must be a number of MiB). Aborting.\n",
+                           SYNTHXEX_PRINT_STEM, optarg);
+
+                    ret = -1;
+                    goto cleanup;
+                }
+
+                options.memLimit = memLimit * 1024 * 1024;
+                break;
+
+            case 'c':
+                buildOptionGiven = true;
+                options.maxPageRun = (uint32_t)strtoul(optarg, &strtoulRet, 10);
+
+                if(*strtoulRet != 0 || strtoulRet == optarg || options.maxPageRun == 0 || options.maxPageRun > XEX_PAGE_DESC_MAX_RUN)
+                {
+                    printf("%s ERROR: Invalid page run limit \"%s\" (must be a number from 1 to %u). Aborting.\n",
+                           SYNTHXEX_PRINT_STEM, optarg, XEX_PAGE_DESC_MAX_RUN);
+
+                    ret = -1;
+                    goto cleanup;
+                }
+
+                break;
+
+            case 'z':
+                buildOptionGiven = true;
+                if(!parseCompMode(optarg, &(options.compMode)))
+                {
+                    printf("%s ERROR: Invalid compression mode \"%s\" (valid: none, basic, fast, default, max). Aborting.\n",
+                           SYNTHXEX_PRINT_STEM, optarg);
+
+                    ret = -1;
+                    goto cleanup;
                 }
 
                 break;
@@ -279,256 +458,314 @@ int main(int argc, char **argv)
             case 'h':
             default:
                 dispHelp(argv);
-                freeAllMainStructs(&offsets, &xexHeader, &secInfoHeader, &peData,
-                                   &optHeaderEntries, &optHeaders);
-                return SUCCESS;
+                goto cleanup;
         }
     }
 
     printf("%s This is %s. Copyright (c) %s Aiden Isik.\n", SYNTHXEX_PRINT_STEM, SYNTHXEX_VERSION_STRING, SYNTHXEX_COPYRIGHT);
     printf("%s This program is free/libre software. Run \"%s --version\" for info.\n\n", SYNTHXEX_PRINT_STEM, argv[0]);
 
-    if(!gotInput)
+    if(editPath == NULL && (edits.setGameRegion || edits.setMediaTypes || edits.setSysFlags))
     {
-        if(gotOutput)
-        { nullAndFree((void **)&xexfilePath); }
-
-        freeAllMainStructs(&offsets, &xexHeader, &secInfoHeader, &peData, &optHeaderEntries, &optHeaders);
-        printf("%s ERROR: PE input expected but not found. Aborting.\n", SYNTHXEX_PRINT_STEM);
-        return -1;
+        printf("%s ERROR: --region, --media-types and --sys-flags are only valid with --edit. Aborting.\n", SYNTHXEX_PRINT_STEM);
+        ret = -1;
+        goto cleanup;
     }
-    else if(!gotOutput)
-    {
-        if(gotInput)
-        { nullAndFree((void **)&pePath); }
 
-        freeAllMainStructs(&offsets, &xexHeader, &secInfoHeader, &peData, &optHeaderEntries, &optHeaders);
-        printf("%s ERROR: XEX file output expected but not found. Aborting.\n", SYNTHXEX_PRINT_STEM);
-        return -1;
+    // Server conversions go straight between file descriptors, with no output path to cache, keep a sidecar next to or update
+    if((serverPath != NULL || clientPath != NULL) && (options.cacheDir != NULL || options.cacheLink || options.incremental || options.update))
+    {
+        printf("%s ERROR: --cache-dir, --cache-link, --incremental and --update aren't supported with --server or --client. Aborting.\n",
+               SYNTHXEX_PRINT_STEM);
+        ret = -1;
+        goto cleanup;
     }
 
-    FILE *pe = fopen(pePath, "rb");
-
-    if(pe == NULL)
+    if(variantCount > 0 && (editPath != NULL || patchFromPath != NULL || applyPatchPath != NULL || serverPath != NULL
+                            || clientPath != NULL || manifestPath != NULL || peCount > 1 || xexCount > 1))
     {
-        printf("%s ERROR: Failed to open PE file. Do you have read permissions? Aborting.\n", SYNTHXEX_PRINT_STEM);
-        nullAndFree((void **)&pePath);
-        nullAndFree((void **)&xexfilePath);
-        freeAllMainStructs(&offsets, &xexHeader, &secInfoHeader, &peData, &optHeaderEntries, &optHeaders);
-        return -1;
+        printf("%s ERROR: --variant is only valid when converting a single PE. Aborting.\n", SYNTHXEX_PRINT_STEM);
+        ret = -1;
+        goto cleanup;
     }
 
-    nullAndFree((void **)&pePath);
+    // Nothing's built, just laid out, so -o and the like aren't needed
+    if(plan)
+    {
+        if(peCount != 1 || xexCount > 0 || editPath != NULL || patchFromPath != NULL || applyPatchPath != NULL || serverPath != NULL
+                || clientPath != NULL || manifestPath != NULL || variantCount > 0 || options.update || options.cacheDir != NULL
+                || options.cacheLink || options.incremental || options.encrypt)
+        {
+            printf("%s ERROR: --plan needs exactly one input (-i), and nothing else to do (it doesn't write, cache or encrypt). Aborting.\n", SYNTHXEX_PRINT_STEM);
+            ret = -1;
+            goto cleanup;
+        }
 
-    FILE *xex = fopen(xexfilePath, "wb+");
+        struct xexPlan xexPlan;
+        ret = planConversion(pePaths[0], &options, &xexPlan);
 
-    if(xex == NULL)
-    {
-        printf("%s ERROR: Failed to create XEX file. Do you have write permissions? Aborting.\n", SYNTHXEX_PRINT_STEM);
-        fclose(pe);
-        nullAndFree((void **)&xexfilePath);
-        freeAllMainStructs(&offsets, &xexHeader, &secInfoHeader, &peData, &optHeaderEntries, &optHeaders);
-        return -1;
-    }
+        if(ret != SUCCESS)
+        {
+            handleError(ret);
+            ret = -1;
+            goto cleanup;
+        }
 
-    // Keep xexfilePath for later use
-    // Do NOT free xexfilePath here yet
+        printf("Header size: %u\n", xexPlan.headerSize);
+        printf("Basefile offset: %u\n", xexPlan.headerSize);
+        printf("Page size: %u\n", xexPlan.pageSize);
+        printf("Page count: %u\n", xexPlan.pageCount);
+        printf("Page descriptors: %u\n", xexPlan.pageDescCount);
 
-    int ret = 0;
+        if(xexPlan.basefileSizeKnown)
+        {
+            printf("Basefile size: %" PRIu64 "\n", xexPlan.basefileSize);
+            printf("Total size: %" PRIu64 "\n\n", xexPlan.totalSize);
+        }
+        else
+        {
+            printf("Basefile size: unknown (LZX compressed)\n");
+            printf("Total size: unknown (LZX compressed)\n\n");
+        }
 
-    printf("%s Validating PE file...\n", SYNTHXEX_PRINT_STEM);
+        goto cleanup;
+    }
 
-    if(!validatePE(pe, skipMachineCheck))
+    // Editing only touches the headers, nothing gets converted
+    if(editPath != NULL)
     {
-        printf("%s ERROR: Input PE is not Xbox 360 PE. Aborting.\n", SYNTHXEX_PRINT_STEM);
-        nullAndFree((void **)&xexfilePath);
-        freeAllMainStructs(&offsets, &xexHeader, &secInfoHeader, &peData, &optHeaderEntries, &optHeaders);
-        fclose(pe);
-        fclose(xex);
-        return -1;
-    }
+        if(peCount > 0 || xexCount > 0 || manifestPath != NULL || serverPath != NULL || clientPath != NULL || patchFromPath != NULL
+                || applyPatchPath != NULL || variantCount > 0 || plan || buildOptionGiven)
+        {
+            printf("%s ERROR: --edit only takes -t, -r, -M and -F, it doesn't build anything. Aborting.\n", SYNTHXEX_PRINT_STEM);
+            ret = -1;
+            goto cleanup;
+        }
 
-    printf("%s PE valid!\n", SYNTHXEX_PRINT_STEM);
+        edits.moduleFlags = options.moduleFlags;
 
-    printf("%s Retrieving header data from PE...\n", SYNTHXEX_PRINT_STEM);
-    ret = getHdrData(pe, peData, 0);
+        if(edits.moduleFlags == 0 && !edits.setGameRegion && !edits.setMediaTypes && !edits.setSysFlags)
+        {
+            printf("%s ERROR: Nothing to edit (give -t, -r, -M and/or -F). Aborting.\n", SYNTHXEX_PRINT_STEM);
+            ret = -1;
+            goto cleanup;
+        }
 
-    if(ret != SUCCESS)
-    {
-        handleError(ret);
-        nullAndFree((void **)&xexfilePath);
-        freeAllMainStructs(&offsets, &xexHeader, &secInfoHeader, &peData, &optHeaderEntries, &optHeaders);
-        fclose(pe);
-        fclose(xex);
-        return -1;
-    }
+        printf("%s Editing XEX headers...\n", SYNTHXEX_PRINT_STEM);
+        ret = editXEX(editPath, &edits);
 
-    printf("%s Got header data from PE!\n", SYNTHXEX_PRINT_STEM);
+        if(ret == ERR_FILE_OPEN)
+        { printf("%s ERROR: Failed to open XEX file. Do you have read/write permissions? Aborting.\n", SYNTHXEX_PRINT_STEM); }
+        else if(ret != SUCCESS)
+        { handleError(ret); }
+        else
+        { printf("%s XEX edited. Have a nice day!\n\n", SYNTHXEX_PRINT_STEM); }
 
-    printf("%s Retrieving import data from PE...\n", SYNTHXEX_PRINT_STEM);
-    ret = getImports(pe, peData);
+        if(ret != SUCCESS)
+        { ret = -1; }
 
-    if(ret != SUCCESS)
-    {
-        handleError(ret);
-        nullAndFree((void **)&xexfilePath);
-        freeAllMainStructs(&offsets, &xexHeader, &secInfoHeader, &peData, &optHeaderEntries, &optHeaders);
-        fclose(pe);
-        fclose(xex);
-        return -1;
+        goto cleanup;
     }
 
-    printf("%s Got import data from PE!\n", SYNTHXEX_PRINT_STEM);
-
-    printf("%s Creating basefile from PE...\n", SYNTHXEX_PRINT_STEM);
-    char *basefilePath = malloc((strlen(xexfilePath) + strlen(".basefile") + 1) * sizeof(char));
-
-    if(!basefilePath)
+    // Making or applying a delta patch, -i and -o are the one input and output
+    if(patchFromPath != NULL || applyPatchPath != NULL)
     {
-        printf("%s ERROR: Out of memory. Aborting.\n", SYNTHXEX_PRINT_STEM);
-        freeAllMainStructs(&offsets, &xexHeader, &secInfoHeader, &peData, &optHeaderEntries, &optHeaders);
-        nullAndFree((void **)&xexfilePath);
-        fclose(pe);
-        fclose(xex);
-        return -1;
-    }
+        if(patchFromPath != NULL && applyPatchPath != NULL)
+        {
+            printf("%s ERROR: --patch-from and --apply-patch can't be used together. Aborting.\n", SYNTHXEX_PRINT_STEM);
+            ret = -1;
+            goto cleanup;
+        }
 
-    strcpy(basefilePath, xexfilePath);
-    strcat(basefilePath, ".basefile");
+        if(peCount != 1 || xexCount != 1 || options.update)
+        {
+            printf("%s ERROR: Delta patches need exactly one input (-i) and one output (-o). Aborting.\n", SYNTHXEX_PRINT_STEM);
+            ret = -1;
+            goto cleanup;
+        }
 
-    FILE *basefile = fopen(basefilePath, "wb+");
-    nullAndFree((void **)&xexfilePath);
-    nullAndFree((void **)&basefilePath);
+        if(options.cacheDir != NULL || options.cacheLink || options.incremental)
+        {
+            printf("%s ERROR: Delta patches can't use the output or hash caches (-D, -L, -I). Aborting.\n", SYNTHXEX_PRINT_STEM);
+            ret = -1;
+            goto cleanup;
+        }
 
-    if(!basefile)
-    {
-        printf("%s ERROR: Could not create basefile. Do you have write permission? Aborting.\n", SYNTHXEX_PRINT_STEM);
-        freeAllMainStructs(&offsets, &xexHeader, &secInfoHeader, &peData, &optHeaderEntries, &optHeaders);
-        fclose(pe);
-        fclose(xex);
-        return -1;
-    }
+        // Only a PE given to --patch-from gets built
+        if((buildOptionGiven || options.moduleFlags != 0) && (applyPatchPath != NULL || isXEXFile(pePaths[0])))
+        {
+            printf("%s ERROR: Build options are only valid with --patch-from when the input is a PE to convert. Aborting.\n",
+                   SYNTHXEX_PRINT_STEM);
 
-    // Map the PE into the basefile (RVAs become offsets)
-    ret = mapPEToBasefile(pe, basefile, peData);
-    fclose(pe);
+            ret = -1;
+            goto cleanup;
+        }
 
-    if(ret != SUCCESS)
-    {
-        handleError(ret);
-        freeAllMainStructs(&offsets, &xexHeader, &secInfoHeader, &peData, &optHeaderEntries, &optHeaders);
-        fclose(basefile);
-        fclose(xex);
-        return -1;
-    }
+        if(patchFromPath != NULL)
+        {
+            printf("%s Making delta patch...\n", SYNTHXEX_PRINT_STEM);
+            ret = makeXEXPatch(patchFromPath, pePaths[0], xexfilePaths[0], &options);
+        }
+        else
+        {
+            printf("%s Applying delta patch...\n", SYNTHXEX_PRINT_STEM);
+            ret = applyXEXPatch(pePaths[0], applyPatchPath, xexfilePaths[0]);
+        }
 
-    printf("%s Created basefile!\n", SYNTHXEX_PRINT_STEM);
+        if(ret == ERR_FILE_OPEN)
+        { printf("%s ERROR: Failed to open XEX or patch file. Do you have read/write permissions? Aborting.\n", SYNTHXEX_PRINT_STEM); }
+        else if(ret != SUCCESS)
+        { handleError(ret); }
+        else
+        { printf("%s Delta patch %s. Have a nice day!\n\n", SYNTHXEX_PRINT_STEM, (patchFromPath != NULL) ? "written" : "applied"); }
 
-    // Setting final XEX data structs
-    printf("%s Building security header...\n", SYNTHXEX_PRINT_STEM);
-    ret = setSecInfoHeader(secInfoHeader, peData);
+        if(ret != SUCCESS)
+        { ret = -1; }
 
-    if(ret != SUCCESS)
-    {
-        handleError(ret);
-        freeAllMainStructs(&offsets, &xexHeader, &secInfoHeader, &peData, &optHeaderEntries, &optHeaders);
-        fclose(basefile);
-        fclose(xex);
-        return -1;
+        goto cleanup;
     }
 
-    printf("%s Setting page descriptors...\n", SYNTHXEX_PRINT_STEM);
-    ret = setPageDescriptors(basefile, peData, secInfoHeader);
-
-    if(ret != SUCCESS)
+    // Part of a parallel build, so take turns with everything else make is running rather than adding to it.
+    // The server's not tied to any one build, and a client leaves the work to the server.
+    if(serverPath == NULL && clientPath == NULL && connectJobServer(&jobServer))
     {
-        handleError(ret);
-        freeAllMainStructs(&offsets, &xexHeader, &secInfoHeader, &peData, &optHeaderEntries, &optHeaders);
-        fclose(basefile);
-        fclose(xex);
-        return -1;
+        options.jobServer = &jobServer;
+
+        if(!jobsGiven)
+        { options.jobs = getProcessorCount(); }
     }
 
-    // Done with this now
-    freeSectionsStruct(&(peData->sections));
+    if(serverPath != NULL)
+    {
+        printf("%s Serving conversions on %s...\n", SYNTHXEX_PRINT_STEM, serverPath);
+        fflush(stdout); // Runs until killed, so make sure this gets out
+        ret = runServer(serverPath, &options);
 
-    printf("%s Building optional headers...\n", SYNTHXEX_PRINT_STEM);
-    ret = setOptHeaders(secInfoHeader, peData, optHeaderEntries, optHeaders);
+        if(ret != SUCCESS)
+        {
+            if(ret == ERR_SOCKET)
+            { printf("%s ERROR: Failed to listen on %s. Is another server using it? Aborting.\n", SYNTHXEX_PRINT_STEM, serverPath); }
+            else
+            { handleError(ret); }
 
-    if(ret != SUCCESS)
-    {
-        handleError(ret);
-        freeAllMainStructs(&offsets, &xexHeader, &secInfoHeader, &peData, &optHeaderEntries, &optHeaders);
-        fclose(basefile);
-        fclose(xex);
-        return -1;
-    }
+            ret = -1;
+        }
 
-    printf("%s Building XEX header...\n", SYNTHXEX_PRINT_STEM);
-    ret = setXEXHeader(xexHeader, optHeaderEntries, peData);
+        goto cleanup;
+    }
 
-    if(ret != SUCCESS)
+    // A manifest, or more than one input, makes this a batch. So does handing the work to a server.
+    if(manifestPath != NULL || clientPath != NULL || peCount > 1 || xexCount > 1)
     {
-        handleError(ret);
-        freeAllMainStructs(&offsets, &xexHeader, &secInfoHeader, &peData, &optHeaderEntries, &optHeaders);
-        fclose(basefile);
-        fclose(xex);
-        return -1;
-    }
+        if(peCount != xexCount)
+        {
+            printf("%s ERROR: Got %u inputs but %u outputs, each input needs an output. Aborting.\n",
+                   SYNTHXEX_PRINT_STEM, peCount, xexCount);
+            ret = -1;
+            goto cleanup;
+        }
 
-    // Done with this now
-    freePeImportInfoStruct(&(peData->peImportInfo));
+        struct batchEntry *entries = NULL;
+        uint32_t entryCount = 0;
+        uint32_t badLine = 0;
 
-    // Setting data positions
-    printf("%s Aligning data...\n", SYNTHXEX_PRINT_STEM);
-    ret = placeStructs(offsets, xexHeader, optHeaderEntries, secInfoHeader, optHeaders);
+        if(manifestPath != NULL)
+        { ret = readBatchManifest(manifestPath, &entries, &entryCount, &badLine); }
 
-    if(ret != SUCCESS)
-    {
-        handleError(ret);
-        freeAllMainStructs(&offsets, &xexHeader, &secInfoHeader, &peData, &optHeaderEntries, &optHeaders);
-        fclose(basefile);
-        fclose(xex);
-        return -1;
-    }
+        for(uint32_t i = 0; i < peCount && ret == SUCCESS; i++)
+        { ret = addBatchEntry(&entries, &entryCount, pePaths[i], xexfilePaths[i], 0); }
+
+        if(ret == ERR_INVALID_MANIFEST)
+        {
+            printf("%s ERROR: Invalid entry on line %u of batch manifest (expected <input><TAB><output>[<TAB><type>]). Aborting.\n",
+                   SYNTHXEX_PRINT_STEM, badLine);
+        }
+        else if(ret == ERR_FILE_OPEN)
+        { printf("%s ERROR: Failed to open batch manifest. Do you have read permissions? Aborting.\n", SYNTHXEX_PRINT_STEM); }
+        else if(ret != SUCCESS)
+        { handleError(ret); }
+        else if(entryCount == 0)
+        {
+            if(manifestPath != NULL)
+            { printf("%s ERROR: Batch manifest has no entries. Aborting.\n", SYNTHXEX_PRINT_STEM); }
+            else
+            { printf("%s ERROR: PE input expected but not found. Aborting.\n", SYNTHXEX_PRINT_STEM); }
+
+            ret = -1;
+        }
+        else
+        {
+            uint32_t failed = 0;
+
+            if(clientPath != NULL)
+            { ret = runClient(clientPath, entries, entryCount, &options, &failed); }
+            else
+            { failed = runBatch(entries, entryCount, &options); }
+
+            if(ret != SUCCESS)
+            {
+                printf("%s ERROR: Failed to connect to a server on %s. Is it running? Aborting.\n", SYNTHXEX_PRINT_STEM, clientPath);
+                failed = entryCount;
+            }
+            else
+            {
+                printf("\n%s Built %u of %u XEX files.%s\n\n", SYNTHXEX_PRINT_STEM, entryCount - failed, entryCount,
+                       (failed == 0) ? " Have a nice day!" : "");
+            }
+
+            ret = (failed == 0) ? SUCCESS : -1;
+        }
 
-    // We're done with this now
-    freePeDataStruct(&peData);
+        freeBatchEntries(&entries, entryCount);
 
-    // Write out all of the XEX data to file
-    printf("%s Writing XEX...\n", SYNTHXEX_PRINT_STEM);
-    ret = writeXEX(xexHeader, optHeaderEntries, secInfoHeader, optHeaders, offsets, basefile, xex);
+        if(ret != SUCCESS)
+        { ret = -1; }
 
-    if(ret != SUCCESS)
+        goto cleanup;
+    }
+
+    if(peCount == 0)
     {
-        handleError(ret);
-        freeAllMainStructs(&offsets, &xexHeader, &secInfoHeader, &peData, &optHeaderEntries, &optHeaders);
-        fclose(basefile);
-        fclose(xex);
-        return -1;
+        printf("%s ERROR: PE input expected but not found. Aborting.\n", SYNTHXEX_PRINT_STEM);
+        ret = -1;
+        goto cleanup;
+    }
+    else if(xexCount == 0)
+    {
+        printf("%s ERROR: XEX file output expected but not found. Aborting.\n", SYNTHXEX_PRINT_STEM);
+        ret = -1;
+        goto cleanup;
     }
 
-    // Final pass (sets & writes header hash)
-    printf("%s Calculating and writing header SHA1...\n", SYNTHXEX_PRINT_STEM);
-    ret = setHeaderSha1(xex);
+    ret = convertPE(pePaths[0], xexfilePaths[0], &options);
 
     if(ret != SUCCESS)
     {
         handleError(ret);
-        freeAllMainStructs(&offsets, &xexHeader, &secInfoHeader, &peData, &optHeaderEntries, &optHeaders);
-        fclose(basefile);
-        fclose(xex);
-        return -1;
+        ret = -1;
+        goto cleanup;
     }
 
-    printf("%s Header SHA1 written!\n", SYNTHXEX_PRINT_STEM);
+    // Variants share everything with the XEX just built besides a few header fields, so they're made from it
+    for(uint32_t i = 0; i < variantCount; i++)
+    {
+        printf("%s Writing variant %s...\n", SYNTHXEX_PRINT_STEM, variants[i].xexfilePath);
+        ret = writeXEXVariant(xexfilePaths[0], &(variants[i]));
 
-    // Free files
-    fclose(xex);
-    fclose(basefile);
-    // Free structs
-    freeAllMainStructs(&offsets, &xexHeader, &secInfoHeader, &peData, &optHeaderEntries, &optHeaders);
+        if(ret != SUCCESS)
+        {
+            handleError(ret);
+            ret = -1;
+            goto cleanup;
+        }
+    }
 
     printf("%s XEX built. Have a nice day!\n\n", SYNTHXEX_PRINT_STEM);
-    return SUCCESS;
+
+cleanup:
+    disconnectJobServer(&jobServer);
+    nullAndFree((void **)&pePaths);
+    nullAndFree((void **)&xexfilePaths);
+    nullAndFree((void **)&variants);
+    return ret;
 }
@@ -0,0 +1,511 @@
+// This file is part of SynthXEX, one component of the
+// OpenXeChain development toolchain
+//
+// Copyright (c) 2025 Aiden Isik
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "xexpatch.h"
+
+// One of the old basefile's blocks, for finding where a new block's contents were before
+struct patchBlock
+{
+    uint64_t fingerprint;
+    uint32_t index;
+};
+
+// A run of new basefile blocks being gathered up before it's written to the patch
+struct patchRun
+{
+    bool literal;
+    uint32_t start; // First new block
+    uint32_t count;
+    uint32_t source; // First old block, if copying
+};
+
+// The header's kept in host byte order, this swaps it to or from the patch's
+void swapXEXPatchHeader(struct xexPatchHeader *header)
+{
+#ifdef LITTLE_ENDIAN_SYSTEM
+    header->version = __builtin_bswap32(header->version);
+    header->blockSize = __builtin_bswap32(header->blockSize);
+    header->oldSize = __builtin_bswap32(header->oldSize);
+    header->newSize = __builtin_bswap32(header->newSize);
+    header->headerSize = __builtin_bswap32(header->headerSize);
+#else
+    (void)header;
+#endif
+}
+
+// Finds where a XEX's headers end (so where it's basefile starts), and the hash of them
+int getXEXLayout(const struct mappedFile *xex, uint32_t *headerSize, const uint8_t **headersHash)
+{
+    const uint8_t *xexHeader = getSpan(xex, 0, sizeof(struct xexHeader));
+
+    if(xexHeader == NULL || memcmp(xexHeader, "XEX2", 4) != 0 || xex->size > UINT32_MAX)
+    { return ERR_INVALID_XEX; }
+
+    *headerSize = get32BitBE(xexHeader + 0x08);
+    uint32_t secInfoOffset = get32BitBE(xexHeader + 0x10);
+
+    if(*headerSize > xex->size || secInfoOffset < sizeof(struct xexHeader) || secInfoOffset > *headerSize
+            || *headerSize - secInfoOffset < SEC_INFO_MIN_SIZE)
+    { return ERR_INVALID_XEX; }
+
+    *headersHash = xex->data + secInfoOffset + SEC_INFO_HEADERS_HASH_OFFSET;
+    return SUCCESS;
+}
+
+// Patches are made from the bytes stored, so a change anywhere in an LZX compressed or encrypted
+// basefile alters everything after it (or all of it, with a new random key), leaving nothing to reuse
+bool isXEXBasefileDiffable(const struct mappedFile *xex, uint32_t headerSize)
+{
+    const uint8_t *headers = getSpan(xex, 0, headerSize);
+    uint32_t optHeaderCount = get32BitBE(headers + 0x14);
+
+    if(optHeaderCount > (headerSize - sizeof(struct xexHeader)) / sizeof(struct optHeaderEntry))
+    { return false; }
+
+    for(uint32_t i = 0; i < optHeaderCount; i++)
+    {
+        const uint8_t *entry = headers + sizeof(struct xexHeader) + i * sizeof(struct optHeaderEntry);
+
+        if(get32BitBE(entry) != XEX_OPT_ID_BASEFILE_FORMAT)
+        { continue; }
+
+        uint32_t formatOffset = get32BitBE(entry + 0x4);
+
+        if(formatOffset > headerSize || headerSize - formatOffset < 8)
+        { return false; }
+
+        uint32_t types = get32BitBE(headers + formatOffset + 4); // Encryption type, then compression type
+        return (types >> 16) == XEX_ENC_NONE && (types & 0xFFFF) != XEX_COMP_NORMAL;
+    }
+
+    return false;
+}
+
+int comparePatchBlocks(const void *a, const void *b)
+{
+    const struct patchBlock *blockA = a;
+    const struct patchBlock *blockB = b;
+
+    if(blockA->fingerprint != blockB->fingerprint)
+    { return (blockA->fingerprint < blockB->fingerprint) ? -1 : 1; }
+
+    if(blockA->index != blockB->index)
+    { return (blockA->index < blockB->index) ? -1 : 1; }
+
+    return 0;
+}
+
+// Looks for data (a whole block) anywhere in the old basefile, for when it's moved
+bool findOldBlock(const struct patchBlock *blocks, uint32_t blockCount, const uint8_t *oldBasefile, const uint8_t *data, uint32_t *index)
+{
+    uint64_t fingerprint = fingerprintData(data, XEX_PATCH_BLOCK_SIZE);
+    uint32_t low = 0;
+    uint32_t high = blockCount;
+
+    // First block with this fingerprint, then the ones after it until one actually matches
+    while(low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+
+        if(blocks[middle].fingerprint < fingerprint)
+        { low = middle + 1; }
+        else
+        { high = middle; }
+    }
+
+    for(; low < blockCount && blocks[low].fingerprint == fingerprint; low++)
+        if(memcmp(oldBasefile + (uint64_t)blocks[low].index * XEX_PATCH_BLOCK_SIZE, data, XEX_PATCH_BLOCK_SIZE) == 0)
+        {
+            *index = blocks[low].index;
+            return true;
+        }
+
+    return false;
+}
+
+int writePatchRun(FILE *patch, const struct patchRun *run, const uint8_t *newBasefile, uint32_t newBasefileSize)
+{
+    uint8_t info[8];
+    put32BitBE(info, run->count | (run->literal ? XEX_PATCH_RUN_LITERAL : 0));
+
+    if(run->literal)
+    {
+        uint64_t offset = (uint64_t)run->start * XEX_PATCH_BLOCK_SIZE;
+        uint64_t length = (uint64_t)run->count * XEX_PATCH_BLOCK_SIZE;
+
+        if(length > newBasefileSize - offset)
+        { length = newBasefileSize - offset; }
+
+        if(fwrite(info, sizeof(uint8_t), sizeof(uint32_t), patch) != sizeof(uint32_t)
+                || fwrite(newBasefile + offset, sizeof(uint8_t), length, patch) != length)
+        { return ERR_FILE_WRITE; }
+
+        return SUCCESS;
+    }
+
+    put32BitBE(info + 4, run->source);
+
+    if(fwrite(info, sizeof(uint8_t), sizeof(info), patch) != sizeof(info))
+    { return ERR_FILE_WRITE; }
+
+    return SUCCESS;
+}
+
+// Writes the patch taking oldXex to newXex into patch. Each new basefile block is looked for in the same place
+// in the old one, then following on from the last block found, then anywhere (by fingerprint). The page hashes
+// in the security info can't do this, each one covers the next page's hash too, so one change alters all before it.
+int writeXEXPatch(const struct mappedFile *oldXex, const struct mappedFile *newXex, FILE *patch)
+{
+    struct xexPatchHeader header;
+    const uint8_t *oldHeadersHash = NULL;
+    const uint8_t *newHeadersHash = NULL;
+    uint32_t oldHeaderSize = 0;
+    uint32_t newHeaderSize = 0;
+    int ret = getXEXLayout(oldXex, &oldHeaderSize, &oldHeadersHash);
+
+    if(ret == SUCCESS)
+    { ret = getXEXLayout(newXex, &newHeaderSize, &newHeadersHash); }
+
+    if(ret != SUCCESS)
+    { return ret; }
+
+    if(!isXEXBasefileDiffable(newXex, newHeaderSize))
+    { return ERR_PATCH_UNDIFFABLE; }
+
+    memcpy(header.magic, XEX_PATCH_MAGIC, sizeof(header.magic));
+    header.version = XEX_PATCH_VERSION;
+    header.blockSize = XEX_PATCH_BLOCK_SIZE;
+    header.oldSize = (uint32_t)oldXex->size;
+    header.newSize = (uint32_t)newXex->size;
+    header.headerSize = newHeaderSize;
+    memcpy(header.oldHeadersHash, oldHeadersHash, sizeof(header.oldHeadersHash));
+
+    struct sha1_ctx sha1;
+    sha1_init(&sha1);
+    sha1_update(&sha1, newXex->size, newXex->data);
+    sha1_digest(&sha1, sizeof(header.newSha1), header.newSha1);
+
+    const uint8_t *oldBasefile = oldXex->data + oldHeaderSize;
+    const uint8_t *newBasefile = newXex->data + header.headerSize;
+    uint32_t newBasefileSize = header.newSize - header.headerSize;
+    uint32_t oldBlockCount = (header.oldSize - oldHeaderSize) / XEX_PATCH_BLOCK_SIZE; // Whole blocks only
+    uint32_t newBlockCount = getNextAligned(newBasefileSize, XEX_PATCH_BLOCK_SIZE) / XEX_PATCH_BLOCK_SIZE;
+
+    // One extra, so there's something to allocate with no old blocks
+    struct patchBlock *blocks = malloc((oldBlockCount + 1) * sizeof(struct patchBlock));
+
+    if(blocks == NULL)
+    { return ERR_OUT_OF_MEM; }
+
+    for(uint32_t i = 0; i < oldBlockCount; i++)
+    {
+        blocks[i].fingerprint = fingerprintData(oldBasefile + (uint64_t)i * XEX_PATCH_BLOCK_SIZE, XEX_PATCH_BLOCK_SIZE);
+        blocks[i].index = i;
+    }
+
+    qsort(blocks, oldBlockCount, sizeof(struct patchBlock), comparePatchBlocks);
+
+    struct xexPatchHeader headerOut = header;
+    swapXEXPatchHeader(&headerOut);
+
+    if(fwrite(&headerOut, sizeof(struct xexPatchHeader), 1, patch) != 1
+            || fwrite(newXex->data, sizeof(uint8_t), header.headerSize, patch) != header.headerSize)
+    { ret = ERR_FILE_WRITE; }
+
+    struct patchRun run = { true, 0, 0, 0 };
+
+    for(uint32_t i = 0; i < newBlockCount && ret == SUCCESS; i++)
+    {
+        const uint8_t *data = newBasefile + (uint64_t)i * XEX_PATCH_BLOCK_SIZE;
+        bool found = false;
+        uint32_t source = 0;
+
+        // A short last block is always sent as is
+        if(newBasefileSize - (uint64_t)i * XEX_PATCH_BLOCK_SIZE >= XEX_PATCH_BLOCK_SIZE)
+        {
+            uint32_t following = run.source + run.count;
+
+            if(!run.literal && following < oldBlockCount
+                    && memcmp(oldBasefile + (uint64_t)following * XEX_PATCH_BLOCK_SIZE, data, XEX_PATCH_BLOCK_SIZE) == 0)
+            {
+                found = true;
+                source = following;
+            }
+            else if(i < oldBlockCount && memcmp(oldBasefile + (uint64_t)i * XEX_PATCH_BLOCK_SIZE, data, XEX_PATCH_BLOCK_SIZE) == 0)
+            {
+                found = true;
+                source = i;
+            }
+            else
+            { found = findOldBlock(blocks, oldBlockCount, oldBasefile, data, &source); }
+        }
+
+        // Carry on with the current run if this block fits on the end of it
+        if(run.count > 0 && run.count < XEX_PATCH_RUN_MAX_BLOCKS && run.literal == !found
+                && (run.literal || source == run.source + run.count))
+        {
+            run.count++;
+            continue;
+        }
+
+        if(run.count > 0)
+        { ret = writePatchRun(patch, &run, newBasefile, newBasefileSize); }
+
+        run.literal = !found;
+        run.start = i;
+        run.count = 1;
+        run.source = source;
+    }
+
+    if(run.count > 0 && ret == SUCCESS)
+    { ret = writePatchRun(patch, &run, newBasefile, newBasefileSize); }
+
+    nullAndFree((void **)&blocks);
+    return ret;
+}
+
+// A XEX starts with it's magic, anything else is taken to be a PE
+bool isXEXFile(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+
+    if(file == NULL)
+    { return false; }
+
+    char magic[4];
+    bool isXEX = (fread(magic, sizeof(char), sizeof(magic), file) == sizeof(magic) && memcmp(magic, "XEX2", sizeof(magic)) == 0);
+    fclose(file);
+    return isXEX;
+}
+
+// Makes a patch taking the XEX at oldPath to the one at newPath. newPath can also be a PE, which is converted
+// (with options) to a temporary XEX next to the patch first. That's thrown away afterwards, so it isn't cached,
+// updated in place or given a hash cache (which would be left behind under it's temporary name).
+int makeXEXPatch(const char *oldPath, const char *newPath, const char *patchPath, const struct convertOptions *options)
+{
+    char *builtPath = NULL;
+    int ret = SUCCESS;
+
+    if(!isXEXFile(newPath))
+    {
+        struct convertOptions buildOptions = *options;
+        buildOptions.incremental = false;
+        buildOptions.update = false;
+        buildOptions.cacheDir = NULL;
+        buildOptions.cacheLink = false;
+
+        ret = getTempPath(patchPath, &builtPath);
+
+        if(ret == SUCCESS)
+        { ret = convertPE(newPath, builtPath, &buildOptions); }
+
+        if(ret != SUCCESS)
+        {
+            if(builtPath != NULL)
+            { remove(builtPath); }
+
+            nullAndFree((void **)&builtPath);
+            return ret;
+        }
+
+        newPath = builtPath;
+    }
+
+    struct mappedFile oldXex;
+    struct mappedFile newXex;
+    memset(&newXex, 0, sizeof(newXex));
+    char *tempPath = NULL;
+    FILE *patch = NULL;
+
+    ret = mapInputFile(oldPath, &oldXex);
+
+    if(ret == SUCCESS)
+    { ret = mapInputFile(newPath, &newXex); }
+
+    if(ret == SUCCESS)
+    { ret = getTempPath(patchPath, &tempPath); }
+
+    if(ret == SUCCESS)
+    {
+        patch = fopen(tempPath, "wb");
+
+        if(patch == NULL)
+        { ret = ERR_FILE_OPEN; }
+    }
+
+    if(ret == SUCCESS)
+    { ret = writeXEXPatch(&oldXex, &newXex, patch); }
+
+    if(patch != NULL && fclose(patch) != 0 && ret == SUCCESS)
+    { ret = ERR_FILE_WRITE; }
+
+    if(ret == SUCCESS)
+    { ret = replaceFile(tempPath, patchPath); }
+    else if(patch != NULL)
+    { remove(tempPath); }
+
+    freeMappedFileStruct(&oldXex);
+    freeMappedFileStruct(&newXex);
+    nullAndFree((void **)&tempPath);
+
+    if(builtPath != NULL)
+    { remove(builtPath); }
+
+    nullAndFree((void **)&builtPath);
+    return ret;
+}
+
+// Rebuilds the new XEX from oldXex and patch into file, checking the result is what the patch was made from
+int writePatchedXEX(const struct mappedFile *oldXex, const struct mappedFile *patch, FILE *file)
+{
+    const uint8_t *headerIn = getSpan(patch, 0, sizeof(struct xexPatchHeader));
+
+    if(headerIn == NULL)
+    { return ERR_INVALID_PATCH; }
+
+    struct xexPatchHeader header;
+    memcpy(&header, headerIn, sizeof(header));
+    swapXEXPatchHeader(&header);
+
+    if(memcmp(header.magic, XEX_PATCH_MAGIC, sizeof(header.magic)) != 0 || header.version != XEX_PATCH_VERSION
+            || header.blockSize == 0 || header.headerSize > header.newSize)
+    { return ERR_INVALID_PATCH; }
+
+    const uint8_t *oldHeadersHash = NULL;
+    uint32_t oldHeaderSize = 0;
+    int ret = getXEXLayout(oldXex, &oldHeaderSize, &oldHeadersHash);
+
+    if(ret != SUCCESS)
+    { return ret; }
+
+    if(oldXex->size != header.oldSize || memcmp(oldHeadersHash, header.oldHeadersHash, sizeof(header.oldHeadersHash)) != 0)
+    { return ERR_PATCH_MISMATCH; }
+
+    struct sha1_ctx sha1;
+    sha1_init(&sha1);
+    uint64_t position = sizeof(struct xexPatchHeader);
+    uint64_t written = 0;
+
+    const uint8_t *data = getSpan(patch, position, header.headerSize);
+    uint64_t length = header.headerSize;
+    position += header.headerSize;
+
+    while(true)
+    {
+        if(data == NULL)
+        { return ERR_INVALID_PATCH; }
+
+        if(fwrite(data, sizeof(uint8_t), length, file) != length)
+        { return ERR_FILE_WRITE; }
+
+        sha1_update(&sha1, length, data);
+        written += length;
+
+        if(written == header.newSize)
+        { break; }
+
+        const uint8_t *info = getSpan(patch, position, sizeof(uint32_t));
+
+        if(info == NULL)
+        { return ERR_INVALID_PATCH; }
+
+        uint32_t count = get32BitBE(info) & XEX_PATCH_RUN_MAX_BLOCKS;
+        bool literal = (get32BitBE(info) & XEX_PATCH_RUN_LITERAL) != 0;
+        position += sizeof(uint32_t);
+
+        // Only the last run can stop short of it's blocks, at the end of the XEX
+        if(count == 0 || (uint64_t)(count - 1) * header.blockSize >= header.newSize - written)
+        { return ERR_INVALID_PATCH; }
+
+        length = (uint64_t)count * header.blockSize;
+
+        if(length > header.newSize - written)
+        { length = header.newSize - written; }
+
+        if(literal)
+        {
+            data = getSpan(patch, position, length);
+            position += length;
+        }
+        else
+        {
+            info = getSpan(patch, position, sizeof(uint32_t));
+
+            if(info == NULL)
+            { return ERR_INVALID_PATCH; }
+
+            data = getSpan(oldXex, oldHeaderSize + (uint64_t)get32BitBE(info) * header.blockSize, length);
+            position += sizeof(uint32_t);
+        }
+    }
+
+    if(position != patch->size)
+    { return ERR_INVALID_PATCH; }
+
+    uint8_t newSha1[0x14];
+    sha1_digest(&sha1, sizeof(newSha1), newSha1);
+
+    // The headers hash matched, so this means the old basefile didn't match them
+    if(memcmp(newSha1, header.newSha1, sizeof(newSha1)) != 0)
+    { return ERR_PATCH_MISMATCH; }
+
+    return SUCCESS;
+}
+
+// Rebuilds the XEX a patch was made to from the one it was made from. newPath can be the same as oldPath,
+// the new XEX is put together in a temporary file and only replaces anything once it's checked.
+int applyXEXPatch(const char *oldPath, const char *patchPath, const char *newPath)
+{
+    struct mappedFile oldXex;
+    struct mappedFile patch;
+    memset(&patch, 0, sizeof(patch));
+    char *tempPath = NULL;
+    FILE *file = NULL;
+
+    int ret = mapInputFile(oldPath, &oldXex);
+
+    if(ret == SUCCESS)
+    { ret = mapInputFile(patchPath, &patch); }
+
+    if(ret == SUCCESS)
+    { ret = getTempPath(newPath, &tempPath); }
+
+    if(ret == SUCCESS)
+    {
+        file = fopen(tempPath, "wb");
+
+        if(file == NULL)
+        { ret = ERR_FILE_OPEN; }
+    }
+
+    if(ret == SUCCESS)
+    { ret = writePatchedXEX(&oldXex, &patch, file); }
+
+    if(file != NULL && fclose(file) != 0 && ret == SUCCESS)
+    { ret = ERR_FILE_WRITE; }
+
+    if(ret == SUCCESS)
+    { ret = replaceFile(tempPath, newPath); }
+    else if(file != NULL)
+    { remove(tempPath); }
+
+    freeMappedFileStruct(&oldXex);
+    freeMappedFileStruct(&patch);
+    nullAndFree((void **)&tempPath);
+    return ret;
+}
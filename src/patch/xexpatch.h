@@ -0,0 +1,58 @@
+// This file is part of SynthXEX, one component of the
+// OpenXeChain development toolchain
+//
+// Copyright (c) 2025 Aiden Isik
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "../common/common.h"
+#include "../common/crypto.h"
+#include "../common/datastorage.h"
+#include "../cache/hashcache.h"
+#include "../cache/outputcache.h"
+#include "../convert/convert.h"
+#include "../edit/editxex.h"
+
+// A delta patch takes one XEX to another. It holds the new XEX's headers (which include the page descriptors)
+// in full, then rebuilds the basefile from blocks of the old one where they're unchanged, and new data where not.
+// Everything in it is big endian, like the XEX itself.
+#define XEX_PATCH_MAGIC "XEXP"
+#define XEX_PATCH_VERSION 1
+
+// The smaller of the two XEX page sizes, so changing a byte of a 64KiB page title doesn't cost the whole page
+#define XEX_PATCH_BLOCK_SIZE 0x1000
+
+// After the header come the new headers, then runs of blocks until the new basefile is complete. Each run
+// starts with a word giving it's block count, with XEX_PATCH_RUN_LITERAL set if the blocks follow (the last
+// block of the XEX may be short). Otherwise, the next word is the index of the old basefile block to copy from.
+#define XEX_PATCH_RUN_LITERAL 0x80000000
+#define XEX_PATCH_RUN_MAX_BLOCKS 0x7FFFFFFF
+
+struct __attribute__((packed)) xexPatchHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t blockSize;
+    uint32_t oldSize;
+    uint32_t newSize;
+    uint32_t headerSize; // Of the new XEX, i.e. where it's basefile starts
+    uint8_t oldHeadersHash[0x14]; // From the old XEX's security info, identifying it without reading it all
+    uint8_t newSha1[0x14]; // Of the whole new XEX, checked once it's rebuilt
+};
+
+bool isXEXFile(const char *path);
+int makeXEXPatch(const char *oldPath, const char *newPath, const char *patchPath, const struct convertOptions *options);
+int applyXEXPatch(const char *oldPath, const char *patchPath, const char *newPath);
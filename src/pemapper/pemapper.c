@@ -18,185 +18,123 @@
 
 #include "pemapper.h"
 
-struct sectionInfo
-{
-    uint32_t virtualSize;
-    uint32_t rva;
-    uint32_t rawSize;
-    uint32_t offset;
-};
-
 // Strips the ordinal flags from IAT entries, and swaps them to big endian
 // Also adds module indexes to them
-int xenonifyIAT(FILE *basefile, struct peData *peData)
+int xenonifyIAT(struct basefile *basefile, struct peData *peData)
 {
     // Loop through each import table and handle their IAT entries
     for(uint32_t i = 0; i < peData->peImportInfo.tableCount; i++)
     {
-        // Seek to the first IAT entry for this table
-        if(fseek(basefile, peData->peImportInfo.tables[i].rva, SEEK_SET) != 0)
-        { return ERR_FILE_READ; }
-
         // Loop through each import and handle it's IAT entry
         for(uint32_t j = 0; j < peData->peImportInfo.tables[i].importCount; j++)
         {
-            // Read in the current IAT entry
-            uint32_t iatEntry = get32BitFromPE(basefile);
+            uint64_t entryOffset = (uint64_t)peData->peImportInfo.tables[i].rva + (j * sizeof(uint32_t));
+
+            if(entryOffset + sizeof(uint32_t) > basefile->size)
+            { return ERR_INVALID_RVA_OR_OFFSET; }
+
+            // Read in the current IAT entry (little endian)
+            uint32_t iatEntry;
+            memcpy(&iatEntry, basefile->data + entryOffset, sizeof(uint32_t));
 
-            if(errno != SUCCESS)
-            { return ERR_FILE_READ; }
+#ifdef BIG_ENDIAN_SYSTEM
+            iatEntry = __builtin_bswap32(iatEntry);
+#endif
 
             // If we're importing by name, get the ordinal from the hint and overwrite the name RVA
             if(!(iatEntry & PE_IMPORT_ORDINAL_FLAG))
             {
-                // Seek to the RVA of the import name
-                uint32_t pos = ftell(basefile) - 0x4;
-
-                if(fseek(basefile, iatEntry, SEEK_SET) != 0)
-                { return ERR_FILE_READ; }
+                if((uint64_t)iatEntry + sizeof(uint16_t) > basefile->size)
+                { return ERR_INVALID_RVA_OR_OFFSET; }
 
                 // Grab the ordinal from the start of the name
-                iatEntry = get16BitFromPE(basefile);
+                uint16_t hint;
+                memcpy(&hint, basefile->data + iatEntry, sizeof(uint16_t));
 
-                if(errno != SUCCESS)
-                { return ERR_FILE_READ; }
+#ifdef BIG_ENDIAN_SYSTEM
+                hint = __builtin_bswap16(hint);
+#endif
 
-                // Seek back to the entry to write
-                fseek(basefile, pos, SEEK_SET);
+                iatEntry = hint;
             }
             else
             {
-                // Seek back so we can write back to the same place
-                if(fseek(basefile, -0x4, SEEK_CUR) != 0)
-                { return ERR_FILE_READ; }
-
                 iatEntry &= ~PE_IMPORT_ORDINAL_FLAG; // Strip the import by ordinal flag
             }
 
             iatEntry |= (i & 0x000000FF) << 16; // Add the module index
 
-            // Write back out as big endian (TODO: make a utility function for this like get32BitFromPE)
+            // Write back out as big endian
 #ifdef LITTLE_ENDIAN_SYSTEM
             iatEntry = __builtin_bswap32(iatEntry);
 #endif
 
-            if(fwrite(&iatEntry, sizeof(uint32_t), 1, basefile) < 1)
-            { return ERR_FILE_WRITE; }
-
-            // Call file positioning function between reads and writes to the same file.
-            // This is mandated by the C standard.
-            fseek(basefile, 0, SEEK_CUR);
+            memcpy(basefile->data + entryOffset, &iatEntry, sizeof(uint32_t));
         }
     }
 
     return SUCCESS;
 }
 
-// Maps the PE file into the basefile (RVAs become offsets)
-int mapPEToBasefile(FILE *pe, FILE *basefile, struct peData *peData)
+// Works out how big the basefile will be, from the section table alone
+int getBasefileSize(const struct peData *peData, uint32_t *size)
 {
-    // Retrieve the section info from PE (TODO: use the data we get from getHdrData for this, right now we're duplicating work)
-    struct sectionInfo *sectionInfo = malloc(peData->numberOfSections *sizeof(struct sectionInfo));
-
-    if(!sectionInfo)
-    { return ERR_OUT_OF_MEM; }
+    const struct section *section = peData->sections.section;
 
-    // Seek to the first section in the section table at virtualSize
-    if(fseek(pe, (peData->headerSize - 1) + 0x8, SEEK_SET) != 0)
-    { return ERR_FILE_READ; }
+    // The basefile runs up to the end of the furthest section, padded out to a whole page
+    uint64_t end = peData->headerSize + peData->sectionTableSize;
 
     for(uint16_t i = 0; i < peData->numberOfSections; i++)
     {
-        sectionInfo[i].virtualSize = get32BitFromPE(pe);
-
-        if(errno != SUCCESS)
-        { return errno; }
-
-        sectionInfo[i].rva = get32BitFromPE(pe);
-
-        if(errno != SUCCESS)
-        { return errno; }
+        if((uint64_t)section[i].rva + section[i].rawSize > end)
+        { end = (uint64_t)section[i].rva + section[i].rawSize; }
+    }
 
-        sectionInfo[i].rawSize = get32BitFromPE(pe);
+    if(end > UINT32_MAX - peData->pageSize)
+    { return ERR_DATA_OVERFLOW; }
 
-        if(errno != SUCCESS)
-        { return errno; }
+    *size = getNextAligned(end, peData->pageSize);
+    return SUCCESS;
+}
 
-        sectionInfo[i].offset = get32BitFromPE(pe);
+// Maps the PE file into the basefile (RVAs become offsets)
+int mapPEToBasefile(struct mappedFile *pe, struct basefile *basefile, struct peData *peData, uint64_t memLimit)
+{
+    struct section *section = peData->sections.section;
+    size_t totalHeader = peData->headerSize + peData->sectionTableSize;
+    uint32_t size = 0;
+    int ret = getBasefileSize(peData, &size);
 
-        if(errno != SUCCESS)
-        { return errno; }
+    if(ret != SUCCESS)
+    { return ret; }
 
-        // Seek to the next entry at virtualSize
-        if(fseek(pe, 0x18, SEEK_CUR) != 0)
-        { return ERR_FILE_READ; }
-    }
+    // The basefile starts out zeroed, so any gaps and the padding at the end are taken care of
+    ret = createBasefile(basefile, size, memLimit);
 
-    if(fseek(pe, 0, SEEK_SET) != 0)
-    { return ERR_FILE_READ; }
+    if(ret != SUCCESS)
+    { return ret; }
 
     // Copy the PE header and section table to the basefile verbatim
-    uint8_t *buffer = malloc(peData->headerSize + peData->sectionTableSize);
-
-    if(!buffer)
-    { return ERR_OUT_OF_MEM; }
-
-    size_t totalHeader = peData->headerSize + peData->sectionTableSize;
+    const uint8_t *span = getSpan(pe, 0, totalHeader);
 
-    if(fread(buffer, 1, totalHeader, pe) != totalHeader)
+    if(span == NULL)
     { return ERR_FILE_READ; }
 
-    if(fwrite(buffer, 1, totalHeader, basefile) != totalHeader)
-    { return ERR_FILE_READ; }
+    memcpy(basefile->data, span, totalHeader);
 
-    // Now map the sections and write them
+    // Now map the sections
     for(uint16_t i = 0; i < peData->numberOfSections; i++)
     {
-        buffer = realloc(buffer, sectionInfo[i].rawSize);
-
-        if(!buffer)
-        { return ERR_OUT_OF_MEM; }
-
-        if(fseek(pe, sectionInfo[i].offset, SEEK_SET) != 0)
-        { return ERR_FILE_READ; }
-
-        if(fread(buffer, 1, sectionInfo[i].rawSize, pe) != sectionInfo[i].rawSize)
-        { return ERR_FILE_READ; }
-
-        if(fseek(basefile, sectionInfo[i].rva, SEEK_SET) != 0)
-        { return ERR_FILE_READ; }
-
-        if(fwrite(buffer, 1, sectionInfo[i].rawSize, basefile) != sectionInfo[i].rawSize)
-        { return ERR_FILE_READ; }
-    }
-
-    // Pad the rest of the final page with zeroes, we can achieve this by seeking
-    // to the end and placing a single zero there (unless the data runs all the way up to the end!)
-    uint32_t currentOffset = ftell(basefile);
-    uint32_t nextAligned = getNextAligned(currentOffset, peData->pageSize) - 1;
-
-    if(nextAligned != currentOffset)
-    {
-        buffer = realloc(buffer, 1);
-
-        if(!buffer)
-        { return ERR_OUT_OF_MEM; }
+        span = getSpan(pe, section[i].offset, section[i].rawSize);
 
-        buffer[0] = 0;
-
-        if(fseek(basefile, nextAligned, SEEK_SET) != 0)
+        if(span == NULL)
         { return ERR_FILE_READ; }
 
-        if(fwrite(buffer, 1, 1, basefile) != 1)
-        { return ERR_FILE_READ; }
+        memcpy(basefile->data + section[i].rva, span, section[i].rawSize);
     }
 
     // Make sure to update the PE (basefile) size
-    peData->size = ftell(basefile);
-
-    // We're done with these now, free them
-    nullAndFree((void **)&buffer);
-    nullAndFree((void **)&sectionInfo);
+    peData->size = basefile->size;
 
     // While we're writing the basefile, let's do the required modifications to the IAT.
     // We can skip the return check because this is the last function call.
@@ -21,4 +21,5 @@
 #include "../common/common.h"
 #include "../common/datastorage.h"
 
-int mapPEToBasefile(FILE *pe, FILE *basefile, struct peData *peData);
+int getBasefileSize(const struct peData *peData, uint32_t *size);
+int mapPEToBasefile(struct mappedFile *pe, struct basefile *basefile, struct peData *peData, uint64_t memLimit);
@@ -45,7 +45,7 @@ int setOptHeaderOffsets(struct offsets *offsets, struct optHeaderEntries *optHea
             case XEX_OPT_ID_BASEFILE_FORMAT:
                 optHeaderEntries->optHeaderEntry[i].dataOrOffset = *currentOffset;
                 offsets->optHeaders[sepHeader] = *currentOffset;
-                *currentOffset += sizeof(struct basefileFormat);
+                *currentOffset += optHeaders->basefileFormat.size; // Variable, depends on the number of blocks
                 sepHeader++;
                 break;
 
@@ -0,0 +1,563 @@
+// This file is part of SynthXEX, one component of the
+// OpenXeChain development toolchain
+//
+// Copyright (c) 2025 Aiden Isik
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "server.h"
+
+#ifndef _WIN32
+
+// What the server shares with each connection's thread
+struct serverState
+{
+    const struct convertOptions *options;
+    pthread_mutex_t mutex; // Guards connections
+    pthread_cond_t idle;
+    uint32_t connections;
+};
+
+struct serverConnection
+{
+    int sock;
+    struct serverState *state;
+};
+
+// Sends or receives exactly size bytes. Returns false if the other end has gone away.
+bool sendAll(int sock, const void *data, size_t size)
+{
+    while(size > 0)
+    {
+        ssize_t sent = send(sock, data, size, 0);
+
+        if(sent < 0 && errno == EINTR)
+        { continue; }
+
+        if(sent <= 0)
+        { return false; }
+
+        data = (const uint8_t *)data + sent;
+        size -= sent;
+    }
+
+    return true;
+}
+
+bool receiveAll(int sock, void *data, size_t size)
+{
+    while(size > 0)
+    {
+        ssize_t received = recv(sock, data, size, 0);
+
+        if(received < 0 && errno == EINTR)
+        { continue; }
+
+        if(received <= 0)
+        { return false; }
+
+        data = (uint8_t *)data + received;
+        size -= received;
+    }
+
+    return true;
+}
+
+// Receives a request and the two descriptors sent with it. hungUp is set if the client
+// closed the connection cleanly instead of sending anything.
+int receiveRequest(int sock, struct serverRequest *request, int *fds, bool *hungUp)
+{
+    *hungUp = false;
+    fds[0] = -1;
+    fds[1] = -1;
+
+    union
+    {
+        struct cmsghdr header; // For alignment
+        uint8_t buffer[CMSG_SPACE(2 * sizeof(int))];
+    } control;
+
+    memset(&control, 0, sizeof(control));
+
+    struct iovec iov = { request, sizeof(struct serverRequest) };
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    int flags = 0;
+
+#ifdef MSG_CMSG_CLOEXEC
+    flags |= MSG_CMSG_CLOEXEC;
+#endif
+
+    ssize_t received;
+
+    do
+    { received = recvmsg(sock, &message, flags); }
+    while(received < 0 && errno == EINTR);
+
+    if(received == 0)
+    {
+        *hungUp = true;
+        return SUCCESS;
+    }
+
+    if(received < 0)
+    { return ERR_SOCKET; }
+
+    // Descriptors arrive with the first byte, take ownership of whatever came even if the request is bad
+    uint32_t fdCount = 0;
+
+    for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg != NULL; cmsg = CMSG_NXTHDR(&message, cmsg))
+    {
+        if(cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+        { continue; }
+
+        uint32_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+
+        for(uint32_t i = 0; i < count; i++)
+        {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cmsg) + (i * sizeof(int)), sizeof(int));
+
+            if(fdCount < 2)
+            { fds[fdCount] = fd; }
+            else
+            { close(fd); }
+
+            fdCount++;
+        }
+    }
+
+    // The rest of the request, if it was split up
+    bool complete = receiveAll(sock, (uint8_t *)request + received, sizeof(struct serverRequest) - received);
+
+    if(!complete || fdCount != 2 || (message.msg_flags & MSG_CTRUNC) || request->magic != SERVER_PROTOCOL_MAGIC
+            || request->version != SERVER_PROTOCOL_VERSION)
+    {
+        for(uint32_t i = 0; i < 2; i++)
+            if(fds[i] >= 0)
+            {
+                close(fds[i]);
+                fds[i] = -1;
+            }
+
+        return ERR_PROTOCOL;
+    }
+
+    return SUCCESS;
+}
+
+int serveRequest(struct serverRequest *request, int *fds, const struct convertOptions *serverOptions)
+{
+    struct convertOptions options = *serverOptions;
+
+    if(request->compMode > COMP_MODE_MAX || request->maxPageRun == 0 || request->maxPageRun > XEX_PAGE_DESC_MAX_RUN)
+    { return ERR_INVALID_OPTION; }
+
+    options.moduleFlags = request->moduleFlags;
+    options.maxPageRun = request->maxPageRun;
+    options.compMode = request->compMode;
+    options.encrypt = (request->encrypt != 0);
+    options.skipMachineCheck = (request->skipMachineCheck != 0);
+
+    if(request->memLimit != 0)
+    { options.memLimit = (uint64_t)request->memLimit * 1024 * 1024; }
+
+    struct convertContext context;
+    int ret = initConvertContext(&context, &options);
+
+    if(ret != SUCCESS)
+    { return ret; }
+
+    ret = mapInputFd(fds[0], &(context.pe));
+
+    if(ret == ERR_FILE_OPEN)
+    { ret = ERR_PE_OPEN; }
+
+    if(ret == SUCCESS)
+    {
+        // Our own descriptor for the stream, the one received is closed by the caller
+        int xexFd = dup(fds[1]);
+        context.xex = (xexFd >= 0) ? fdopen(xexFd, "wb+") : NULL;
+
+        if(context.xex == NULL)
+        {
+            if(xexFd >= 0)
+            { close(xexFd); }
+
+            ret = ERR_XEX_CREATE;
+        }
+    }
+
+    if(ret == SUCCESS)
+    {
+        ret = runOpenedConversion(&context);
+
+        if(fclose(context.xex) != 0 && ret == SUCCESS)
+        { ret = ERR_FILE_WRITE; }
+
+        context.xex = NULL;
+    }
+
+    freeConvertContext(&context);
+    return ret;
+}
+
+// Serves one client's requests in order until it hangs up
+void *serveClient(void *arg)
+{
+    struct serverConnection *connection = arg;
+    struct serverState *state = connection->state;
+
+    while(true)
+    {
+        struct serverRequest request;
+        int fds[2];
+        bool hungUp;
+        int ret = receiveRequest(connection->sock, &request, fds, &hungUp);
+
+        if(hungUp || ret == ERR_SOCKET)
+        { break; }
+
+        if(ret == SUCCESS)
+        {
+            ret = serveRequest(&request, fds, state->options);
+            close(fds[0]);
+            close(fds[1]);
+        }
+
+        struct serverReply reply = { SERVER_PROTOCOL_MAGIC, ret };
+
+        // After a malformed request there's no telling where the next one starts
+        if(!sendAll(connection->sock, &reply, sizeof(reply)) || ret == ERR_PROTOCOL)
+        { break; }
+    }
+
+    close(connection->sock);
+
+    pthread_mutex_lock(&(state->mutex));
+    state->connections--;
+    pthread_cond_broadcast(&(state->idle));
+    pthread_mutex_unlock(&(state->mutex));
+
+    nullAndFree((void **)&connection);
+    return NULL;
+}
+
+int fillSocketAddress(const char *socketPath, struct sockaddr_un *address)
+{
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+
+    if(strlen(socketPath) >= sizeof(address->sun_path))
+    { return ERR_INVALID_OPTION; }
+
+    strcpy(address->sun_path, socketPath);
+    return SUCCESS;
+}
+
+// Listens on socketPath until accepting a connection fails. Each client gets a thread of it's own, which
+// converts with options (jobs, memory limit) and shares a pool of options->jobs - 1 workers for splitting up big modules.
+int runServer(const char *socketPath, const struct convertOptions *options)
+{
+    struct sockaddr_un address;
+    int ret = fillSocketAddress(socketPath, &address);
+
+    if(ret != SUCCESS)
+    { return ret; }
+
+    // Writing to a client that's gone away shouldn't take the server down with it
+    signal(SIGPIPE, SIG_IGN);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if(listener < 0)
+    { return ERR_SOCKET; }
+
+    if(bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        // Perhaps left behind by a server that's no longer running. If nothing answers on it, replace it.
+        int probe = -1;
+
+        if(errno != EADDRINUSE || connectToServer(socketPath, &probe) == SUCCESS
+                || unlink(socketPath) != 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0)
+        {
+            if(probe >= 0)
+            { close(probe); }
+
+            close(listener);
+            return ERR_SOCKET;
+        }
+    }
+
+    if(listen(listener, SOMAXCONN) != 0)
+    {
+        close(listener);
+        unlink(socketPath);
+        return ERR_SOCKET;
+    }
+
+    struct taskPool pool;
+    struct convertOptions serverOptions = *options;
+    serverOptions.verbose = false;
+    serverOptions.batched = true;
+    serverOptions.pool = (createTaskPool(&pool, options->jobs - 1, options->jobServer) == SUCCESS) ? &pool : NULL;
+
+    struct serverState state;
+    state.options = &serverOptions;
+    state.connections = 0;
+    pthread_mutex_init(&(state.mutex), NULL);
+    pthread_cond_init(&(state.idle), NULL);
+
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+
+    while(true)
+    {
+        int client = accept(listener, NULL, NULL);
+
+        if(client < 0)
+        {
+            // Running out of descriptors or memory is hopefully temporary, back off and let some clients finish
+            if(errno == EINTR || errno == ECONNABORTED)
+            { continue; }
+
+            if(errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+            {
+                sleep(1);
+                continue;
+            }
+
+            ret = ERR_SOCKET;
+            break;
+        }
+
+        struct serverConnection *connection = malloc(sizeof(struct serverConnection));
+        pthread_t thread;
+
+        if(connection == NULL)
+        {
+            close(client);
+            continue;
+        }
+
+        connection->sock = client;
+        connection->state = &state;
+
+        pthread_mutex_lock(&(state.mutex));
+        state.connections++;
+        pthread_mutex_unlock(&(state.mutex));
+
+        if(pthread_create(&thread, &attributes, serveClient, connection) != 0)
+        {
+            pthread_mutex_lock(&(state.mutex));
+            state.connections--;
+            pthread_mutex_unlock(&(state.mutex));
+
+            close(client);
+            nullAndFree((void **)&connection);
+        }
+    }
+
+    close(listener);
+    unlink(socketPath);
+
+    // The clients still connected are using the pool
+    pthread_mutex_lock(&(state.mutex));
+
+    while(state.connections > 0)
+    { pthread_cond_wait(&(state.idle), &(state.mutex)); }
+
+    pthread_mutex_unlock(&(state.mutex));
+
+    if(serverOptions.pool != NULL)
+    { destroyTaskPool(&pool); }
+
+    pthread_attr_destroy(&attributes);
+    pthread_cond_destroy(&(state.idle));
+    pthread_mutex_destroy(&(state.mutex));
+    return ret;
+}
+
+int connectToServer(const char *socketPath, int *sock)
+{
+    struct sockaddr_un address;
+    int ret = fillSocketAddress(socketPath, &address);
+
+    if(ret != SUCCESS)
+    { return ret; }
+
+    *sock = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if(*sock < 0)
+    { return ERR_SOCKET; }
+
+    if(connect(*sock, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        close(*sock);
+        *sock = -1;
+        return ERR_SOCKET;
+    }
+
+    return SUCCESS;
+}
+
+// Asks the server on sock to convert the PE open on peFd into the (empty, seekable) file open on xexFd,
+// and waits for the result. The descriptors stay open here.
+int requestConversion(int sock, int peFd, int xexFd, const struct convertOptions *options)
+{
+    struct serverRequest request;
+    memset(&request, 0, sizeof(request));
+    request.magic = SERVER_PROTOCOL_MAGIC;
+    request.version = SERVER_PROTOCOL_VERSION;
+    request.moduleFlags = options->moduleFlags;
+    request.maxPageRun = options->maxPageRun;
+    request.memLimit = (uint32_t)(options->memLimit / (1024 * 1024));
+    request.compMode = options->compMode;
+    request.encrypt = options->encrypt;
+    request.skipMachineCheck = options->skipMachineCheck;
+
+    union
+    {
+        struct cmsghdr header; // For alignment
+        uint8_t buffer[CMSG_SPACE(2 * sizeof(int))];
+    } control;
+
+    memset(&control, 0, sizeof(control));
+
+    struct iovec iov = { &request, sizeof(request) };
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+    int fds[2] = { peFd, xexFd };
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    ssize_t sent;
+
+    do
+    { sent = sendmsg(sock, &message, 0); }
+    while(sent < 0 && errno == EINTR);
+
+    // The descriptors went with the first byte, anything left is plain data
+    if(sent <= 0 || !sendAll(sock, (uint8_t *)&request + sent, sizeof(request) - sent))
+    { return ERR_SOCKET; }
+
+    struct serverReply reply;
+
+    if(!receiveAll(sock, &reply, sizeof(reply)))
+    { return ERR_SOCKET; }
+
+    if(reply.magic != SERVER_PROTOCOL_MAGIC)
+    { return ERR_PROTOCOL; }
+
+    return reply.ret;
+}
+
+// Has the server on socketPath convert each entry in turn, over one connection. Like a local batch,
+// a failed entry doesn't stop the others, failed is set to how many did.
+int runClient(const char *socketPath, struct batchEntry *entries, uint32_t count, const struct convertOptions *options, uint32_t *failed)
+{
+    *failed = 0;
+
+    int sock;
+    int ret = connectToServer(socketPath, &sock);
+
+    if(ret != SUCCESS)
+    { return ret; }
+
+    for(uint32_t i = 0; i < count; i++)
+    {
+        struct convertOptions entryOptions = *options;
+
+        if(entries[i].moduleFlags != 0)
+        { entryOptions.moduleFlags = entries[i].moduleFlags; }
+
+        int peFd = open(entries[i].pePath, O_RDONLY | O_CLOEXEC);
+        int xexFd = -1;
+
+        // Don't leave an empty XEX behind if there's nothing to build it from
+        if(peFd >= 0)
+        {
+            unshareOutput(entries[i].xexfilePath);
+            xexFd = open(entries[i].xexfilePath, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        }
+
+        if(peFd < 0)
+        { entries[i].ret = ERR_PE_OPEN; }
+        else if(xexFd < 0)
+        { entries[i].ret = ERR_XEX_CREATE; }
+        else
+        { entries[i].ret = requestConversion(sock, peFd, xexFd, &entryOptions); }
+
+        if(peFd >= 0)
+        { close(peFd); }
+
+        if(xexFd >= 0)
+        { close(xexFd); }
+
+        reportBatchEntry(&(entries[i]));
+
+        if(entries[i].ret != SUCCESS)
+        { (*failed)++; }
+
+        // The connection's no good after these, the rest can't be done
+        if(entries[i].ret == ERR_SOCKET || entries[i].ret == ERR_PROTOCOL)
+        {
+            *failed += count - i - 1;
+            break;
+        }
+    }
+
+    close(sock);
+    return SUCCESS;
+}
+
+#else
+
+// Windows has no descriptor passing, so there's no server there
+
+int runServer(const char *socketPath, const struct convertOptions *options)
+{
+    return ERR_SOCKET;
+}
+
+int connectToServer(const char *socketPath, int *sock)
+{
+    return ERR_SOCKET;
+}
+
+int requestConversion(int sock, int peFd, int xexFd, const struct convertOptions *options)
+{
+    return ERR_SOCKET;
+}
+
+int runClient(const char *socketPath, struct batchEntry *entries, uint32_t count, const struct convertOptions *options, uint32_t *failed)
+{
+    return ERR_SOCKET;
+}
+
+#endif
@@ -0,0 +1,64 @@
+// This file is part of SynthXEX, one component of the
+// OpenXeChain development toolchain
+//
+// Copyright (c) 2025 Aiden Isik
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "../common/common.h"
+#include "../common/datastorage.h"
+#include "../common/taskpool.h"
+#include "../convert/convert.h"
+#include "../convert/batch.h"
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <signal.h>
+    #include <pthread.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+#endif
+
+// A server keeps one process warm (thread pool, selected hash/AES functions) and converts
+// for clients connecting over a local (Unix) socket. Files are passed as descriptors alongside
+// each request, so no image data goes through the socket itself.
+#define SERVER_PROTOCOL_MAGIC   0x58455853 // "SXEX"
+#define SERVER_PROTOCOL_VERSION 1
+
+// Sent with two descriptors: the PE to read, then the (empty, seekable) file to write the XEX to.
+// Both ends are on the same machine, so everything is in host byte order.
+struct __attribute__((packed)) serverRequest
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t moduleFlags; // 0 to detect
+    uint32_t maxPageRun;
+    uint32_t memLimit; // In MiB, 0 for the server's
+    uint8_t compMode;
+    uint8_t encrypt;
+    uint8_t skipMachineCheck;
+};
+
+struct __attribute__((packed)) serverReply
+{
+    uint32_t magic;
+    int32_t ret; // SUCCESS or one of the ERR_* values
+};
+
+int runServer(const char *socketPath, const struct convertOptions *options);
+int connectToServer(const char *socketPath, int *sock);
+int requestConversion(int sock, int peFd, int xexFd, const struct convertOptions *options);
+int runClient(const char *socketPath, struct batchEntry *entries, uint32_t count, const struct convertOptions *options, uint32_t *failed);
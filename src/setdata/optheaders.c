@@ -18,13 +18,62 @@
 
 #include "optheaders.h"
 
-void setBasefileFormat(struct basefileFormat *basefileFormat, struct secInfoHeader *secInfoHeader)
+// Pads the compressed blocks out to a whole number of AES blocks, after the last one so the loader never looks at it
+int padNormalCompData(struct basefileFormat *basefileFormat)
 {
-    basefileFormat->size = (1 * 8) + 8; // (Block count * size of raw data descriptor) + size of data descriptor
-    basefileFormat->encType = 0x0; // No encryption
-    basefileFormat->compType = 0x1; // No compression
-    basefileFormat->dataSize = secInfoHeader->peSize;
-    basefileFormat->zeroSize = 0x0; // We aren't going to be removing any zeroes. TODO: implement this, it can make files much smaller
+    uint8_t *compData = basefileFormat->normalCompData; // Avoid dereferencing unaligned pointer
+    uint32_t paddedSize = (basefileFormat->normalCompDataSize + AES_BLOCK_SIZE - 1) & ~(AES_BLOCK_SIZE - 1);
+    uint8_t *newData = realloc(compData, paddedSize);
+
+    if(newData == NULL)
+    { return ERR_OUT_OF_MEM; }
+
+    memset(newData + basefileFormat->normalCompDataSize, 0, paddedSize - basefileFormat->normalCompDataSize);
+    basefileFormat->normalCompData = newData;
+    basefileFormat->normalCompDataSize = paddedSize;
+    return SUCCESS;
+}
+
+int setBasefileFormat(struct basefileFormat *basefileFormat, struct basefile *basefile, uint8_t compMode, bool encrypt, uint32_t jobs,
+                      struct taskPool *pool)
+{
+    basefileFormat->encType = XEX_ENC_NONE;
+
+    if(encrypt)
+    {
+        // A fresh key for every image
+        int ret = getRandomBytes(basefileFormat->imageKey, sizeof(basefileFormat->imageKey));
+
+        if(ret != SUCCESS)
+        { return ret; }
+
+        basefileFormat->encType = XEX_ENC_NORMAL;
+    }
+
+    if(compMode >= COMP_MODE_FAST)
+    {
+        basefileFormat->size = BASEFILE_FORMAT_NORMAL_SIZE;
+        basefileFormat->compType = XEX_COMP_NORMAL;
+        basefileFormat->windowSize = LZX_WINDOW_SIZE;
+        int ret = lzxCompressBasefile(basefile, compMode - COMP_MODE_FAST + LZX_LEVEL_FAST, jobs, pool, basefileFormat);
+
+        if(ret == SUCCESS && encrypt)
+        { ret = padNormalCompData(basefileFormat); }
+
+        return ret;
+    }
+
+    struct basicCompBlock *blocks;
+    uint32_t blockCount;
+    int ret = getBasicCompBlocks(basefile, compMode == COMP_MODE_BASIC, &blocks, &blockCount);
+
+    if(ret != SUCCESS)
+    { return ret; }
+
+    basefileFormat->size = (blockCount * sizeof(struct basicCompBlock)) + 8; // (Block count * size of raw data descriptor) + size of data descriptor
+    basefileFormat->compType = XEX_COMP_BASIC;
+    basefileFormat->blocks = blocks;
+    return SUCCESS;
 }
 
 // STUB. TLS info not supported.
@@ -36,6 +85,63 @@ void setTLSInfo(struct tlsInfo *tlsInfo)
     tlsInfo->rawDataSize = 0x0;
 }
 
+// Reads a decimal version field of an import name, which must be followed by terminator. Advances pos past the terminator.
+bool parseImportVersionField(const char **pos, char terminator, uint32_t *value)
+{
+    const char *current = *pos;
+    *value = 0;
+
+    if(*current < '0' || *current > '9')
+    { return false; } // Empty, or a non-number
+
+    for(; *current >= '0' && *current <= '9'; current++)
+    {
+        if(*value > (UINT32_MAX - 9) / 10)
+        { return false; }
+
+        *value = (*value * 10) + (*current - '0');
+    }
+
+    if(*current != terminator)
+    { return false; }
+
+    *pos = (terminator == '\0') ? current : current + 1;
+    return true;
+}
+
+// Splits an import name of the form name@targetBuild.targetHotfix+minimumBuild.minimumHotfix.
+// The name is left untouched, the library name's length is given back instead of terminating it in place.
+bool parseImportName(const char *importName, uint32_t *nameLen, uint32_t *targetVer, uint32_t *minimumVer)
+{
+    // Major and minor version are always 2 and 0, respectively
+    const uint8_t majorVer = 2;
+    const uint8_t minorVer = 0;
+    const char *at = strchr(importName, '@');
+
+    if(at == NULL || at == importName)
+    { return false; }
+
+    *nameLen = at - importName;
+
+    const char *pos = at + 1;
+    uint32_t fields[4];
+
+    if(!parseImportVersionField(&pos, '.', &fields[0]) || !parseImportVersionField(&pos, '+', &fields[1])
+            || !parseImportVersionField(&pos, '.', &fields[2]) || !parseImportVersionField(&pos, '\0', &fields[3]))
+    { return false; }
+
+    // Pack these into the version bitfields
+    *targetVer = ((majorVer & 0xF) << 28) | ((minorVer & 0xF) << 24) | ((uint16_t)fields[0] << 8) | (uint8_t)fields[1];
+    *minimumVer = ((majorVer & 0xF) << 28) | ((minorVer & 0xF) << 24) | ((uint16_t)fields[2] << 8) | (uint8_t)fields[3];
+    return true;
+}
+
+// Compares a length-delimited name with a null-terminated one
+bool importNameIs(const char *name, uint32_t nameLen, const char *expected)
+{
+    return strlen(expected) == nameLen && memcmp(name, expected, nameLen) == 0;
+}
+
 int setImportLibsInfo(struct importLibraries *importLibraries, struct peImportInfo *peImportInfo, struct secInfoHeader *secInfoHeader)
 {
     // Set table count and allocate enough memory for all tables
@@ -57,11 +163,12 @@ int setImportLibsInfo(struct importLibraries *importLibraries, struct peImportIn
     importLibraries->size = (sizeof(struct importLibraries) + importLibraries->nameTableSize) - (2 * sizeof(void *));
 
     int ret = ERR_INVALID_IMPORT_NAME;
+    uint8_t *serialisedTable = NULL;
 
-    // Allocate name list
-    char **names = calloc(importLibraries->tableCount, sizeof(char *));
+    // Allocate name length list (the names themselves stay in peImportInfo)
+    uint32_t *nameLens = calloc(importLibraries->tableCount, sizeof(uint32_t));
 
-    if(!names)
+    if(!nameLens)
     { goto cleanup_tables; }
 
     // Populate each table, then compute it's hash and store in the previous table
@@ -71,100 +178,26 @@ int setImportLibsInfo(struct importLibraries *importLibraries, struct peImportIn
         importTables[i].tableIndex = i;
 
         // Extract the name, target, and minimum versions from the name string
-        // Major and minor version are always 2 and 0, respectively
         // Strings are definitely null-terminated as otherwise they couldn't have been read in
-        const uint8_t majorVer = 2;
-        const uint8_t minorVer = 0;
-        char *targetBuildVerStr = NULL;
-        char *targetHotfixVerStr = NULL;
-        char *minimumBuildVerStr = NULL;
-        char *minimumHotfixVerStr = NULL;
-        uint16_t buildVer = 0;
-        uint8_t hotfixVer = 0;
-        char *strtoulRet = NULL;
-
-        // Get the name
-        uint32_t oldNameLen = strlen(peImportInfo->tables[i].name);
-        names[i] = strtok(peImportInfo->tables[i].name, "@");
-
-        if(!peImportInfo->tables[i].name)
-        { goto cleanup_names_invalid; } // Encountered '\0', not '@'
-
-        // Target versions first
-        targetBuildVerStr = strtok(NULL, ".");
-
-        if(!targetBuildVerStr)
-        { goto cleanup_names_invalid; }
-
-        if(strlen(names[i]) + 1 + strlen(targetBuildVerStr) == oldNameLen)
-        { goto cleanup_names_invalid; } // Encountered null terminator instead of '.'
-
-        buildVer = (uint16_t)strtoul(targetBuildVerStr, &strtoulRet, 10);
-
-        if(*strtoulRet != 0 || strtoulRet == targetBuildVerStr)
-        { goto cleanup_names_invalid; } // Encountered a non-number, or string was empty
-
-        targetHotfixVerStr = strtok(NULL, "+");
-
-        if(!targetHotfixVerStr)
-        { goto cleanup_names_invalid; }
-
-        if(strlen(names[i]) + 1 + strlen(targetBuildVerStr) + 1 + strlen(targetHotfixVerStr) == oldNameLen)
-        { goto cleanup_names_invalid; }
-
-        hotfixVer = (uint8_t)strtoul(targetHotfixVerStr, &strtoulRet, 10);
-
-        if(*strtoulRet != 0 || strtoulRet == targetHotfixVerStr)
-        { goto cleanup_names_invalid; }
-
-        // Now pack these into the target version bitfield
-        importTables[i].targetVer =
-            ((majorVer & 0xF) << 28) |
-            ((minorVer & 0xF) << 24) |
-            (buildVer << 8) |
-            hotfixVer;
-
-        // Now onto the minimum versions, this works much the same
-        minimumBuildVerStr = strtok(NULL, ".");
+        const char *name = peImportInfo->tables[i].name;
+        uint32_t targetVer = 0;
+        uint32_t minimumVer = 0;
 
-        if(!minimumBuildVerStr)
-        { goto cleanup_names_invalid; } // No more tokens
+        if(!parseImportName(name, &nameLens[i], &targetVer, &minimumVer))
+        { goto cleanup_names; }
 
-        if(strlen(names[i]) + 1 + strlen(targetBuildVerStr) + 1 + strlen(targetHotfixVerStr)
-                + 1 + strlen(minimumBuildVerStr) == oldNameLen)
-        { goto cleanup_names_invalid; } // Encountered null terminator instead of '.'
-
-        buildVer = (uint16_t)strtoul(minimumBuildVerStr, &strtoulRet, 10);
-
-        if(*strtoulRet != 0 || strtoulRet == minimumBuildVerStr)
-        { goto cleanup_names_invalid; } // Encountered a non-number, or string was empty
-
-        minimumHotfixVerStr = strtok(NULL, "\0");
-
-        if(!minimumHotfixVerStr)
-        { goto cleanup_names_invalid; }
-
-        hotfixVer = (uint8_t)strtoul(minimumHotfixVerStr, &strtoulRet, 10);
-
-        if(*strtoulRet != 0 || strtoulRet == minimumHotfixVerStr)
-        { goto cleanup_names_invalid; }
-
-        // Now pack these into the minimum version bitfield
-        importTables[i].minimumVer =
-            ((majorVer & 0xF) << 28) |
-            ((minorVer & 0xF) << 24) |
-            (buildVer << 8) |
-            hotfixVer;
+        importTables[i].targetVer = targetVer;
+        importTables[i].minimumVer = minimumVer;
 
         // Hardcode a currently unknown value. TODO: find out how this is calculated.
-        if(strcmp(names[i], "xboxkrnl.exe") == 0)
+        if(importNameIs(name, nameLens[i], "xboxkrnl.exe"))
         { importTables[i].unknown = 0x45DC17E0; }
-        else if(strcmp(names[i], "xam.xex") == 0)
+        else if(importNameIs(name, nameLens[i], "xam.xex"))
         { importTables[i].unknown = 0xFCA15C76; }
-        else if(strcmp(names[i], "xbdm.xex") == 0)
+        else if(importNameIs(name, nameLens[i], "xbdm.xex"))
         { importTables[i].unknown = 0xECEB8109; }
         else
-        { goto cleanup_names_invalid; }
+        { goto cleanup_names; }
 
         // Determine the number of addresses
         importTables[i].addressCount = peImportInfo->tables[i].importCount;
@@ -173,7 +206,10 @@ int setImportLibsInfo(struct importLibraries *importLibraries, struct peImportIn
         importTables[i].addresses = calloc(importTables[i].addressCount, sizeof(uint32_t));
 
         if(!importTables[i].addresses)
-        { goto cleanup_names_invalid; }
+        {
+            ret = ERR_OUT_OF_MEM;
+            goto cleanup_names;
+        }
 
         uint32_t *addresses = importTables[i].addresses; // Use this to avoid dereferencing an unaligned pointer
         uint16_t currentAddr = 0;
@@ -182,57 +218,31 @@ int setImportLibsInfo(struct importLibraries *importLibraries, struct peImportIn
         for(uint16_t j = 0; j < peImportInfo->tables[i].importCount; j++)
         {
             if(currentAddr >= importTables[i].addressCount)
-            { goto cleanup_names_invalid; }
+            { goto cleanup_names; }
 
             addresses[currentAddr++] = peImportInfo->tables[i].imports[j].iatAddr;
         }
 
         // Determine the total size, in bytes, of the current table (- sizeof(void*) to exclude address to addresses at the end)
-        importTables[i].size = (sizeof(struct importTable) - sizeof(void *) + (importTables[i].addressCount *sizeof(uint32_t)));
+        importTables[i].size = (sizeof(struct importTable) - sizeof(void *) + (importTables[i].addressCount * sizeof(uint32_t)));
         importLibraries->size += importTables[i].size;
 
-        // Init sha1 hash
-        struct sha1_ctx shaContext;
-        memset(&shaContext, 0, sizeof(shaContext));
-        sha1_init(&shaContext);
+        // The hash is of the table as it's written (big endian), minus it's size field
+        serialisedTable = malloc(importTables[i].size);
 
-        // On little endian this ensures the byteswapped address count doesn't cause any trouble when using it.
-        // On big endian it's pointless but here so the code isn't too complex with differences between endianness.
-        uint16_t addressCount = importTables[i].addressCount;
-
-        // If we're on a little endian system, swap everything into big endian for hashing
-#ifdef LITTLE_ENDIAN_SYSTEM
-        importTables[i].size = __builtin_bswap32(importTables[i].size);
-        importTables[i].unknown = __builtin_bswap32(importTables[i].unknown);
-        importTables[i].targetVer = __builtin_bswap32(importTables[i].targetVer);
-        importTables[i].minimumVer = __builtin_bswap32(importTables[i].minimumVer);
-        importTables[i].addressCount = __builtin_bswap16(importTables[i].addressCount);
-
-        // Byteswap the addresses
-        for(uint16_t j = 0; j < addressCount; j++)
-        { addresses[j] = __builtin_bswap32(addresses[j]); }
-
-#endif
-        // - sizeof(void*) to exclude the address to the addresses at the end (not part of the XEX format)
-        // +/- sizeof(uint32_t) to exclude table size from hash
-        sha1_update(&shaContext, sizeof(struct importTable) - sizeof(void *) - sizeof(uint32_t), (void *)&importTables[i] + sizeof(uint32_t));
-        sha1_update(&shaContext, addressCount *sizeof(uint32_t), (void *)addresses);
-
-        // If we're on a little endian system, swap everything back into little endian
-#ifdef LITTLE_ENDIAN_SYSTEM
-        importTables[i].size = __builtin_bswap32(importTables[i].size);
-        importTables[i].unknown = __builtin_bswap32(importTables[i].unknown);
-        importTables[i].targetVer = __builtin_bswap32(importTables[i].targetVer);
-        importTables[i].minimumVer = __builtin_bswap32(importTables[i].minimumVer);
-        importTables[i].addressCount = __builtin_bswap16(importTables[i].addressCount);
-
-        // Byteswap the addresses
-        for(uint16_t j = 0; j < addressCount; j++)
-        { addresses[j] = __builtin_bswap32(addresses[j]); }
-
-#endif
+        if(!serialisedTable)
+        {
+            ret = ERR_OUT_OF_MEM;
+            goto cleanup_names;
+        }
 
+        uint32_t tableSize = serialiseImportTable(&(importTables[i]), serialisedTable);
+
+        struct sha1_ctx shaContext;
+        sha1_init(&shaContext);
+        sha1_update(&shaContext, tableSize - sizeof(uint32_t), serialisedTable + sizeof(uint32_t));
         sha1_digest(&shaContext, 0x14, i != 0 ? importTables[i - 1].sha1 : secInfoHeader->importTableSha1);
+        nullAndFree((void **)&serialisedTable);
     }
 
     // Allocate offset table
@@ -244,7 +254,7 @@ int setImportLibsInfo(struct importLibraries *importLibraries, struct peImportIn
     for(uint32_t i = 0; i < importLibraries->tableCount; i++)
     {
         nameOffsets[i] = importLibraries->nameTableSize;
-        importLibraries->nameTableSize += getNextAligned(strlen(names[i]) + 1, sizeof(uint32_t));
+        importLibraries->nameTableSize += getNextAligned(nameLens[i] + 1, sizeof(uint32_t));
     }
 
     importLibraries->size += importLibraries->nameTableSize;
@@ -256,12 +266,12 @@ int setImportLibsInfo(struct importLibraries *importLibraries, struct peImportIn
     // Use this to avoid dereferencing an unaligned pointer
     char *nameTable = importLibraries->nameTable;
 
-    // Populate the name table
+    // Populate the name table (calloc has already terminated each name)
     for(uint32_t i = 0; i < importLibraries->tableCount; i++)
-    { strcpy(&(nameTable[nameOffsets[i]]), names[i]); }
+    { memcpy(&(nameTable[nameOffsets[i]]), peImportInfo->tables[i].name, nameLens[i]); }
 
     nullAndFree((void **)&nameOffsets);
-    nullAndFree((void **)&names);
+    nullAndFree((void **)&nameLens);
     return SUCCESS;
 
 cleanup_offsets:
@@ -275,8 +285,7 @@ cleanup_names:
         importTables[i].addresses = addresses;
     }
 
-cleanup_names_invalid:
-    nullAndFree((void **)&names);
+    nullAndFree((void **)&nameLens);
 cleanup_tables:
     nullAndFree((void **)&importTables);
     importLibraries->importTables = importTables;
@@ -296,7 +305,8 @@ void setSysFlags(uint32_t *flags)
              XEX_SYS_ALLOW_CONTROL_SWAP;
 }
 
-int setOptHeaders(struct secInfoHeader *secInfoHeader, struct peData *peData, struct optHeaderEntries *optHeaderEntries, struct optHeaders *optHeaders)
+int setOptHeaders(struct secInfoHeader *secInfoHeader, struct peData *peData, struct optHeaderEntries *optHeaderEntries, struct optHeaders *optHeaders,
+                  struct basefile *basefile, uint8_t compMode, bool encrypt, uint32_t jobs, struct taskPool *pool)
 {
     bool importsPresent = (peData->peImportInfo.totalImportCount > 0) ? true : false;
 
@@ -315,7 +325,14 @@ int setOptHeaders(struct secInfoHeader *secInfoHeader, struct peData *peData, st
     // NOTE: Make sure that these headers are handled IN ORDER OF ID. The loader will reject the XEX if they are not.
 
     // Basefile format (0x003FF)
-    setBasefileFormat(&(optHeaders->basefileFormat), secInfoHeader);
+    int ret = setBasefileFormat(&(optHeaders->basefileFormat), basefile, compMode, encrypt, jobs, pool);
+
+    if(ret != SUCCESS)
+    { return ret; }
+
+    if(encrypt)
+    { wrapImageKey(optHeaders->basefileFormat.imageKey, secInfoHeader->aesKey); }
+
     optHeaderEntries->optHeaderEntry[currentHeader].id = XEX_OPT_ID_BASEFILE_FORMAT;
     currentHeader++;
 
@@ -328,7 +345,7 @@ int setOptHeaders(struct secInfoHeader *secInfoHeader, struct peData *peData, st
     if(importsPresent)
     {
         optHeaderEntries->optHeaderEntry[currentHeader].id = XEX_OPT_ID_IMPORT_LIBS;
-        int ret = setImportLibsInfo(&(optHeaders->importLibraries), &(peData->peImportInfo), secInfoHeader);
+        ret = setImportLibsInfo(&(optHeaders->importLibraries), &(peData->peImportInfo), secInfoHeader);
 
         if(ret != SUCCESS)
         { return ret; }
@@ -21,5 +21,11 @@
 #include "../common/common.h"
 #include "../common/crypto.h"
 #include "../common/datastorage.h"
+#include "../compress/basiccomp.h"
+#include "../compress/lzx.h"
 
-int setOptHeaders(struct secInfoHeader *secInfoHeader, struct peData *peData, struct optHeaderEntries *optHeaderEntries, struct optHeaders *optHeaders);
+// Size of the basefile format header with normal compression: data descriptor + window size + first block info
+#define BASEFILE_FORMAT_NORMAL_SIZE (8 + sizeof(uint32_t) + sizeof(struct normalCompBlockInfo))
+
+int setOptHeaders(struct secInfoHeader *secInfoHeader, struct peData *peData, struct optHeaderEntries *optHeaderEntries, struct optHeaders *optHeaders,
+                  struct basefile *basefile, uint8_t compMode, bool encrypt, uint32_t jobs, struct taskPool *pool);
@@ -15,75 +15,370 @@
 //
 // You should have received a copy of the GNU Affero General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
-
 #include "pagedescriptors.h"
 
-uint8_t getRwx(struct secInfoHeader *secInfoHeader, struct peData *peData, uint32_t page)
+// Internal struct, shared between the page hashing workers
+struct pageHashState
+{
+    const uint8_t *basefile;
+    struct basefile *basefileStruct;
+    FILE *xex; // If NULL, the pages aren't written by the workers
+    const struct mappedFile *existing; // What the XEX held before, when it's updated in place
+    uint32_t basefileOffset; // Where the basefile goes in the XEX
+    struct basicCompMap compMap; // Which parts of the basefile actually go in the XEX
+    pthread_mutex_t mutex; // Guards nextDesc, nextEncryptDesc and ret
+    pthread_cond_t encryptTurn; // Signalled when nextEncryptDesc moves on, or on error
+    bool encrypt;
+    struct aes128_ctx aes;
+    uint8_t iv[AES_BLOCK_SIZE]; // Carries the CBC chain from one batch to the next
+    uint32_t nextEncryptDesc; // CBC is serial, so batches are encrypted strictly in order
+    uint32_t pageSize;
+    uint32_t descCount;
+    uint32_t nextDesc;
+    int ret;
+    uint32_t *firstPages; // The first page covered by each descriptor, plus one past the last page at the end
+    struct sha1_ctx *midstates;
+    const struct pageHashCache *hashCache; // Midstates from the last build, if any
+    uint64_t *fingerprints; // Of each descriptor's pages, when there's a cache
+};
+
+uint8_t getRwx(struct peData *peData, uint32_t page)
 {
-    uint32_t pageSize = secInfoHeader->peSize / secInfoHeader->pageDescCount;
-    uint32_t currentOffset = page *pageSize;
+    uint32_t currentOffset = page *peData->pageSize;
 
     for(int32_t i = peData->sections.count - 1; i >= 0; i--)
         if(currentOffset >= peData->sections.section[i].rva)
         { return peData->sections.section[i].permFlag; }
 
-    return XEX_SECTION_RODATA | 0b10000; // We're in the PE header, so RODATA
+    return XEX_SECTION_RODATA; // We're in the PE header, so RODATA
 }
 
-int setPageDescriptors(FILE *pe, struct peData *peData, struct secInfoHeader *secInfoHeader)
+// Works out which pages each page descriptor covers, and sizes the security info to suit.
+// The upper 28 bits of a descriptor are a page count, so runs of up to maxRun consecutive pages with the same
+// permissions can share one descriptor (and one hash). maxRun == 1 gives the usual one descriptor per page.
+int setPageDescriptorRuns(struct secInfoHeader *secInfoHeader, struct peData *peData, uint32_t maxRun)
 {
-    uint32_t pageSize = secInfoHeader->peSize / secInfoHeader->pageDescCount;
+    uint32_t pageCount = secInfoHeader->peSize / peData->pageSize;
+
+    if(maxRun == 0 || maxRun > XEX_PAGE_DESC_MAX_RUN)
+    { maxRun = XEX_PAGE_DESC_MAX_RUN; }
 
-    secInfoHeader->descriptors = calloc(secInfoHeader->pageDescCount, sizeof(struct pageDescriptor));
+    // At most one descriptor per page, shrunk to fit once we know how many runs there are
+    secInfoHeader->descriptors = calloc(pageCount, sizeof(struct pageDescriptor));
 
     if(!secInfoHeader->descriptors)
     { return ERR_OUT_OF_MEM; }
 
     struct pageDescriptor *descriptors = secInfoHeader->descriptors; // So we don't dereference an unaligned pointer
+    uint32_t descCount = 0;
 
-    // Setting size/info data and calculating hashes for page descriptors
-    for(int64_t i = secInfoHeader->pageDescCount - 1; i >= 0; i--)
+    for(uint32_t page = 0; page < pageCount;)
     {
-        // Get page type (rwx)
-        descriptors[i].sizeAndInfo = getRwx(secInfoHeader, peData, i);
+        uint8_t rwx = getRwx(peData, page);
+        uint32_t run = 1;
+
+        while(run < maxRun && page + run < pageCount && getRwx(peData, page + run) == rwx)
+        { run++; }
+
+        descriptors[descCount].sizeAndInfo = (run << 4) | rwx;
+        descCount++;
+        page += run;
+    }
+
+    if(descCount < pageCount)
+    {
+        struct pageDescriptor *shrunk = realloc(descriptors, descCount * sizeof(struct pageDescriptor));
+
+        if(shrunk != NULL)
+        { secInfoHeader->descriptors = shrunk; }
+    }
+
+    secInfoHeader->pageDescCount = descCount;
+    secInfoHeader->headerSize = (descCount * sizeof(struct pageDescriptor)) + (sizeof(struct secInfoHeader) - sizeof(void *));
+    return SUCCESS;
+}
+
+// Absorbs the data covered by each descriptor into it's own SHA1 context (midstate), then encrypts it in place if
+// asked to and copies it into the XEX while it's still in cache, so the basefile is only read from memory once.
+// Pages are always a multiple of the SHA1 block size, so nothing is left buffered,
+// and these can be picked up later to hash the descriptor which follows the data.
+// Descriptors are taken in batches, so equally sized ones can be hashed side by side with multi-buffer SIMD where available.
+void *hashPages(void *arg)
+{
+    struct pageHashState *state = arg;
+    uint32_t batchSize = sha1_multi_lanes();
+
+    while(true)
+    {
+        pthread_mutex_lock(&(state->mutex));
+
+        if(state->nextDesc >= state->descCount || state->ret != SUCCESS)
+        {
+            pthread_mutex_unlock(&(state->mutex));
+            break;
+        }
+
+        uint32_t first = state->nextDesc;
+        uint32_t count = (state->descCount - first < batchSize) ? state->descCount - first : batchSize;
+        state->nextDesc += count;
+
+        pthread_mutex_unlock(&(state->mutex));
+
+        const uint8_t *batch = state->basefile + (size_t)state->firstPages[first] * state->pageSize;
+        size_t batchLength = (size_t)(state->firstPages[first + count] - state->firstPages[first]) * state->pageSize;
+        size_t runLength = (size_t)(state->firstPages[first + 1] - state->firstPages[first]) * state->pageSize;
 
-        // Init sha1 hash
-        struct sha1_ctx shaContext;
-        sha1_init(&shaContext);
+        // Pages which haven't changed since the last build already have their midstate
+        bool cached[SHA1_MULTI_MAX_LANES] = { false };
+        uint32_t hits = 0;
 
-        if(fseek(pe, i *pageSize, SEEK_SET) != 0)
-        { return ERR_FILE_READ; }
+        if(state->hashCache != NULL)
+        {
+            for(uint32_t i = first; i < first + count; i++)
+            {
+                uint32_t pageCount = state->firstPages[i + 1] - state->firstPages[i];
+                state->fingerprints[i] = fingerprintData(state->basefile + (size_t)state->firstPages[i] * state->pageSize,
+                                                         (size_t)pageCount * state->pageSize);
+                cached[i - first] = findPageHash(state->hashCache, state->fingerprints[i], pageCount, &(state->midstates[i]));
 
-        uint8_t *page = malloc(pageSize);
+                if(cached[i - first])
+                { hits++; }
+            }
+        }
 
-        if(!page)
-        { return ERR_OUT_OF_MEM; }
+        if(hits == 0 && batchLength == runLength * count)
+        {
+            // Every descriptor in the batch covers the same number of pages (always the case without coalescing)
+            for(uint32_t i = first; i < first + count; i++)
+            { sha1_init(&(state->midstates[i])); }
 
-        if(fread(page, 1, pageSize, pe) != pageSize)
+            sha1_update_multi(&(state->midstates[first]), count, runLength, batch, runLength);
+        }
+        else
         {
-            nullAndFree((void **)&page);
-            return ERR_FILE_READ;
+            for(uint32_t i = first; i < first + count; i++)
+            {
+                if(cached[i - first])
+                { continue; }
+
+                sha1_init(&(state->midstates[i]));
+                sha1_update(&(state->midstates[i]), (size_t)(state->firstPages[i + 1] - state->firstPages[i]) * state->pageSize,
+                            state->basefile + (size_t)state->firstPages[i] * state->pageSize);
+            }
         }
 
-        // For little endian systems, swap into big endian for hashing, then back (to keep struct endianness consistent)
-#ifdef LITTLE_ENDIAN_SYSTEM
-        descriptors[i].sizeAndInfo = __builtin_bswap32(descriptors[i].sizeAndInfo);
+        if(state->encrypt)
+        {
+            // Wait for the batches before this one, they feed into it
+            pthread_mutex_lock(&(state->mutex));
+
+            while(state->nextEncryptDesc != first && state->ret == SUCCESS)
+            { pthread_cond_wait(&(state->encryptTurn), &(state->mutex)); }
+
+            bool failed = (state->ret != SUCCESS);
+            pthread_mutex_unlock(&(state->mutex));
+
+            if(failed)
+            { break; }
+
+            encryptBasicCompRange(&(state->compMap), state->basefileStruct, state->firstPages[first] * state->pageSize, batchLength,
+                                  &(state->aes), state->iv);
+
+            pthread_mutex_lock(&(state->mutex));
+            state->nextEncryptDesc = first + count;
+            pthread_cond_broadcast(&(state->encryptTurn));
+            pthread_mutex_unlock(&(state->mutex));
+        }
+
+        if(state->xex == NULL)
+        { continue; }
+
+#ifdef _WIN32
+        // No positional writes here, so the seek and write have to happen together
+        pthread_mutex_lock(&(state->mutex));
 #endif
 
-        sha1_update(&shaContext, pageSize, page);
-        sha1_update(&shaContext, 0x18, (uint8_t *)&descriptors[i]);
+        int ret = writeBasicCompRange(&(state->compMap), state->basefileStruct, state->firstPages[first] * state->pageSize, batchLength,
+                                      state->xex, state->basefileOffset, false, state->existing);
 
-#ifdef LITTLE_ENDIAN_SYSTEM
-        descriptors[i].sizeAndInfo = __builtin_bswap32(descriptors[i].sizeAndInfo);
+#ifndef _WIN32
+        pthread_mutex_lock(&(state->mutex));
 #endif
 
-        if(i != 0)
-        { sha1_digest(&shaContext, 0x14, descriptors[i - 1].sha1); }
+        if(ret != SUCCESS)
+        {
+            state->ret = ret;
+            pthread_cond_broadcast(&(state->encryptTurn)); // Nobody waiting on us will get a turn now
+        }
+
+        pthread_mutex_unlock(&(state->mutex));
+    }
+
+    return NULL;
+}
+
+// Hashes the data covered by each descriptor set up by setPageDescriptorRuns
+int setPageDescriptors(struct basefile *basefile, struct peData *peData, struct secInfoHeader *secInfoHeader,
+                       struct basefileFormat *basefileFormat, struct offsets *offsets, FILE *xex, uint32_t jobs,
+                       struct taskPool *pool, struct pageHashCache *hashCache, const struct mappedFile *existing)
+{
+    struct pageDescriptor *descriptors = secInfoHeader->descriptors; // So we don't dereference an unaligned pointer
+
+    struct pageHashState state;
+    memset(&state, 0, sizeof(state));
+    state.basefile = basefile->data;
+    state.basefileStruct = basefile;
+    // A file-backed basefile is copied over in one go by the kernel afterwards instead (unless it's being compared
+    // with what's there already), and with normal compression it's the compressed blocks that are written afterwards
+    bool normalComp = (basefileFormat->compType == XEX_COMP_NORMAL);
+    state.xex = (((basefile->mapped && existing == NULL) || normalComp) ? NULL : xex);
+    state.basefileOffset = offsets->basefile;
+    state.existing = existing;
+    state.pageSize = peData->pageSize;
+    state.descCount = secInfoHeader->pageDescCount;
+    // The compressed blocks are encrypted in one go after hashing instead, there's no data to spread the work over
+    state.encrypt = (basefileFormat->encType == XEX_ENC_NORMAL && !normalComp);
+    aes128_set_encrypt_key(&(state.aes), basefileFormat->imageKey);
+    state.firstPages = malloc((state.descCount + 1) * sizeof(uint32_t));
+    state.midstates = calloc(state.descCount, sizeof(struct sha1_ctx));
+    state.hashCache = hashCache;
+
+    if(hashCache != NULL)
+    {
+        // Hashes from a build with a different page size are no use
+        if(hashCache->pageSize != peData->pageSize)
+        {
+            freePageHashCache(hashCache);
+            hashCache->pageSize = peData->pageSize;
+        }
+
+        state.fingerprints = malloc(state.descCount * sizeof(uint64_t));
+        nullAndFree((void **) & (hashCache->newEntries));
+        hashCache->newEntries = malloc(state.descCount * sizeof(struct pageHashEntry));
+    }
+
+    if(!state.firstPages || !state.midstates || (hashCache != NULL && (!state.fingerprints || !hashCache->newEntries)))
+    {
+        nullAndFree((void **)&state.firstPages);
+        nullAndFree((void **)&state.midstates);
+        nullAndFree((void **)&state.fingerprints);
+        return ERR_OUT_OF_MEM;
+    }
+
+    int ret = (normalComp ? SUCCESS : createBasicCompMap(&(state.compMap), basefileFormat));
+
+    if(ret != SUCCESS)
+    {
+        nullAndFree((void **)&state.firstPages);
+        nullAndFree((void **)&state.midstates);
+        nullAndFree((void **)&state.fingerprints);
+        return ret;
+    }
+
+    state.firstPages[0] = 0;
+
+    for(uint32_t i = 0; i < state.descCount; i++)
+    { state.firstPages[i + 1] = state.firstPages[i] + (descriptors[i].sizeAndInfo >> 4); }
+
+    // Anything buffered must be out before the workers start writing behind the stream's back
+    if(fflush(xex) != 0)
+    {
+        freeBasicCompMap(&(state.compMap));
+        nullAndFree((void **)&state.firstPages);
+        nullAndFree((void **)&state.midstates);
+        nullAndFree((void **)&state.fingerprints);
+        return ERR_FILE_WRITE;
+    }
+
+    if(pthread_mutex_init(&(state.mutex), NULL) != 0)
+    {
+        freeBasicCompMap(&(state.compMap));
+        nullAndFree((void **)&state.firstPages);
+        nullAndFree((void **)&state.midstates);
+        nullAndFree((void **)&state.fingerprints);
+        return ERR_OUT_OF_MEM;
+    }
+
+    if(pthread_cond_init(&(state.encryptTurn), NULL) != 0)
+    {
+        pthread_mutex_destroy(&(state.mutex));
+        freeBasicCompMap(&(state.compMap));
+        nullAndFree((void **)&state.firstPages);
+        nullAndFree((void **)&state.midstates);
+        nullAndFree((void **)&state.fingerprints);
+        return ERR_OUT_OF_MEM;
+    }
+
+    // No point in having more workers than descriptors. The calling thread is always one of them.
+    if(jobs > state.descCount)
+    { jobs = state.descCount; }
+
+    if(jobs == 0)
+    { jobs = 1; }
+
+    // Inside a batch these run on the shared pool, alongside whole conversions of other modules
+    if(runParallel(pool, hashPages, &state, jobs) != SUCCESS)
+    { state.ret = ERR_OUT_OF_MEM; }
+
+    nullAndFree((void **)&state.firstPages);
+    pthread_cond_destroy(&(state.encryptTurn));
+    pthread_mutex_destroy(&(state.mutex));
+
+    if(state.ret == SUCCESS && normalComp)
+    {
+        uint8_t *compData = basefileFormat->normalCompData; // Avoid dereferencing unaligned pointer
+
+        // The block hashes are of the unencrypted data, so this is only done now
+        if(basefileFormat->encType == XEX_ENC_NORMAL)
+        { cbc_aes128_encrypt(&(state.aes), state.iv, basefileFormat->normalCompDataSize, compData, compData); }
+
+        if(existing != NULL)
+        { state.ret = writeChangedAtOffset(xex, existing, compData, basefileFormat->normalCompDataSize, offsets->basefile); }
         else
-        { sha1_digest(&shaContext, 0x14, secInfoHeader->imageSha1); }
+        { state.ret = writeAtOffset(xex, compData, basefileFormat->normalCompDataSize, offsets->basefile); }
+    }
+    else if(state.ret == SUCCESS && state.xex == NULL)
+    { state.ret = writeBasicCompRange(&(state.compMap), basefile, 0, basefile->size, xex, offsets->basefile, true, existing); }
+
+    freeBasicCompMap(&(state.compMap));
+
+    if(state.ret != SUCCESS)
+    {
+        nullAndFree((void **)&state.midstates);
+        nullAndFree((void **)&state.fingerprints);
+        return state.ret;
+    }
+
+    // Kept for the next build before the midstates are finished off below
+    if(hashCache != NULL)
+    {
+        for(uint32_t i = 0; i < state.descCount; i++)
+        {
+            hashCache->newEntries[i].fingerprint = state.fingerprints[i];
+            hashCache->newEntries[i].pageCount = descriptors[i].sizeAndInfo >> 4;
+            memcpy(hashCache->newEntries[i].state, state.midstates[i].state, sizeof(hashCache->newEntries[i].state));
+        }
+
+        hashCache->newCount = state.descCount;
+    }
+
+    // Finishing hashes for page descriptors.
+    // Each descriptor contains the hash of the data covered by the next one, so this part has to go backwards, one at a time.
+    for(int64_t i = secInfoHeader->pageDescCount - 1; i >= 0; i--)
+    {
+        // The descriptor is hashed as it's written (big endian)
+        uint8_t descriptor[sizeof(struct pageDescriptor)];
+        put32BitBE(descriptor, descriptors[i].sizeAndInfo);
+        memcpy(descriptor + sizeof(uint32_t), descriptors[i].sha1, 0x14);
+        sha1_update(&(state.midstates[i]), sizeof(descriptor), descriptor);
 
-        nullAndFree((void **)&page);
+        if(i != 0)
+        { sha1_digest(&(state.midstates[i]), 0x14, descriptors[i - 1].sha1); }
+        else
+        { sha1_digest(&(state.midstates[i]), 0x14, secInfoHeader->imageSha1); }
     }
 
+    nullAndFree((void **)&state.midstates);
+    nullAndFree((void **)&state.fingerprints);
     return SUCCESS;
 }
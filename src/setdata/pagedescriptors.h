@@ -21,5 +21,19 @@
 #include "../common/common.h"
 #include "../common/crypto.h"
 #include "../common/datastorage.h"
+#include "../common/taskpool.h"
+#include "../cache/hashcache.h"
+#include "../compress/basiccomp.h"
 
-int setPageDescriptors(FILE *pe, struct peData *peData, struct secInfoHeader *secInfoHeader);
+#include <pthread.h>
+
+// Decides which pages each page descriptor covers (up to maxRun pages with the same permissions per descriptor)
+int setPageDescriptorRuns(struct secInfoHeader *secInfoHeader, struct peData *peData, uint32_t maxRun);
+
+// Hashes the basefile page by page and copies the parts kept by basefileFormat into the XEX (at offsets->basefile), either as it goes
+// or, for a file-backed basefile, in-kernel once hashing is done. Workers come from pool if it isn't NULL.
+// With a hashCache, pages found in it aren't hashed again, and the hashes for the next build are left in it's newEntries.
+// With existing, the XEX is being updated in place and only data which differs from it is written.
+int setPageDescriptors(struct basefile *basefile, struct peData *peData, struct secInfoHeader *secInfoHeader,
+                       struct basefileFormat *basefileFormat, struct offsets *offsets, FILE *xex, uint32_t jobs,
+                       struct taskPool *pool, struct pageHashCache *hashCache, const struct mappedFile *existing);
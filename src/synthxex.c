@@ -0,0 +1,212 @@
+// This file is part of SynthXEX, one component of the
+// OpenXeChain development toolchain
+//
+// Copyright (c) 2025 Aiden Isik
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "synthxex.h"
+#include "convert/convert.h"
+#include "server/server.h"
+
+#ifdef _WIN32
+    #include <io.h>
+#else
+    #include <unistd.h>
+    #include <sys/mman.h>
+#endif
+
+// Fills in a convertOptions from the public options, applying defaults for anything left as 0/NULL
+int getConvertOptions(const struct synthxexOptions *options, struct convertOptions *convertOptions)
+{
+    memset(convertOptions, 0, sizeof(struct convertOptions));
+    convertOptions->compMode = COMP_MODE_BASIC;
+    convertOptions->maxPageRun = 1;
+    convertOptions->jobs = 1;
+    convertOptions->memLimit = 1024 * 1024 * 1024;
+
+    if(options == NULL)
+    { return SUCCESS; }
+
+    if(options->type != NULL && !parseModuleType(options->type, &(convertOptions->moduleFlags)))
+    { return ERR_INVALID_OPTION; }
+
+    if(options->compression != NULL && !parseCompMode(options->compression, &(convertOptions->compMode)))
+    { return ERR_INVALID_OPTION; }
+
+    if(options->maxPageRun > XEX_PAGE_DESC_MAX_RUN)
+    { return ERR_INVALID_OPTION; }
+
+    convertOptions->encrypt = options->encrypt;
+    convertOptions->skipMachineCheck = options->skipMachineCheck;
+
+    if(options->maxPageRun != 0)
+    { convertOptions->maxPageRun = options->maxPageRun; }
+
+    if(options->jobs != 0)
+    { convertOptions->jobs = options->jobs; }
+
+    if(options->memLimit != 0)
+    { convertOptions->memLimit = (uint64_t)options->memLimit * 1024 * 1024; }
+
+    return SUCCESS;
+}
+
+// Converts pe into the already open xex
+int convertBufferTo(const uint8_t *pe, size_t peSize, const struct synthxexOptions *options, FILE *xex)
+{
+    struct convertOptions convertOptions;
+    int ret = getConvertOptions(options, &convertOptions);
+
+    if(ret != SUCCESS)
+    { return ret; }
+
+    struct convertContext context;
+    ret = initConvertContext(&context, &convertOptions);
+
+    if(ret != SUCCESS)
+    { return ret; }
+
+    useBufferAsInput(pe, peSize, &(context.pe));
+    context.xex = xex;
+    ret = runOpenedConversion(&context);
+
+    // The XEX belongs to the caller
+    context.xex = NULL;
+    freeConvertContext(&context);
+    return ret;
+}
+
+// Somewhere to build a XEX in memory. On Linux that's a memfd, which the page hashing and
+// basefile copying can write to just like a file. Elsewhere it falls back to an anonymous temporary file.
+FILE *openMemoryFile()
+{
+#ifdef __linux__
+    int fd = memfd_create("synthxex", MFD_CLOEXEC);
+
+    if(fd >= 0)
+    {
+        FILE *file = fdopen(fd, "wb+");
+
+        if(file != NULL)
+        { return file; }
+
+        close(fd);
+    }
+
+#endif
+
+    return tmpfile();
+}
+
+int synthxexConvertBuffer(const uint8_t *pe, size_t peSize, const struct synthxexOptions *options, uint8_t **xex, size_t *xexSize)
+{
+    *xex = NULL;
+    *xexSize = 0;
+
+    FILE *file = openMemoryFile();
+
+    if(file == NULL)
+    { return ERR_XEX_CREATE; }
+
+    int ret = convertBufferTo(pe, peSize, options, file);
+
+    if(ret == SUCCESS)
+    {
+        long size = -1;
+
+        if(fseek(file, 0, SEEK_END) == 0)
+        { size = ftell(file); }
+
+        if(size > 0)
+        { *xex = malloc(size); }
+
+        if(size <= 0 || fseek(file, 0, SEEK_SET) != 0)
+        { ret = ERR_FILE_READ; }
+        else if(*xex == NULL)
+        { ret = ERR_OUT_OF_MEM; }
+        else if(fread(*xex, sizeof(uint8_t), size, file) != (size_t)size)
+        {
+            nullAndFree((void **)xex);
+            ret = ERR_FILE_READ;
+        }
+        else
+        { *xexSize = size; }
+    }
+
+    fclose(file);
+    return ret;
+}
+
+int synthxexConvertToFd(const uint8_t *pe, size_t peSize, const struct synthxexOptions *options, int fd)
+{
+    // Our own descriptor, so closing the stream leaves the caller's alone
+    int ownFd = dup(fd);
+
+    if(ownFd < 0)
+    { return ERR_FILE_OPEN; }
+
+    FILE *file = fdopen(ownFd, "wb+");
+
+    if(file == NULL)
+    {
+        close(ownFd);
+        return ERR_FILE_OPEN;
+    }
+
+    int ret = convertBufferTo(pe, peSize, options, file);
+
+    if(fclose(file) != 0 && ret == SUCCESS)
+    { ret = ERR_FILE_WRITE; }
+
+    return ret;
+}
+
+int synthxexConvertViaServer(const char *socketPath, int peFd, int xexFd, const struct synthxexOptions *options)
+{
+    struct convertOptions convertOptions;
+    int ret = getConvertOptions(options, &convertOptions);
+
+    if(ret != SUCCESS)
+    { return ret; }
+
+    int sock;
+    ret = connectToServer(socketPath, &sock);
+
+    if(ret != SUCCESS)
+    { return ret; }
+
+    ret = requestConversion(sock, peFd, xexFd, &convertOptions);
+    close(sock);
+    return ret;
+}
+
+void synthxexFreeBuffer(uint8_t **xex)
+{
+    nullAndFree((void **)xex);
+}
+
+const char *synthxexErrorString(int error)
+{
+    if(error == SUCCESS)
+    { return "Success."; }
+
+    const char *message = getErrorString(error);
+    return (message != NULL) ? message : "Unknown error.";
+}
+
+const char *synthxexVersion()
+{
+    return SYNTHXEX_VERSION_STRING;
+}
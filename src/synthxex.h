@@ -0,0 +1,78 @@
+// This file is part of SynthXEX, one component of the
+// OpenXeChain development toolchain
+//
+// Copyright (c) 2025 Aiden Isik
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// libsynthxex: converts a PE image in memory into a XEX, without a process or temporary files.
+// This is the library's public interface, it's all a program linking against it needs.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Only these functions are exported from a shared libsynthxex, everything else is built hidden
+#if defined(__GNUC__) && !defined(_WIN32)
+    #define SYNTHXEX_API __attribute__((visibility("default")))
+#else
+    #define SYNTHXEX_API
+#endif
+
+// Returned on success. Anything else is a (negative) error, see synthxexErrorString.
+#define SYNTHXEX_SUCCESS 0
+
+// How to build the XEX. A NULL options pointer, or an all-zero struct, gives the same XEX as
+// running synthxex with no options.
+struct synthxexOptions
+{
+    const char *type; // Executable type override (title, titledll, sysdll, dll), NULL to detect it
+    const char *compression; // Basefile compression (none, basic, fast, default, max), NULL for basic
+    bool encrypt; // Encrypt the basefile with a random key
+    bool skipMachineCheck; // Skip the PE file machine ID check
+    uint32_t maxPageRun; // Most pages one page descriptor may cover, 0 for 1 (no coalescing)
+    uint32_t jobs; // Threads to use, 0 for 1
+    uint32_t memLimit; // Largest basefile to keep in memory, in MiB, 0 for the default (1024)
+};
+
+// Converts the peSize byte PE at pe. On success, *xex points to the XEX (free it with synthxexFreeBuffer)
+// and *xexSize is it's size.
+SYNTHXEX_API int synthxexConvertBuffer(const uint8_t *pe, size_t peSize, const struct synthxexOptions *options, uint8_t **xex, size_t *xexSize);
+
+// Converts the peSize byte PE at pe and writes the XEX to fd, from offset 0. fd must be an empty, seekable file
+// open for reading and writing (a regular file or a memfd, not a pipe). It's left open.
+SYNTHXEX_API int synthxexConvertToFd(const uint8_t *pe, size_t peSize, const struct synthxexOptions *options, int fd);
+
+// Has the server listening on socketPath (synthxex --server) convert the PE open on peFd into xexFd, which
+// must be an empty file open for reading and writing. Both are left open. Not available on Windows.
+SYNTHXEX_API int synthxexConvertViaServer(const char *socketPath, int peFd, int xexFd, const struct synthxexOptions *options);
+
+// Frees a XEX returned by synthxexConvertBuffer and sets the pointer to NULL
+SYNTHXEX_API void synthxexFreeBuffer(uint8_t **xex);
+
+// Describes an error returned by the functions above
+SYNTHXEX_API const char *synthxexErrorString(int error);
+
+// Name and version of the library, e.g. "SynthXEX v0.0.5"
+SYNTHXEX_API const char *synthxexVersion(void);
+
+#ifdef __cplusplus
+}
+#endif
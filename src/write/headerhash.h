@@ -22,4 +22,4 @@
 #include "../common/crypto.h"
 #include "../common/datastorage.h"
 
-int setHeaderSha1(FILE *xex);
+void setHeaderSha1(uint8_t *headers, struct offsets *offsets);
@@ -18,189 +18,150 @@
 
 #include "writexex.h"
 
-// TEMPORARY WRITE TESTING
-int writeXEX(struct xexHeader *xexHeader, struct optHeaderEntries *optHeaderEntries, struct secInfoHeader *secInfoHeader, struct optHeaders *optHeaders, struct offsets *offsets, FILE *pe, FILE *xex)
+// Everything before the basefile is assembled in memory, so the header hash can be taken from there
+// and the whole header region goes out in one write. The basefile itself is already in place (see setPageDescriptors).
+// The structs passed in are left as they are (host byte order), byteswapping happens on copies.
+int writeXEX(const struct xexHeader *xexHeader, const struct optHeaderEntries *optHeaderEntries, const struct secInfoHeader *secInfoHeader,
+             const struct optHeaders *optHeaders, struct offsets *offsets, FILE *xex)
 {
+    // Calloc, so any padding between structs is zeroed
+    uint8_t *headers = calloc(offsets->basefile, sizeof(uint8_t));
+
+    if(headers == NULL)
+    { return ERR_OUT_OF_MEM; }
+
     // XEX Header
+    struct xexHeader xexHeaderOut = *xexHeader;
+
 #ifdef LITTLE_ENDIAN_SYSTEM
     // Endian-swap XEX header before writing
-    xexHeader->moduleFlags = __builtin_bswap32(xexHeader->moduleFlags);
-    xexHeader->peOffset = __builtin_bswap32(xexHeader->peOffset);
-    xexHeader->secInfoOffset = __builtin_bswap32(xexHeader->secInfoOffset);
-    xexHeader->optHeaderCount = __builtin_bswap32(xexHeader->optHeaderCount);
+    xexHeaderOut.moduleFlags = __builtin_bswap32(xexHeaderOut.moduleFlags);
+    xexHeaderOut.peOffset = __builtin_bswap32(xexHeaderOut.peOffset);
+    xexHeaderOut.secInfoOffset = __builtin_bswap32(xexHeaderOut.secInfoOffset);
+    xexHeaderOut.optHeaderCount = __builtin_bswap32(xexHeaderOut.optHeaderCount);
 #endif
 
-    fseek(xex, offsets->xexHeader, SEEK_SET);
-    fwrite(xexHeader, sizeof(uint8_t), sizeof(struct xexHeader), xex);
+    memcpy(headers + offsets->xexHeader, &xexHeaderOut, sizeof(struct xexHeader));
 
     // Optional header entries
-#ifdef LITTLE_ENDIAN_SYSTEM
+    uint8_t *currentPos = headers + offsets->optHeaderEntries;
 
-    // Endian swap opt header entries
     for(uint32_t i = 0; i < optHeaderEntries->count; i++)
     {
-        optHeaderEntries->optHeaderEntry[i].id = __builtin_bswap32(optHeaderEntries->optHeaderEntry[i].id);
-        optHeaderEntries->optHeaderEntry[i].dataOrOffset = __builtin_bswap32(optHeaderEntries->optHeaderEntry[i].dataOrOffset);
+        put32BitBE(currentPos, optHeaderEntries->optHeaderEntry[i].id);
+        put32BitBE(currentPos + sizeof(uint32_t), optHeaderEntries->optHeaderEntry[i].dataOrOffset);
+        currentPos += sizeof(struct optHeaderEntry);
     }
 
-#endif
-
-    fseek(xex, offsets->optHeaderEntries, SEEK_SET);
-
-    for(int i = 0; i < optHeaderEntries->count; i++)
-    { fwrite(&(optHeaderEntries->optHeaderEntry[i]), sizeof(uint8_t), sizeof(struct optHeaderEntry), xex); }
-
     // Page descriptors
-    fseek(xex, offsets->secInfoHeader + sizeof(struct secInfoHeader) - sizeof(void *), SEEK_SET);
+    currentPos = headers + offsets->secInfoHeader + sizeof(struct secInfoHeader) - sizeof(void *);
 
     // So we don't try to dereference an unaligned pointer
-    struct pageDescriptor *descriptors = secInfoHeader->descriptors;
+    const struct pageDescriptor *descriptors = secInfoHeader->descriptors;
 
     for(int i = 0; i < secInfoHeader->pageDescCount; i++)
     {
-#ifdef LITTLE_ENDIAN_SYSTEM
-        descriptors[i].sizeAndInfo = __builtin_bswap32(descriptors[i].sizeAndInfo);
-#endif
-
         // Writing out current descriptor...
-        fwrite(&(descriptors[i].sizeAndInfo), sizeof(uint32_t), 0x1, xex);
-        fwrite(descriptors[i].sha1, sizeof(uint8_t), 0x14, xex);
+        put32BitBE(currentPos, descriptors[i].sizeAndInfo);
+        memcpy(currentPos + sizeof(uint32_t), descriptors[i].sha1, 0x14);
+        currentPos += sizeof(struct pageDescriptor);
     }
 
-    // Basefile
-    fseek(pe, 0x0, SEEK_SET);
-    fseek(xex, offsets->basefile, SEEK_SET);
-
-    uint16_t readBufSize = 0x1000; // Reading in 4KiB at a time to avoid excessive memory usage
-    uint8_t *buffer = malloc(readBufSize *sizeof(uint8_t));
-
-    if(buffer == NULL)
-    { return ERR_OUT_OF_MEM; }
-
-    for(uint32_t i = 0; i < secInfoHeader->peSize; i += readBufSize)
-    {
-        size_t bytesToRead = (secInfoHeader->peSize - i < readBufSize)
-                             ? secInfoHeader->peSize - i
-                             : readBufSize;
-
-        size_t readRet = fread(buffer, sizeof(uint8_t), bytesToRead, pe);
-
-        if(readRet != bytesToRead)
-        { break; }
-
-        size_t writeRet = fwrite(buffer, sizeof(uint8_t), readRet, xex);
-
-        if(writeRet != readRet)
-        { break; }
-    }
-
-    nullAndFree((void **)&buffer);
-
     // Security Info
+    struct secInfoHeader secInfoHeaderOut = *secInfoHeader;
+
 #ifdef LITTLE_ENDIAN_SYSTEM
     // Endian-swap secinfo header
-    secInfoHeader->headerSize = __builtin_bswap32(secInfoHeader->headerSize);
-    secInfoHeader->peSize = __builtin_bswap32(secInfoHeader->peSize);
-    secInfoHeader->imageInfoSize = __builtin_bswap32(secInfoHeader->imageInfoSize);
-    secInfoHeader->imageFlags = __builtin_bswap32(secInfoHeader->imageFlags);
-    secInfoHeader->baseAddr = __builtin_bswap32(secInfoHeader->baseAddr);
-    secInfoHeader->importTableCount = __builtin_bswap32(secInfoHeader->importTableCount);
-    secInfoHeader->exportTableAddr = __builtin_bswap32(secInfoHeader->exportTableAddr);
-    secInfoHeader->gameRegion = __builtin_bswap32(secInfoHeader->gameRegion);
-    secInfoHeader->mediaTypes = __builtin_bswap32(secInfoHeader->mediaTypes);
-    secInfoHeader->pageDescCount = __builtin_bswap32(secInfoHeader->pageDescCount);
+    secInfoHeaderOut.headerSize = __builtin_bswap32(secInfoHeaderOut.headerSize);
+    secInfoHeaderOut.peSize = __builtin_bswap32(secInfoHeaderOut.peSize);
+    secInfoHeaderOut.imageInfoSize = __builtin_bswap32(secInfoHeaderOut.imageInfoSize);
+    secInfoHeaderOut.imageFlags = __builtin_bswap32(secInfoHeaderOut.imageFlags);
+    secInfoHeaderOut.baseAddr = __builtin_bswap32(secInfoHeaderOut.baseAddr);
+    secInfoHeaderOut.importTableCount = __builtin_bswap32(secInfoHeaderOut.importTableCount);
+    secInfoHeaderOut.exportTableAddr = __builtin_bswap32(secInfoHeaderOut.exportTableAddr);
+    secInfoHeaderOut.gameRegion = __builtin_bswap32(secInfoHeaderOut.gameRegion);
+    secInfoHeaderOut.mediaTypes = __builtin_bswap32(secInfoHeaderOut.mediaTypes);
+    secInfoHeaderOut.pageDescCount = __builtin_bswap32(secInfoHeaderOut.pageDescCount);
 #endif
 
-    fseek(xex, offsets->secInfoHeader, SEEK_SET);
-    fwrite(secInfoHeader, sizeof(uint8_t), sizeof(struct secInfoHeader) - sizeof(void *), xex); // sizeof(void*) == size of page descriptor pointer at end
+    memcpy(headers + offsets->secInfoHeader, &secInfoHeaderOut, sizeof(struct secInfoHeader) - sizeof(void *)); // sizeof(void*) == size of page descriptor pointer at end
 
     // Optional headers
     uint32_t currentHeader = 0;
 
     if(optHeaders->basefileFormat.size != 0) // If not 0, it has data. Write it.
     {
-        fseek(xex, offsets->optHeaders[currentHeader], SEEK_SET);
+        // Use this to avoid dereferencing an unaligned pointer
+        const struct basicCompBlock *blocks = optHeaders->basefileFormat.blocks;
 
-#ifdef LITTLE_ENDIAN_SYSTEM
-        optHeaders->basefileFormat.size = __builtin_bswap32(optHeaders->basefileFormat.size);
-        optHeaders->basefileFormat.encType = __builtin_bswap16(optHeaders->basefileFormat.encType);
-        optHeaders->basefileFormat.compType = __builtin_bswap16(optHeaders->basefileFormat.compType);
-        optHeaders->basefileFormat.dataSize = __builtin_bswap32(optHeaders->basefileFormat.dataSize);
-        optHeaders->basefileFormat.zeroSize = __builtin_bswap32(optHeaders->basefileFormat.zeroSize);
-#endif
+        currentPos = headers + offsets->optHeaders[currentHeader];
+        put32BitBE(currentPos, optHeaders->basefileFormat.size);
+        put16BitBE(currentPos + 4, optHeaders->basefileFormat.encType);
+        put16BitBE(currentPos + 6, optHeaders->basefileFormat.compType);
+        currentPos += 8;
+
+        if(optHeaders->basefileFormat.compType == XEX_COMP_NORMAL)
+        {
+            put32BitBE(currentPos, optHeaders->basefileFormat.windowSize);
+            put32BitBE(currentPos + sizeof(uint32_t), optHeaders->basefileFormat.firstBlock.size);
+            memcpy(currentPos + (2 * sizeof(uint32_t)), optHeaders->basefileFormat.firstBlock.sha1, 0x14);
+        }
+        else
+        {
+            uint32_t blockCount = (optHeaders->basefileFormat.size - 8) / sizeof(struct basicCompBlock);
+
+            for(uint32_t i = 0; i < blockCount; i++)
+            {
+                put32BitBE(currentPos, blocks[i].dataSize);
+                put32BitBE(currentPos + sizeof(uint32_t), blocks[i].zeroSize);
+                currentPos += sizeof(struct basicCompBlock);
+            }
+        }
 
-        fwrite(&(optHeaders->basefileFormat), sizeof(uint8_t), sizeof(struct basefileFormat), xex);
         currentHeader++;
     }
 
     if(optHeaders->importLibraries.size != 0)
     {
-        fseek(xex, offsets->optHeaders[currentHeader], SEEK_SET);
+        currentPos = headers + offsets->optHeaders[currentHeader];
 
         // Write the main header first
 
         // Use these to avoid dereferencing an unaligned pointer
-        char *nameTable = optHeaders->importLibraries.nameTable;
-
-        // Save the values we need to use before byteswapping
+        const char *nameTable = optHeaders->importLibraries.nameTable;
         uint32_t nameTableSize = optHeaders->importLibraries.nameTableSize;
         uint32_t tableCount = optHeaders->importLibraries.tableCount;
 
-#ifdef LITTLE_ENDIAN_SYSTEM
-        optHeaders->importLibraries.size = __builtin_bswap32(optHeaders->importLibraries.size);
-        optHeaders->importLibraries.nameTableSize = __builtin_bswap32(optHeaders->importLibraries.nameTableSize);
-        optHeaders->importLibraries.tableCount = __builtin_bswap32(optHeaders->importLibraries.tableCount);
-#endif
-
-        fwrite(&(optHeaders->importLibraries), sizeof(uint8_t), sizeof(struct importLibraries) - (2 * sizeof(void *)), xex);
-        fwrite(nameTable, sizeof(uint8_t), nameTableSize, xex);
-
-#ifdef LITTLE_ENDIAN_SYSTEM
-        // Restore the table count (we require it to free the import libraries struct later)
-        optHeaders->importLibraries.tableCount = tableCount;
-#endif
+        put32BitBE(currentPos, optHeaders->importLibraries.size);
+        put32BitBE(currentPos + 4, nameTableSize);
+        put32BitBE(currentPos + 8, tableCount);
+        currentPos += sizeof(struct importLibraries) - (2 * sizeof(void *));
+        memcpy(currentPos, nameTable, nameTableSize);
+        currentPos += nameTableSize;
 
         // Now write each import table
         // Use this to avoid dereferencing an unaligned pointer
-        struct importTable *importTables = optHeaders->importLibraries.importTables;
+        const struct importTable *importTables = optHeaders->importLibraries.importTables;
 
         for(uint32_t i = 0; i < tableCount; i++)
-        {
-            uint32_t *addresses = importTables[i].addresses; // Use this to avoid dereferencing an unaligned pointer
-            uint16_t addressCount = importTables[i].addressCount;
-
-#ifdef LITTLE_ENDIAN_SYSTEM
-            importTables[i].size = __builtin_bswap32(importTables[i].size);
-            importTables[i].unknown = __builtin_bswap32(importTables[i].unknown);
-            importTables[i].targetVer = __builtin_bswap32(importTables[i].targetVer);
-            importTables[i].minimumVer = __builtin_bswap32(importTables[i].minimumVer);
-            importTables[i].addressCount = __builtin_bswap16(importTables[i].addressCount);
-
-            for(uint16_t j = 0; j < addressCount; j++)
-            { addresses[j] = __builtin_bswap32(addresses[j]); }
-
-#endif
-
-            fwrite(&(importTables[i]), sizeof(uint8_t), sizeof(struct importTable) - sizeof(void *), xex);
-            fwrite(addresses, sizeof(uint32_t), addressCount, xex);
-        }
+        { currentPos += serialiseImportTable(&(importTables[i]), currentPos); }
 
         currentHeader++;
     }
 
     if(optHeaders->tlsInfo.slotCount != 0)
     {
-        fseek(xex, offsets->optHeaders[currentHeader], SEEK_SET);
-
-#ifdef LITTLE_ENDIAN_SYSTEM
-        optHeaders->tlsInfo.slotCount = __builtin_bswap32(optHeaders->tlsInfo.slotCount);
-        optHeaders->tlsInfo.rawDataAddr = __builtin_bswap32(optHeaders->tlsInfo.rawDataAddr);
-        optHeaders->tlsInfo.dataSize = __builtin_bswap32(optHeaders->tlsInfo.dataSize);
-        optHeaders->tlsInfo.rawDataSize = __builtin_bswap32(optHeaders->tlsInfo.rawDataSize);
-#endif
-
-        fwrite(&(optHeaders->tlsInfo), sizeof(uint8_t), sizeof(struct tlsInfo), xex);
+        currentPos = headers + offsets->optHeaders[currentHeader];
+        put32BitBE(currentPos, optHeaders->tlsInfo.slotCount);
+        put32BitBE(currentPos + 4, optHeaders->tlsInfo.rawDataAddr);
+        put32BitBE(currentPos + 8, optHeaders->tlsInfo.dataSize);
+        put32BitBE(currentPos + 12, optHeaders->tlsInfo.rawDataSize);
     }
 
-    return SUCCESS;
+    // Header hash, then out it all goes
+    setHeaderSha1(headers, offsets);
+
+    int ret = writeAtOffset(xex, headers, offsets->basefile, 0);
+    nullAndFree((void **)&headers);
+    return ret;
 }
@@ -20,5 +20,7 @@
 
 #include "../common/common.h"
 #include "../common/datastorage.h"
+#include "headerhash.h"
 
-int writeXEX(struct xexHeader *xexHeader, struct optHeaderEntries *optHeaderEntries, struct secInfoHeader *secInfoHeader, struct optHeaders *optHeaders, struct offsets *offsets, FILE *pe, FILE *xex);
+int writeXEX(const struct xexHeader *xexHeader, const struct optHeaderEntries *optHeaderEntries, const struct secInfoHeader *secInfoHeader,
+             const struct optHeaders *optHeaders, struct offsets *offsets, FILE *xex);